@@ -128,6 +128,9 @@ static void print_stat(struct seq_file *m, struct blk_rq_stat *stat)
 	if (stat->nr_samples) {
 		seq_printf(m, "samples=%d, mean=%lld, min=%llu, max=%llu",
 			   stat->nr_samples, stat->mean, stat->min, stat->max);
+		if (stat->p99)
+			seq_printf(m, ", p50=%llu, p90=%llu, p99=%llu",
+				   stat->p50, stat->p90, stat->p99);
 	} else {
 		seq_puts(m, "samples=0");
 	}
@@ -425,10 +428,25 @@ out:
 static int hctx_io_poll_show(void *data, struct seq_file *m)
 {
 	struct blk_mq_hw_ctx *hctx = data;
+	struct blk_mq_poll_ctl *ctl = READ_ONCE(hctx->poll_ctl);
+	static const char *const ddir_name[] = { "read", "write" };
+	int ddir;
 
 	seq_printf(m, "considered=%lu\n", hctx->poll_considered);
 	seq_printf(m, "invoked=%lu\n", hctx->poll_invoked);
 	seq_printf(m, "success=%lu\n", hctx->poll_success);
+	seq_printf(m, "slept=%lu\n", hctx->poll_slept);
+	seq_printf(m, "spin_ns=%lu\n", hctx->poll_spin_ns);
+	seq_printf(m, "gave_up=%lu\n", hctx->poll_gave_up);
+
+	if (!ctl)
+		return 0;
+	for (ddir = 0; ddir < 2; ddir++) {
+		seq_printf(m, "%s: sleep_ns=%u tail_ns=%u added_ns=%u spin_ns=%u saved_ns=%u\n",
+			   ddir_name[ddir], ctl->sleep_nsec[ddir],
+			   ctl->tail_nsec[ddir], ctl->added_nsec[ddir],
+			   ctl->spin_nsec[ddir], ctl->saved_nsec[ddir]);
+	}
 	return 0;
 }
 
@@ -438,6 +456,7 @@ static ssize_t hctx_io_poll_write(void *data, const char __user *buf,
 	struct blk_mq_hw_ctx *hctx = data;
 
 	hctx->poll_considered = hctx->poll_invoked = hctx->poll_success = 0;
+	hctx->poll_slept = hctx->poll_spin_ns = hctx->poll_gave_up = 0;
 	return count;
 }
 
@@ -16,6 +16,9 @@
 #include "blk-mq-tag.h"
 #include "blk-wbt.h"
 
+/* Requests taken from the scheduler at once for drivers with ->queue_rqs() */
+#define BLK_MQ_SCHED_DISPATCH_BATCH	16
+
 void blk_mq_sched_free_hctx_data(struct request_queue *q,
 				 void (*exit)(struct blk_mq_hw_ctx *))
 {
@@ -172,6 +175,30 @@ void blk_mq_sched_put_request(struct request *rq)
 		blk_mq_finish_request(rq);
 }
 
+/*
+ * Take requests from the scheduler for the driver. One at a time, so that
+ * the rest stay available for merging and sorting, unless the driver can
+ * take up to BLK_MQ_SCHED_DISPATCH_BATCH of them at once.
+ */
+static unsigned int blk_mq_sched_pull_requests(struct blk_mq_hw_ctx *hctx,
+					       struct list_head *list)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+	unsigned int max = hctx->queue->mq_ops->queue_rqs ?
+			   BLK_MQ_SCHED_DISPATCH_BATCH : 1;
+	unsigned int nr = 0;
+	struct request *rq;
+
+	while (nr < max) {
+		rq = e->type->ops.mq.dispatch_request(hctx);
+		if (!rq)
+			break;
+		list_add_tail(&rq->queuelist, list);
+		nr++;
+	}
+	return nr;
+}
+
 void blk_mq_sched_dispatch_requests(struct blk_mq_hw_ctx *hctx)
 {
 	struct request_queue *q = hctx->queue;
@@ -220,12 +247,8 @@ void blk_mq_sched_dispatch_requests(struct blk_mq_hw_ctx *hctx)
 	 */
 	if (!did_work && has_sched_dispatch) {
 		do {
-			struct request *rq;
-
-			rq = e->type->ops.mq.dispatch_request(hctx);
-			if (!rq)
+			if (!blk_mq_sched_pull_requests(hctx, &rq_list))
 				break;
-			list_add(&rq->queuelist, &rq_list);
 		} while (blk_mq_dispatch_rq_list(q, &rq_list));
 	}
 }
@@ -23,6 +23,7 @@ static void blk_mq_hw_sysfs_release(struct kobject *kobj)
 						  kobj);
 	free_cpumask_var(hctx->cpumask);
 	kfree(hctx->ctxs);
+	kfree(hctx->poll_ctl);
 	kfree(hctx);
 }
 
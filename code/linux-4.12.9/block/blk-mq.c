@@ -39,6 +39,7 @@
 
 static void blk_mq_poll_stats_start(struct request_queue *q);
 static void blk_mq_poll_stats_fn(struct blk_stat_callback *cb);
+static void blk_mq_poll_account(struct request *rq);
 static void __blk_mq_stop_hw_queues(struct request_queue *q, bool sync);
 
 static int blk_mq_poll_stats_bkt(const struct request *rq)
@@ -432,6 +433,7 @@ static void __blk_mq_complete_request(struct request *rq)
 	if (rq->rq_flags & RQF_STATS) {
 		blk_mq_poll_stats_start(rq->q);
 		blk_stat_add(rq);
+		blk_mq_poll_account(rq);
 	}
 
 	if (!test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags)) {
@@ -961,6 +963,39 @@ static bool blk_mq_dispatch_wait_add(struct blk_mq_hw_ctx *hctx)
 	return true;
 }
 
+/*
+ * Hand the requests at the front of @list that we can get a driver tag for
+ * to ->queue_rqs() in one go. The ones the driver didn't take are put back
+ * in order. Returns the number of requests the driver took.
+ */
+static int blk_mq_dispatch_rq_batch(struct request_queue *q,
+				    struct list_head *list,
+				    struct blk_mq_hw_ctx **hctx)
+{
+	struct request *rq, *next;
+	LIST_HEAD(batch);
+	int nr = 0;
+
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		if (!blk_mq_get_driver_tag(rq, hctx, false))
+			break;
+		list_move_tail(&rq->queuelist, &batch);
+		nr++;
+	}
+
+	/* not worth it for a single request */
+	if (nr > 1) {
+		q->mq_ops->queue_rqs(*hctx, &batch);
+		list_for_each_entry(rq, &batch, queuelist)
+			nr--;
+	} else {
+		nr = 0;
+	}
+
+	list_splice(&batch, list);
+	return nr;
+}
+
 bool blk_mq_dispatch_rq_list(struct request_queue *q, struct list_head *list)
 {
 	struct blk_mq_hw_ctx *hctx;
@@ -974,7 +1009,10 @@ bool blk_mq_dispatch_rq_list(struct request_queue *q, struct list_head *list)
 	 * Now process all the entries, sending them to the driver.
 	 */
 	errors = queued = 0;
-	do {
+	if (q->mq_ops->queue_rqs)
+		queued = blk_mq_dispatch_rq_batch(q, list, &hctx);
+
+	while (!list_empty(list)) {
 		struct blk_mq_queue_data bd;
 
 		rq = list_first_entry(list, struct request, queuelist);
@@ -1035,7 +1073,7 @@ bool blk_mq_dispatch_rq_list(struct request_queue *q, struct list_head *list)
 
 		if (ret == BLK_MQ_RQ_QUEUE_BUSY)
 			break;
-	} while (!list_empty(list));
+	}
 
 	hctx->dispatched[queued_to_index(queued)]++;
 
@@ -1045,11 +1083,13 @@ bool blk_mq_dispatch_rq_list(struct request_queue *q, struct list_head *list)
 	 */
 	if (!list_empty(list)) {
 		/*
-		 * If an I/O scheduler has been configured and we got a driver
-		 * tag for the next request already, free it again.
+		 * If an I/O scheduler has been configured and we got driver
+		 * tags for the next requests already, free them again. That
+		 * is the whole batch ->queue_rqs() didn't take, not just the
+		 * first request.
 		 */
-		rq = list_first_entry(list, struct request, queuelist);
-		blk_mq_put_driver_tag(rq);
+		list_for_each_entry(rq, list, queuelist)
+			blk_mq_put_driver_tag(rq);
 
 		spin_lock(&hctx->lock);
 		list_splice_init(list, &hctx->dispatch);
@@ -2644,6 +2684,121 @@ static void blk_mq_poll_stats_fn(struct blk_stat_callback *cb)
 	}
 }
 
+/* Completions after which the poll sleep of a hardware queue is redone */
+#define BLK_MQ_POLL_WINDOW	1024
+/* Percentile of the completion time after which spinning is given up */
+#define BLK_MQ_POLL_TAIL_PCT	99
+
+static u64 blk_mq_poll_hist_mid(unsigned int idx)
+{
+	u64 start = idx ? blk_stat_hist_bucket_end(idx - 1) : 0;
+
+	return (start + blk_stat_hist_bucket_end(idx)) / 2;
+}
+
+/*
+ * Pick the sleep after issue for requests of direction @ddir that saves the
+ * most spinning while adding at most q->poll_target_nsec to their mean
+ * completion time, going by the completion times in @ctl. For a sleep s, a
+ * request completing at t adds max(s - t, 0) to its completion time and
+ * leaves max(t - s, 0) of spinning. Also pick when to stop spinning on the
+ * tail requests and leave them to the completion interrupt.
+ */
+static void blk_mq_poll_adapt(struct request_queue *q,
+			      struct blk_mq_poll_ctl *ctl, int ddir)
+{
+	struct blk_rq_hist *hist = &ctl->hist[ddir];
+	u64 total = 0, sum = 0, below = 0, sum_below = 0;
+	u64 sleep = 0, added = 0, spin, tail = 0;
+	u64 budget, end, cost, n;
+	unsigned int i;
+
+	for (i = 0; i < BLK_STAT_HIST_BUCKETS; i++) {
+		n = hist->buckets[i];
+		total += n;
+		sum += n * blk_mq_poll_hist_mid(i);
+	}
+	if (!total)
+		return;
+
+	/* the added completion time only grows with the sleep */
+	budget = (u64)READ_ONCE(q->poll_target_nsec) * total;
+	spin = sum;
+	for (i = 0; i < BLK_STAT_HIST_BUCKETS; i++) {
+		n = hist->buckets[i];
+		end = blk_stat_hist_bucket_end(i);
+		below += n;
+		sum_below += n * blk_mq_poll_hist_mid(i);
+
+		cost = below * end - sum_below;
+		if (cost <= budget) {
+			sleep = end;
+			added = cost;
+			spin = (sum - sum_below) - (total - below) * end;
+		}
+		if (!tail && below * 100 >= total * BLK_MQ_POLL_TAIL_PCT)
+			tail = end;
+	}
+
+	ctl->sleep_nsec[ddir] = min_t(u64, sleep, UINT_MAX);
+	ctl->tail_nsec[ddir] = tail > sleep ? min_t(u64, tail, UINT_MAX) : 0;
+	ctl->added_nsec[ddir] = div64_u64(added, total);
+	ctl->spin_nsec[ddir] = div64_u64(spin, total);
+	ctl->saved_nsec[ddir] = div64_u64(sum - spin, total);
+
+	/* keep half of the history */
+	for (i = 0; i < BLK_STAT_HIST_BUCKETS; i++)
+		hist->buckets[i] >>= 1;
+	atomic_set(&ctl->nr_samples[ddir], 0);
+}
+
+static void blk_mq_poll_account(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(rq->q, rq->mq_ctx->cpu);
+	struct blk_mq_poll_ctl *ctl = READ_ONCE(hctx->poll_ctl);
+	int ddir = rq_data_dir(rq);
+	u64 now, issue;
+
+	if (!ctl)
+		return;
+
+	now = __blk_stat_time(ktime_to_ns(ktime_get()));
+	issue = blk_stat_time(&rq->issue_stat);
+	if (now < issue)
+		return;
+
+	ctl->hist[ddir].buckets[blk_stat_hist_bucket(now - issue)]++;
+	if (atomic_inc_return(&ctl->nr_samples[ddir]) == BLK_MQ_POLL_WINDOW)
+		blk_mq_poll_adapt(rq->q, ctl, ddir);
+}
+
+static unsigned long blk_mq_poll_adaptive_nsecs(struct blk_mq_hw_ctx *hctx,
+						struct request *rq)
+{
+	struct blk_mq_poll_ctl *ctl = READ_ONCE(hctx->poll_ctl);
+	u64 now, elapsed, sleep;
+
+	/* Start learning, until then don't sleep */
+	if (!ctl) {
+		ctl = kzalloc_node(sizeof(*ctl), GFP_NOWAIT | __GFP_NOWARN,
+				   hctx->numa_node);
+		if (ctl && cmpxchg(&hctx->poll_ctl, NULL, ctl))
+			kfree(ctl);
+		return 0;
+	}
+
+	if (!(rq->rq_flags & RQF_STATS))
+		return 0;
+
+	/* The sleep is counted from issue, like the completion times */
+	sleep = ctl->sleep_nsec[rq_data_dir(rq)];
+	now = __blk_stat_time(ktime_to_ns(ktime_get()));
+	elapsed = now - blk_stat_time(&rq->issue_stat);
+	if (now < blk_stat_time(&rq->issue_stat) || elapsed >= sleep)
+		return 0;
+	return sleep - elapsed;
+}
+
 static unsigned long blk_mq_poll_nsecs(struct request_queue *q,
 				       struct blk_mq_hw_ctx *hctx,
 				       struct request *rq)
@@ -2658,6 +2813,9 @@ static unsigned long blk_mq_poll_nsecs(struct request_queue *q,
 	if (!blk_poll_stats_enable(q))
 		return 0;
 
+	if (q->poll_target_nsec)
+		return blk_mq_poll_adaptive_nsecs(hctx, rq);
+
 	/*
 	 * As an optimistic guess, use half of the mean service time
 	 * for this type of request. We can (and should) make this smarter.
@@ -2707,6 +2865,7 @@ static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
 		return false;
 
 	set_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
+	hctx->poll_slept++;
 
 	/*
 	 * This will be replaced with the stats tracking code, using
@@ -2738,6 +2897,9 @@ static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
 static bool __blk_mq_poll(struct blk_mq_hw_ctx *hctx, struct request *rq)
 {
 	struct request_queue *q = hctx->queue;
+	struct blk_mq_poll_ctl *ctl = READ_ONCE(hctx->poll_ctl);
+	u64 start = 0, deadline = 0;
+	bool polled = false;
 	long state;
 
 	/*
@@ -2752,6 +2914,19 @@ static bool __blk_mq_poll(struct blk_mq_hw_ctx *hctx, struct request *rq)
 
 	hctx->poll_considered++;
 
+	/*
+	 * With adaptive polling, account the time spent spinning, and don't
+	 * spin on for tail requests, returning false makes the caller wait
+	 * for the completion interrupt instead.
+	 */
+	if (ctl && q->poll_target_nsec) {
+		start = ktime_get_ns();
+		if (ctl->tail_nsec[rq_data_dir(rq)] &&
+		    (rq->rq_flags & RQF_STATS))
+			deadline = blk_stat_time(&rq->issue_stat) +
+				   ctl->tail_nsec[rq_data_dir(rq)];
+	}
+
 	state = current->state;
 	while (!need_resched()) {
 		int ret;
@@ -2762,20 +2937,29 @@ static bool __blk_mq_poll(struct blk_mq_hw_ctx *hctx, struct request *rq)
 		if (ret > 0) {
 			hctx->poll_success++;
 			set_current_state(TASK_RUNNING);
-			return true;
+			polled = true;
+			break;
 		}
 
 		if (signal_pending_state(state, current))
 			set_current_state(TASK_RUNNING);
 
-		if (current->state == TASK_RUNNING)
-			return true;
+		if (current->state == TASK_RUNNING) {
+			polled = true;
+			break;
+		}
 		if (ret < 0)
 			break;
+		if (deadline && __blk_stat_time(ktime_get_ns()) > deadline) {
+			hctx->poll_gave_up++;
+			break;
+		}
 		cpu_relax();
 	}
 
-	return false;
+	if (start)
+		hctx->poll_spin_ns += ktime_get_ns() - start;
+	return polled;
 }
 
 bool blk_mq_poll(struct request_queue *q, blk_qc_t cookie)
@@ -5,6 +5,27 @@
 
 struct blk_mq_tag_set;
 
+/*
+ * State of adaptive hybrid polling of a hardware queue, by data direction,
+ * see blk_mq_poll_adapt(). Updated without locking, like the other poll
+ * statistics, since it only needs to be roughly right.
+ */
+struct blk_mq_poll_ctl {
+	/* completion times since issue, halved after every window */
+	struct blk_rq_hist	hist[2];
+	atomic_t		nr_samples[2];
+
+	/* sleep this long after issue before spinning */
+	unsigned int		sleep_nsec[2];
+	/* stop spinning this long after issue, 0 for never */
+	unsigned int		tail_nsec[2];
+
+	/* expected per request cost and benefit of sleep_nsec */
+	unsigned int		added_nsec[2];	/* completion time */
+	unsigned int		spin_nsec[2];	/* spinning left */
+	unsigned int		saved_nsec[2];	/* spinning avoided */
+};
+
 struct blk_mq_ctx {
 	struct {
 		spinlock_t		lock;
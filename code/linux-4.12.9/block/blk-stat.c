@@ -23,9 +23,54 @@ static void blk_stat_init(struct blk_rq_stat *stat)
 {
 	stat->min = -1ULL;
 	stat->max = stat->nr_samples = stat->mean = 0;
+	stat->p50 = stat->p90 = stat->p99 = 0;
 	stat->batch = stat->nr_batch = 0;
 }
 
+unsigned int blk_stat_hist_bucket(u64 value)
+{
+	unsigned int msb, group;
+
+	if (value < (1ULL << BLK_STAT_HIST_MIN_SHIFT))
+		return value >> (BLK_STAT_HIST_MIN_SHIFT -
+				 BLK_STAT_HIST_SUB_BITS);
+
+	msb = fls64(value) - 1;
+	group = msb - BLK_STAT_HIST_MIN_SHIFT + 1;
+	if (group >= BLK_STAT_HIST_GROUPS)
+		return BLK_STAT_HIST_BUCKETS - 1;
+
+	return group * BLK_STAT_HIST_SUB +
+	       ((value >> (msb - BLK_STAT_HIST_SUB_BITS)) &
+		(BLK_STAT_HIST_SUB - 1));
+}
+
+/* The first latency past histogram bucket @idx. */
+u64 blk_stat_hist_bucket_end(unsigned int idx)
+{
+	unsigned int group = idx / BLK_STAT_HIST_SUB;
+	unsigned int sub = idx % BLK_STAT_HIST_SUB;
+	u64 base, width;
+
+	if (!group) {
+		width = 1ULL << (BLK_STAT_HIST_MIN_SHIFT -
+				 BLK_STAT_HIST_SUB_BITS);
+		return (sub + 1) * width;
+	}
+
+	base = 1ULL << (group + BLK_STAT_HIST_MIN_SHIFT - 1);
+	width = base >> BLK_STAT_HIST_SUB_BITS;
+	return base + (sub + 1) * width;
+}
+
+static void blk_stat_hist_sum(struct blk_rq_hist *dst, struct blk_rq_hist *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < BLK_STAT_HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
 static void blk_stat_flush_batch(struct blk_rq_stat *stat)
 {
 	const s32 nr_batch = READ_ONCE(stat->nr_batch);
@@ -105,28 +150,84 @@ void blk_stat_add(struct request *rq)
 
 		stat = &get_cpu_ptr(cb->cpu_stat)[bucket];
 		__blk_stat_add(stat, value);
+		if (smp_load_acquire(&cb->hist_on))
+			this_cpu_ptr(cb->cpu_hist)[bucket].buckets[
+				blk_stat_hist_bucket(value)]++;
 		put_cpu_ptr(cb->cpu_stat);
 	}
 	rcu_read_unlock();
 }
 
+u64 blk_stat_percentile(struct blk_stat_callback *cb, unsigned int bucket,
+			unsigned int pct)
+{
+	struct blk_rq_stat *stat = &cb->stat[bucket];
+	struct blk_rq_hist *hist;
+	u64 target = 0, seen = 0;
+	unsigned int i;
+
+	if (!cb->hist || stat->nr_samples <= 0)
+		return 0;
+
+	/*
+	 * Count the histogram's samples rather than using ->nr_samples, the
+	 * two may disagree a little since neither is updated atomically.
+	 */
+	hist = &cb->hist[bucket];
+	for (i = 0; i < BLK_STAT_HIST_BUCKETS; i++)
+		target += hist->buckets[i];
+	target = DIV_ROUND_UP_ULL(target * min(pct, 100U), 100);
+
+	for (i = 0; i < BLK_STAT_HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen && seen >= target)
+			break;
+	}
+	if (i == BLK_STAT_HIST_BUCKETS)
+		return stat->max;
+
+	return clamp(blk_stat_hist_bucket_end(i), stat->min, stat->max);
+}
+EXPORT_SYMBOL_GPL(blk_stat_percentile);
+
 static void blk_stat_timer_fn(unsigned long data)
 {
 	struct blk_stat_callback *cb = (void *)data;
+	bool hist = smp_load_acquire(&cb->hist_on);
 	unsigned int bucket;
 	int cpu;
 
 	for (bucket = 0; bucket < cb->buckets; bucket++)
 		blk_stat_init(&cb->stat[bucket]);
+	if (hist)
+		memset(cb->hist, 0, cb->buckets * sizeof(struct blk_rq_hist));
 
 	for_each_online_cpu(cpu) {
 		struct blk_rq_stat *cpu_stat;
+		struct blk_rq_hist *cpu_hist;
 
 		cpu_stat = per_cpu_ptr(cb->cpu_stat, cpu);
 		for (bucket = 0; bucket < cb->buckets; bucket++) {
 			blk_stat_sum(&cb->stat[bucket], &cpu_stat[bucket]);
 			blk_stat_init(&cpu_stat[bucket]);
 		}
+
+		if (!hist)
+			continue;
+		cpu_hist = per_cpu_ptr(cb->cpu_hist, cpu);
+		for (bucket = 0; bucket < cb->buckets; bucket++)
+			blk_stat_hist_sum(&cb->hist[bucket], &cpu_hist[bucket]);
+		memset(cpu_hist, 0, cb->buckets * sizeof(struct blk_rq_hist));
+	}
+
+	if (hist) {
+		for (bucket = 0; bucket < cb->buckets; bucket++) {
+			struct blk_rq_stat *stat = &cb->stat[bucket];
+
+			stat->p50 = blk_stat_percentile(cb, bucket, 50);
+			stat->p90 = blk_stat_percentile(cb, bucket, 90);
+			stat->p99 = blk_stat_percentile(cb, bucket, 99);
+		}
 	}
 
 	cb->timer_fn(cb);
@@ -139,23 +240,18 @@ blk_stat_alloc_callback(void (*timer_fn)(struct blk_stat_callback *),
 {
 	struct blk_stat_callback *cb;
 
-	cb = kmalloc(sizeof(*cb), GFP_KERNEL);
+	cb = kzalloc(sizeof(*cb), GFP_KERNEL);
 	if (!cb)
 		return NULL;
 
 	cb->stat = kmalloc_array(buckets, sizeof(struct blk_rq_stat),
 				 GFP_KERNEL);
-	if (!cb->stat) {
-		kfree(cb);
-		return NULL;
-	}
+	if (!cb->stat)
+		goto err_cb;
 	cb->cpu_stat = __alloc_percpu(buckets * sizeof(struct blk_rq_stat),
 				      __alignof__(struct blk_rq_stat));
-	if (!cb->cpu_stat) {
-		kfree(cb->stat);
-		kfree(cb);
-		return NULL;
-	}
+	if (!cb->cpu_stat)
+		goto err_stat;
 
 	cb->timer_fn = timer_fn;
 	cb->bucket_fn = bucket_fn;
@@ -164,9 +260,50 @@ blk_stat_alloc_callback(void (*timer_fn)(struct blk_stat_callback *),
 	setup_timer(&cb->timer, blk_stat_timer_fn, (unsigned long)cb);
 
 	return cb;
+
+err_stat:
+	kfree(cb->stat);
+err_cb:
+	kfree(cb);
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(blk_stat_alloc_callback);
 
+int blk_stat_set_hist(struct blk_stat_callback *cb, bool on)
+{
+	size_t size = cb->buckets * sizeof(struct blk_rq_hist);
+	int cpu;
+
+	if (!on) {
+		WRITE_ONCE(cb->hist_on, false);
+		return 0;
+	}
+	if (cb->hist_on)
+		return 0;
+
+	if (!cb->hist) {
+		cb->hist = kzalloc(size, GFP_KERNEL);
+		if (!cb->hist)
+			return -ENOMEM;
+		cb->cpu_hist = __alloc_percpu(size,
+					      __alignof__(struct blk_rq_hist));
+		if (!cb->cpu_hist) {
+			kfree(cb->hist);
+			cb->hist = NULL;
+			return -ENOMEM;
+		}
+	} else {
+		/* drop what was counted before they were last turned off */
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(cb->cpu_hist, cpu), 0, size);
+	}
+
+	/* pairs with the timer, the histograms must be seen before the flag */
+	smp_store_release(&cb->hist_on, true);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(blk_stat_set_hist);
+
 void blk_stat_add_callback(struct request_queue *q,
 			   struct blk_stat_callback *cb)
 {
@@ -179,6 +316,9 @@ void blk_stat_add_callback(struct request_queue *q,
 		cpu_stat = per_cpu_ptr(cb->cpu_stat, cpu);
 		for (bucket = 0; bucket < cb->buckets; bucket++)
 			blk_stat_init(&cpu_stat[bucket]);
+		if (cb->cpu_hist)
+			memset(per_cpu_ptr(cb->cpu_hist, cpu), 0,
+			       cb->buckets * sizeof(struct blk_rq_hist));
 	}
 
 	spin_lock(&q->stats->lock);
@@ -206,6 +346,8 @@ static void blk_stat_free_callback_rcu(struct rcu_head *head)
 	struct blk_stat_callback *cb;
 
 	cb = container_of(head, struct blk_stat_callback, rcu);
+	free_percpu(cb->cpu_hist);
+	kfree(cb->hist);
 	free_percpu(cb->cpu_stat);
 	kfree(cb->stat);
 	kfree(cb);
@@ -22,6 +22,26 @@
 	(((1ULL << BLK_STAT_SIZE_BITS) - 1) << BLK_STAT_SIZE_SHIFT)
 #define BLK_STAT_RES_MASK	(~((1ULL << BLK_STAT_RES_SHIFT) - 1))
 
+/*
+ * Log-linear latency histogram: latencies below 2^BLK_STAT_HIST_MIN_SHIFT
+ * nanoseconds go to BLK_STAT_HIST_SUB linear buckets, and every following
+ * power of two is split into another BLK_STAT_HIST_SUB linear buckets.  A
+ * bucket thus covers at most 1/8 of the latencies it counts, from 1us up to
+ * ~8.6s; larger latencies are counted in the last bucket.
+ */
+#define BLK_STAT_HIST_SUB_BITS	3
+#define BLK_STAT_HIST_SUB	(1U << BLK_STAT_HIST_SUB_BITS)
+#define BLK_STAT_HIST_MIN_SHIFT	10
+#define BLK_STAT_HIST_GROUPS	24
+#define BLK_STAT_HIST_BUCKETS	(BLK_STAT_HIST_GROUPS * BLK_STAT_HIST_SUB)
+
+struct blk_rq_hist {
+	u32 buckets[BLK_STAT_HIST_BUCKETS];
+};
+
+unsigned int blk_stat_hist_bucket(u64 value);
+u64 blk_stat_hist_bucket_end(unsigned int idx);
+
 /**
  * struct blk_stat_callback - Block statistics callback.
  *
@@ -63,6 +83,23 @@ struct blk_stat_callback {
 	 */
 	struct blk_rq_stat *stat;
 
+	/**
+	 * @cpu_hist: Per-cpu latency histograms, one per statistics bucket, or
+	 * NULL if blk_stat_set_hist() never turned them on.
+	 */
+	struct blk_rq_hist __percpu *cpu_hist;
+
+	/**
+	 * @hist: Array of latency histograms, flushed from @cpu_hist along
+	 * with @stat.
+	 */
+	struct blk_rq_hist *hist;
+
+	/**
+	 * @hist_on: Whether completions are counted in @cpu_hist.
+	 */
+	bool hist_on;
+
 	/**
 	 * @fn: Callback function.
 	 */
@@ -128,6 +165,37 @@ blk_stat_alloc_callback(void (*timer_fn)(struct blk_stat_callback *),
 			int (*bucket_fn)(const struct request *),
 			unsigned int buckets, void *data);
 
+/**
+ * blk_stat_set_hist() - Turn the latency histograms of a block statistics
+ * callback on or off.
+ * @cb: The callback.
+ * @on: Whether to keep histograms.
+ *
+ * While they are on, the p50, p90 and p99 fields of each statistics bucket
+ * are filled in before the timer callback is called, and
+ * blk_stat_percentile() can be used for any other percentile.  They are
+ * allocated the first time they are turned on and cost nothing per request
+ * while off.  Calls for the same callback must be serialized.
+ *
+ * Return: 0 on success or -ENOMEM.
+ */
+int blk_stat_set_hist(struct blk_stat_callback *cb, bool on);
+
+/**
+ * blk_stat_percentile() - Latency percentile of a statistics bucket.
+ * @cb: The callback, with histograms turned on by blk_stat_set_hist().
+ * @bucket: The statistics bucket.
+ * @pct: The percentile, from 1 to 100.
+ *
+ * Only valid from @cb's timer callback, for the window that just expired.
+ *
+ * Return: The latency in nanoseconds that @pct percent of the samples did
+ * not exceed, rounded up to the end of its histogram bucket, or 0 if there
+ * were no samples.
+ */
+u64 blk_stat_percentile(struct blk_stat_callback *cb, unsigned int bucket,
+			unsigned int pct);
+
 /**
  * blk_stat_add_callback() - Add a block statistics callback to be run on a
  * request queue.
@@ -395,6 +395,31 @@ static ssize_t queue_poll_delay_store(struct request_queue *q, const char *page,
 	return count;
 }
 
+static ssize_t queue_poll_target_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%u\n", q->poll_target_nsec / 1000);
+}
+
+static ssize_t queue_poll_target_store(struct request_queue *q,
+				       const char *page, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	err = kstrtouint(page, 10, &val);
+	if (err < 0)
+		return err;
+
+	if (val > UINT_MAX / 1000)
+		return -EINVAL;
+
+	q->poll_target_nsec = val * 1000;
+	return count;
+}
+
 static ssize_t queue_poll_show(struct request_queue *q, char *page)
 {
 	return queue_var_show(test_bit(QUEUE_FLAG_POLL, &q->queue_flags), page);
@@ -467,6 +492,42 @@ static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
 	return count;
 }
 
+static ssize_t queue_wb_lat_pct_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%u\n", q->rq_wb->lat_pct);
+}
+
+static ssize_t queue_wb_lat_pct_store(struct request_queue *q,
+				      const char *page, size_t count)
+{
+	unsigned long pct;
+	ssize_t ret;
+	int err;
+
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	ret = queue_var_store(&pct, page, count);
+	if (ret < 0)
+		return ret;
+	if (pct > 100)
+		return -EINVAL;
+
+	/* the histograms are only kept while a percentile is targeted */
+	if (pct) {
+		err = blk_stat_set_hist(q->rq_wb->cb, true);
+		if (err)
+			return err;
+	}
+	q->rq_wb->lat_pct = pct;
+	if (!pct)
+		blk_stat_set_hist(q->rq_wb->cb, false);
+	return ret;
+}
+
 static ssize_t queue_wc_show(struct request_queue *q, char *page)
 {
 	if (test_bit(QUEUE_FLAG_WC, &q->queue_flags))
@@ -661,6 +722,12 @@ static struct queue_sysfs_entry queue_poll_delay_entry = {
 	.store = queue_poll_delay_store,
 };
 
+static struct queue_sysfs_entry queue_poll_target_entry = {
+	.attr = {.name = "io_poll_target", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_target_show,
+	.store = queue_poll_target_store,
+};
+
 static struct queue_sysfs_entry queue_wc_entry = {
 	.attr = {.name = "write_cache", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_wc_show,
@@ -678,6 +745,12 @@ static struct queue_sysfs_entry queue_wb_lat_entry = {
 	.store = queue_wb_lat_store,
 };
 
+static struct queue_sysfs_entry queue_wb_lat_pct_entry = {
+	.attr = {.name = "wbt_lat_pct", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_lat_pct_show,
+	.store = queue_wb_lat_pct_store,
+};
+
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 static struct queue_sysfs_entry throtl_sample_time_entry = {
 	.attr = {.name = "throttle_sample_time", .mode = S_IRUGO | S_IWUSR },
@@ -718,7 +791,9 @@ static struct attribute *default_attrs[] = {
 	&queue_wc_entry.attr,
 	&queue_dax_entry.attr,
 	&queue_wb_lat_entry.attr,
+	&queue_wb_lat_pct_entry.attr,
 	&queue_poll_delay_entry.attr,
+	&queue_poll_target_entry.attr,
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 	&throtl_sample_time_entry.attr,
 #endif
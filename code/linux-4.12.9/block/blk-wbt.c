@@ -277,6 +277,18 @@ enum {
 	LAT_EXCEEDED,
 };
 
+/*
+ * By default we step down as soon as the fastest read of the window was
+ * slower than the target, i.e. when reads are slow across the board.  If
+ * a percentile is set, its latency is held to the target instead.
+ */
+static u64 rwb_read_lat(struct rq_wb *rwb, struct blk_rq_stat *stat)
+{
+	if (rwb->lat_pct)
+		return blk_stat_percentile(rwb->cb, READ, rwb->lat_pct);
+	return stat[READ].min;
+}
+
 static int latency_exceeded(struct rq_wb *rwb, struct blk_rq_stat *stat)
 {
 	struct backing_dev_info *bdi = rwb->queue->backing_dev_info;
@@ -315,10 +327,11 @@ static int latency_exceeded(struct rq_wb *rwb, struct blk_rq_stat *stat)
 	}
 
 	/*
-	 * If the 'min' latency exceeds our target, step down.
+	 * If the 'min' (or percentile) latency exceeds our target, step down.
 	 */
-	if (stat[READ].min > rwb->min_lat_nsec) {
-		trace_wbt_lat(bdi, stat[READ].min);
+	thislat = rwb_read_lat(rwb, stat);
+	if (thislat > rwb->min_lat_nsec) {
+		trace_wbt_lat(bdi, thislat);
 		trace_wbt_stat(bdi, stat);
 		return LAT_EXCEEDED;
 	}
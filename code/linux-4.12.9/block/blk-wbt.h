@@ -92,6 +92,9 @@ struct rq_wb {
 	unsigned long last_issue;		/* last non-throttled issue */
 	unsigned long last_comp;		/* last non-throttled comp */
 	unsigned long min_lat_nsec;
+	unsigned int lat_pct;			/* read latency percentile */
+						/*  held to min_lat_nsec, */
+						/*  0 for the minimum */
 	struct request_queue *queue;
 	struct rq_wait rq_wait[WBT_NUM_RWQ];
 };
@@ -92,6 +92,12 @@ struct kyber_queue_data {
 
 	/* Target latencies in nanoseconds. */
 	u64 read_lat_nsec, write_lat_nsec;
+
+	/*
+	 * Latency percentiles held to the above targets, or 0 to hold the
+	 * mean latency to them.
+	 */
+	unsigned int read_lat_pct, write_lat_pct;
 };
 
 struct kyber_hctx_data {
@@ -127,14 +133,18 @@ enum {
 #define IS_BAD(status) ((status) < 0)
 
 static int kyber_lat_status(struct blk_stat_callback *cb,
-			    unsigned int sched_domain, u64 target)
+			    unsigned int sched_domain, u64 target,
+			    unsigned int pct)
 {
 	u64 latency;
 
 	if (!cb->stat[sched_domain].nr_samples)
 		return NONE;
 
-	latency = cb->stat[sched_domain].mean;
+	if (pct)
+		latency = blk_stat_percentile(cb, sched_domain, pct);
+	else
+		latency = cb->stat[sched_domain].mean;
 	if (latency >= 2 * target)
 		return AWFUL;
 	else if (latency > target)
@@ -253,8 +263,11 @@ static void kyber_stat_timer_fn(struct blk_stat_callback *cb)
 	struct kyber_queue_data *kqd = cb->data;
 	int read_status, write_status;
 
-	read_status = kyber_lat_status(cb, KYBER_READ, kqd->read_lat_nsec);
-	write_status = kyber_lat_status(cb, KYBER_SYNC_WRITE, kqd->write_lat_nsec);
+	read_status = kyber_lat_status(cb, KYBER_READ, kqd->read_lat_nsec,
+				       kqd->read_lat_pct);
+	write_status = kyber_lat_status(cb, KYBER_SYNC_WRITE,
+					kqd->write_lat_nsec,
+					kqd->write_lat_pct);
 
 	kyber_adjust_rw_depth(kqd, KYBER_READ, read_status, write_status);
 	kyber_adjust_rw_depth(kqd, KYBER_SYNC_WRITE, write_status, read_status);
@@ -324,6 +337,8 @@ static struct kyber_queue_data *kyber_queue_data_alloc(struct request_queue *q)
 
 	kqd->read_lat_nsec = 2000000ULL;
 	kqd->write_lat_nsec = 10000000ULL;
+	kqd->read_lat_pct = 0;
+	kqd->write_lat_pct = 0;
 
 	return kqd;
 
@@ -676,12 +691,53 @@ KYBER_LAT_SHOW_STORE(read);
 KYBER_LAT_SHOW_STORE(write);
 #undef KYBER_LAT_SHOW_STORE
 
+#define KYBER_LAT_PCT_SHOW_STORE(op)					\
+static ssize_t kyber_##op##_lat_pct_show(struct elevator_queue *e,	\
+					 char *page)			\
+{									\
+	struct kyber_queue_data *kqd = e->elevator_data;		\
+									\
+	return sprintf(page, "%u\n", kqd->op##_lat_pct);		\
+}									\
+									\
+static ssize_t kyber_##op##_lat_pct_store(struct elevator_queue *e,	\
+					  const char *page, size_t count) \
+{									\
+	struct kyber_queue_data *kqd = e->elevator_data;		\
+	unsigned int pct;						\
+	int ret;							\
+									\
+	ret = kstrtouint(page, 10, &pct);				\
+	if (ret)							\
+		return ret;						\
+	if (pct > 100)							\
+		return -EINVAL;						\
+									\
+	if (pct) {							\
+		ret = blk_stat_set_hist(kqd->cb, true);			\
+		if (ret)						\
+			return ret;					\
+	}								\
+	kqd->op##_lat_pct = pct;					\
+	if (!kqd->read_lat_pct && !kqd->write_lat_pct)			\
+		blk_stat_set_hist(kqd->cb, false);			\
+									\
+	return count;							\
+}
+KYBER_LAT_PCT_SHOW_STORE(read);
+KYBER_LAT_PCT_SHOW_STORE(write);
+#undef KYBER_LAT_PCT_SHOW_STORE
+
 #define KYBER_LAT_ATTR(op) __ATTR(op##_lat_nsec, 0644, kyber_##op##_lat_show, kyber_##op##_lat_store)
+#define KYBER_LAT_PCT_ATTR(op) __ATTR(op##_lat_pct, 0644, kyber_##op##_lat_pct_show, kyber_##op##_lat_pct_store)
 static struct elv_fs_entry kyber_sched_attrs[] = {
 	KYBER_LAT_ATTR(read),
 	KYBER_LAT_ATTR(write),
+	KYBER_LAT_PCT_ATTR(read),
+	KYBER_LAT_PCT_ATTR(write),
 	__ATTR_NULL
 };
+#undef KYBER_LAT_PCT_ATTR
 #undef KYBER_LAT_ATTR
 
 #ifdef CONFIG_BLK_DEBUG_FS
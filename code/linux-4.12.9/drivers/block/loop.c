@@ -85,6 +85,7 @@ static DEFINE_MUTEX(loop_index_mutex);
 
 static int max_part;
 static int part_shift;
+static unsigned int nr_workers = 1;
 
 static int transfer_xor(struct loop_device *lo, int cmd,
 			struct page *raw_page, unsigned raw_off,
@@ -438,7 +439,18 @@ static int lo_discard(struct loop_device *lo, struct request *rq, loff_t pos)
 static int lo_req_flush(struct loop_device *lo, struct request *rq)
 {
 	struct file *file = lo->lo_backing_file;
-	int ret = vfs_fsync(file, 0);
+	unsigned int i;
+	int ret;
+
+	/*
+	 * Flushes always run on the first worker, see loop_cmd_worker().
+	 * Wait for the commands queued to the other workers ahead of us,
+	 * so that the flush covers them as it would with a single worker.
+	 */
+	for (i = 1; i < lo->nr_workers; i++)
+		kthread_flush_worker(&lo->workers[i].worker);
+
+	ret = vfs_fsync(file, 0);
 	if (unlikely(ret && ret != -EINVAL))
 		ret = -EIO;
 
@@ -767,6 +779,11 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_workers_show(struct loop_device *lo, char *buf)
+{
+	return sprintf(buf, "%u\n", lo->nr_workers);
+}
+
 static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
 {
 	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
@@ -780,6 +797,7 @@ LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
 LOOP_ATTR_RO(dio);
+LOOP_ATTR_RO(workers);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -788,6 +806,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
 	&loop_attr_dio.attr,
+	&loop_attr_workers.attr,
 	NULL,
 };
 
@@ -839,19 +858,53 @@ static void loop_config_discard(struct loop_device *lo)
 
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
+	unsigned int i;
+
+	for (i = 0; i < lo->nr_workers; i++) {
+		kthread_flush_worker(&lo->workers[i].worker);
+		kthread_stop(lo->workers[i].task);
+	}
+	kfree(lo->workers);
+	lo->workers = NULL;
+	lo->nr_workers = 0;
 }
 
+/*
+ * Start the nr_workers workers of a device being bound.  The first one
+ * keeps the historical "loopN" name.
+ */
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	unsigned int i, nr = READ_ONCE(nr_workers);
+	struct loop_worker *w;
+
+	lo->workers = kcalloc(nr, sizeof(*lo->workers), GFP_KERNEL);
+	if (!lo->workers)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+
+	for (i = 0; i < nr; i++) {
+		w = &lo->workers[i];
+		kthread_init_worker(&w->worker);
+		if (!i)
+			w->task = kthread_run(kthread_worker_fn, &w->worker,
+					      "loop%d", lo->lo_number);
+		else
+			w->task = kthread_run(kthread_worker_fn, &w->worker,
+					      "loop%d.%u", lo->lo_number, i);
+		if (IS_ERR(w->task))
+			goto err;
+		set_user_nice(w->task, MIN_NICE);
+	}
+	lo->nr_workers = nr;
+	atomic_set(&lo->next_worker, 0);
 	return 0;
+
+err:
+	while (i--)
+		kthread_stop(lo->workers[i].task);
+	kfree(lo->workers);
+	lo->workers = NULL;
+	return -ENOMEM;
 }
 
 static int loop_set_fd(struct loop_device *lo, fmode_t mode,
@@ -1604,6 +1657,30 @@ module_param(max_loop, int, S_IRUGO);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, S_IRUGO);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+
+static int loop_set_nr_workers(const char *val, const struct kernel_param *kp)
+{
+	unsigned int n;
+	int ret;
+
+	ret = kstrtouint(val, 10, &n);
+	if (ret)
+		return ret;
+	if (n < 1 || n > num_possible_cpus())
+		return -EINVAL;
+
+	WRITE_ONCE(nr_workers, n);
+	return 0;
+}
+
+static const struct kernel_param_ops loop_nr_workers_param_ops = {
+	.set	= loop_set_nr_workers,
+	.get	= param_get_uint,
+};
+
+module_param_cb(nr_workers, &loop_nr_workers_param_ops, &nr_workers,
+		S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(nr_workers, "Number of worker threads of loop devices bound from now on, 1 to the number of possible CPUs (default: 1)");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1645,6 +1722,25 @@ int loop_unregister_transfer(int number)
 EXPORT_SYMBOL(loop_register_transfer);
 EXPORT_SYMBOL(loop_unregister_transfer);
 
+/*
+ * Spread commands over the workers round robin.  Flushes all go to the
+ * first worker, which waits for the others first, see lo_req_flush().
+ * Devices with a transfer function use only the first worker as well,
+ * since transfer functions were never required to be reentrant.
+ */
+static struct kthread_worker *loop_cmd_worker(struct loop_device *lo,
+					      struct loop_cmd *cmd)
+{
+	unsigned int idx = 0;
+
+	if (lo->nr_workers > 1 && req_op(cmd->rq) != REQ_OP_FLUSH &&
+	    !lo->transfer)
+		idx = (unsigned int)atomic_inc_return(&lo->next_worker) %
+		      lo->nr_workers;
+
+	return &lo->workers[idx].worker;
+}
+
 static int loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		const struct blk_mq_queue_data *bd)
 {
@@ -1667,7 +1763,7 @@ static int loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		break;
 	}
 
-	kthread_queue_work(&lo->worker, &cmd->work);
+	kthread_queue_work(loop_cmd_worker(lo, cmd), &cmd->work);
 
 	return BLK_MQ_RQ_QUEUE_OK;
 }
@@ -9,6 +9,7 @@
 #include <linux/blk-mq.h>
 #include <linux/hrtimer.h>
 #include <linux/lightnvm.h>
+#include <linux/random.h>
 
 struct nullb_cmd {
 	struct list_head list;
@@ -25,6 +26,7 @@ struct nullb_queue {
 	unsigned long *tag_map;
 	wait_queue_head_t wait;
 	unsigned int queue_depth;
+	struct nullb *nullb;
 
 	struct nullb_cmd *cmds;
 };
@@ -40,6 +42,10 @@ struct nullb {
 	unsigned int queue_depth;
 	spinlock_t lock;
 
+	/* latency model of timer irqmode, see null_cmd_latency() */
+	atomic_t inflight;
+	atomic64_t bw_next;
+
 	struct nullb_queue *queues;
 	unsigned int nr_queues;
 	char disk_name[DISK_NAME_LEN];
@@ -57,6 +63,12 @@ enum {
 	NULL_IRQ_TIMER		= 2,
 };
 
+enum {
+	NULL_LAT_FIXED		= 0,
+	NULL_LAT_BIMODAL	= 1,
+	NULL_LAT_LONG_TAIL	= 2,
+};
+
 enum {
 	NULL_Q_BIO		= 0,
 	NULL_Q_RQ		= 1,
@@ -121,6 +133,10 @@ static bool blocking;
 module_param(blocking, bool, S_IRUGO);
 MODULE_PARM_DESC(blocking, "Register as a blocking blk-mq driver device");
 
+static bool batch_dispatch = true;
+module_param(batch_dispatch, bool, S_IRUGO);
+MODULE_PARM_DESC(batch_dispatch, "Take lists of requests from blk-mq at once. Default: true");
+
 static int irqmode = NULL_IRQ_SOFTIRQ;
 
 static int null_set_irqmode(const char *str, const struct kernel_param *kp)
@@ -141,6 +157,43 @@ static unsigned long completion_nsec = 10000;
 module_param(completion_nsec, ulong, S_IRUGO);
 MODULE_PARM_DESC(completion_nsec, "Time in ns to complete a request in hardware. Default: 10,000ns");
 
+static unsigned long write_nsec;
+module_param(write_nsec, ulong, S_IRUGO);
+MODULE_PARM_DESC(write_nsec, "Time in ns to complete a write in hardware. Default: completion_nsec");
+
+static int latency_dist = NULL_LAT_FIXED;
+
+static int null_set_latency_dist(const char *str,
+				 const struct kernel_param *kp)
+{
+	return null_param_store_val(str, &latency_dist, NULL_LAT_FIXED,
+					NULL_LAT_LONG_TAIL);
+}
+
+static const struct kernel_param_ops null_latency_dist_param_ops = {
+	.set	= null_set_latency_dist,
+	.get	= param_get_int,
+};
+
+device_param_cb(latency_dist, &null_latency_dist_param_ops, &latency_dist, S_IRUGO);
+MODULE_PARM_DESC(latency_dist, "Distribution of the completion time in timer irqmode. 0-fixed, 1-bimodal, 2-long tail");
+
+static unsigned int slow_pct = 1;
+module_param(slow_pct, uint, S_IRUGO);
+MODULE_PARM_DESC(slow_pct, "Percentage of requests taking slow_nsec if bimodal, chance of each doubling of the completion time if long tail. Default: 1");
+
+static unsigned long slow_nsec = 1000000;
+module_param(slow_nsec, ulong, S_IRUGO);
+MODULE_PARM_DESC(slow_nsec, "Time in ns to complete a slow request if bimodal, the maximum if long tail. Default: 1,000,000ns");
+
+static unsigned int bw_mbps;
+module_param(bw_mbps, uint, S_IRUGO);
+MODULE_PARM_DESC(bw_mbps, "Bandwidth of each device in MB/s in timer irqmode. Default: 0 (unlimited)");
+
+static unsigned int service_units;
+module_param(service_units, uint, S_IRUGO);
+MODULE_PARM_DESC(service_units, "Requests served in parallel by each device in timer irqmode, others wait for their turn. Default: 0 (unlimited)");
+
 static int hw_queue_depth = 64;
 module_param(hw_queue_depth, int, S_IRUGO);
 MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: 64");
@@ -227,6 +280,9 @@ static void end_cmd(struct nullb_cmd *cmd)
 	if (cmd->rq)
 		q = cmd->rq->q;
 
+	if (irqmode == NULL_IRQ_TIMER && service_units)
+		atomic_dec(&cmd->nq->nullb->inflight);
+
 	switch (queue_mode)  {
 	case NULL_Q_MQ:
 		blk_mq_end_request(cmd->rq, 0);
@@ -259,9 +315,64 @@ static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 	return HRTIMER_NORESTART;
 }
 
+/*
+ * Time to complete @cmd in timer irqmode.  The base time for its direction
+ * is drawn from latency_dist and multiplied by the number of rounds the
+ * requests in flight need on service_units, and the request can't complete
+ * before its data has been transferred at bw_mbps after those before it.
+ */
+static u64 null_cmd_latency(struct nullb_cmd *cmd)
+{
+	struct nullb *nullb = cmd->nq->nullb;
+	u64 nsec, now, start, xfer, old;
+	unsigned int bytes;
+	bool is_write;
+
+	if (queue_mode == NULL_Q_BIO) {
+		is_write = op_is_write(bio_op(cmd->bio));
+		bytes = cmd->bio->bi_iter.bi_size;
+	} else {
+		is_write = op_is_write(req_op(cmd->rq));
+		bytes = blk_rq_bytes(cmd->rq);
+	}
+
+	nsec = is_write && write_nsec ? write_nsec : completion_nsec;
+
+	switch (latency_dist) {
+	case NULL_LAT_BIMODAL:
+		if (prandom_u32_max(100) < slow_pct)
+			nsec = slow_nsec;
+		break;
+	case NULL_LAT_LONG_TAIL:
+		/* P(nsec >= base * 2^k) = (slow_pct / 100)^k, a power law */
+		while (nsec && nsec < slow_nsec &&
+		       prandom_u32_max(100) < slow_pct)
+			nsec = min_t(u64, nsec << 1, slow_nsec);
+		break;
+	}
+
+	if (service_units)
+		nsec *= DIV_ROUND_UP(atomic_inc_return(&nullb->inflight),
+				     service_units);
+
+	if (bw_mbps && bytes) {
+		/* 1 MB/s is 1000 ns per byte */
+		xfer = div_u64((u64)bytes * 1000, bw_mbps);
+		now = ktime_get_ns();
+		do {
+			old = atomic64_read(&nullb->bw_next);
+			start = max(old, now);
+		} while (atomic64_cmpxchg(&nullb->bw_next, old,
+					  start + xfer) != old);
+		nsec = max(nsec, start + xfer - now);
+	}
+
+	return nsec;
+}
+
 static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
-	ktime_t kt = completion_nsec;
+	ktime_t kt = null_cmd_latency(cmd);
 
 	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
 }
@@ -356,26 +467,44 @@ static void null_request_fn(struct request_queue *q)
 	}
 }
 
-static int null_queue_rq(struct blk_mq_hw_ctx *hctx,
-			 const struct blk_mq_queue_data *bd)
+static void null_queue_cmd(struct blk_mq_hw_ctx *hctx, struct request *rq)
 {
-	struct nullb_cmd *cmd = blk_mq_rq_to_pdu(bd->rq);
-
-	might_sleep_if(hctx->flags & BLK_MQ_F_BLOCKING);
+	struct nullb_cmd *cmd = blk_mq_rq_to_pdu(rq);
 
 	if (irqmode == NULL_IRQ_TIMER) {
 		hrtimer_init(&cmd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 		cmd->timer.function = null_cmd_timer_expired;
 	}
-	cmd->rq = bd->rq;
+	cmd->rq = rq;
 	cmd->nq = hctx->driver_data;
 
-	blk_mq_start_request(bd->rq);
+	blk_mq_start_request(rq);
 
 	null_handle_cmd(cmd);
+}
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx,
+			 const struct blk_mq_queue_data *bd)
+{
+	might_sleep_if(hctx->flags & BLK_MQ_F_BLOCKING);
+
+	null_queue_cmd(hctx, bd->rq);
 	return BLK_MQ_RQ_QUEUE_OK;
 }
 
+static void null_queue_rqs(struct blk_mq_hw_ctx *hctx, struct list_head *list)
+{
+	struct request *rq, *next;
+
+	might_sleep_if(hctx->flags & BLK_MQ_F_BLOCKING);
+
+	/* the request may be completed and freed by null_queue_cmd() */
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		list_del_init(&rq->queuelist);
+		null_queue_cmd(hctx, rq);
+	}
+}
+
 static void null_init_queue(struct nullb *nullb, struct nullb_queue *nq)
 {
 	BUG_ON(!nullb);
@@ -383,6 +512,7 @@ static void null_init_queue(struct nullb *nullb, struct nullb_queue *nq)
 
 	init_waitqueue_head(&nq->wait);
 	nq->queue_depth = nullb->queue_depth;
+	nq->nullb = nullb;
 }
 
 static int null_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
@@ -404,6 +534,13 @@ static const struct blk_mq_ops null_mq_ops = {
 	.complete	= null_softirq_done_fn,
 };
 
+static const struct blk_mq_ops null_mq_batch_ops = {
+	.queue_rq       = null_queue_rq,
+	.queue_rqs	= null_queue_rqs,
+	.init_hctx	= null_init_hctx,
+	.complete	= null_softirq_done_fn,
+};
+
 static void cleanup_queue(struct nullb_queue *nq)
 {
 	kfree(nq->tag_map);
@@ -715,7 +852,8 @@ static int null_add_dev(void)
 		goto out_free_nullb;
 
 	if (queue_mode == NULL_Q_MQ) {
-		nullb->tag_set.ops = &null_mq_ops;
+		nullb->tag_set.ops = batch_dispatch ? &null_mq_batch_ops :
+						      &null_mq_ops;
 		nullb->tag_set.nr_hw_queues = submit_queues;
 		nullb->tag_set.queue_depth = hw_queue_depth;
 		nullb->tag_set.numa_node = home_node;
@@ -832,6 +970,10 @@ static int __init null_init(void)
 	else if (!submit_queues)
 		submit_queues = 1;
 
+	if (irqmode != NULL_IRQ_TIMER &&
+	    (write_nsec || latency_dist || bw_mbps || service_units))
+		pr_warn("null_blk: latency model only applies to timer irqmode\n");
+
 	mutex_init(&lock);
 
 	null_major = register_blkdev(0, "nullb");
@@ -61,6 +61,7 @@ struct virtblk_req {
 #endif
 	struct virtio_blk_outhdr out_hdr;
 	u8 status;
+	unsigned int sg_num;	/* mapped by virtio_queue_rqs() */
 	struct scatterlist sg[];
 };
 
@@ -214,17 +215,14 @@ static void virtblk_done(struct virtqueue *vq)
 	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
 }
 
-static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
-			   const struct blk_mq_queue_data *bd)
+/*
+ * Fill in the header and the sg list of @req. Returns the number of sg
+ * entries, or -EIO for an unsupported request.
+ */
+static int virtblk_setup_cmd(struct virtio_blk *vblk, struct request *req)
 {
-	struct virtio_blk *vblk = hctx->queue->queuedata;
-	struct request *req = bd->rq;
 	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
-	unsigned long flags;
 	unsigned int num;
-	int qid = hctx->queue_num;
-	int err;
-	bool notify = false;
 	u32 type;
 
 	BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
@@ -246,7 +244,7 @@ static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
 		break;
 	default:
 		WARN_ON_ONCE(1);
-		return BLK_MQ_RQ_QUEUE_ERROR;
+		return -EIO;
 	}
 
 	vbr->out_hdr.type = cpu_to_virtio32(vblk->vdev, type);
@@ -254,21 +252,46 @@ static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
 		0 : cpu_to_virtio64(vblk->vdev, blk_rq_pos(req));
 	vbr->out_hdr.ioprio = cpu_to_virtio32(vblk->vdev, req_get_ioprio(req));
 
-	blk_mq_start_request(req);
-
-	num = blk_rq_map_sg(hctx->queue, req, vbr->sg);
+	num = blk_rq_map_sg(req->q, req, vbr->sg);
 	if (num) {
 		if (rq_data_dir(req) == WRITE)
 			vbr->out_hdr.type |= cpu_to_virtio32(vblk->vdev, VIRTIO_BLK_T_OUT);
 		else
 			vbr->out_hdr.type |= cpu_to_virtio32(vblk->vdev, VIRTIO_BLK_T_IN);
 	}
+	return num;
+}
+
+/* Add @req to @vq, called with the vq lock held */
+static int virtblk_add_cmd(struct virtqueue *vq, struct request *req,
+			   unsigned int num)
+{
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
 
-	spin_lock_irqsave(&vblk->vqs[qid].lock, flags);
 	if (req_op(req) == REQ_OP_SCSI_IN || req_op(req) == REQ_OP_SCSI_OUT)
-		err = virtblk_add_req_scsi(vblk->vqs[qid].vq, vbr, vbr->sg, num);
-	else
-		err = virtblk_add_req(vblk->vqs[qid].vq, vbr, vbr->sg, num);
+		return virtblk_add_req_scsi(vq, vbr, vbr->sg, num);
+	return virtblk_add_req(vq, vbr, vbr->sg, num);
+}
+
+static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
+			   const struct blk_mq_queue_data *bd)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct request *req = bd->rq;
+	unsigned long flags;
+	int num;
+	int qid = hctx->queue_num;
+	int err;
+	bool notify = false;
+
+	num = virtblk_setup_cmd(vblk, req);
+	if (num < 0)
+		return BLK_MQ_RQ_QUEUE_ERROR;
+
+	blk_mq_start_request(req);
+
+	spin_lock_irqsave(&vblk->vqs[qid].lock, flags);
+	err = virtblk_add_cmd(vblk->vqs[qid].vq, req, num);
 	if (err) {
 		virtqueue_kick(vblk->vqs[qid].vq);
 		blk_mq_stop_hw_queue(hctx);
@@ -289,6 +312,68 @@ static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return BLK_MQ_RQ_QUEUE_OK;
 }
 
+/*
+ * Add a list of requests to the virtqueue under a single lock round trip
+ * and notify the host once.  If the ring fills up, the rest is left to
+ * virtio_queue_rq(), which stops the queue.
+ */
+static void virtio_queue_rqs(struct blk_mq_hw_ctx *hctx,
+			     struct list_head *list)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtio_blk_vq *vq = &vblk->vqs[hctx->queue_num];
+	struct virtblk_req *vbr;
+	struct request *req, *next;
+	LIST_HEAD(failed);
+	unsigned long flags;
+	bool queued = false, notify = false;
+	int num, err;
+
+	/* map the data before taking the lock, as virtio_queue_rq() does */
+	list_for_each_entry_safe(req, next, list, queuelist) {
+		num = virtblk_setup_cmd(vblk, req);
+		if (num < 0) {
+			list_move_tail(&req->queuelist, &failed);
+			continue;
+		}
+		vbr = blk_mq_rq_to_pdu(req);
+		vbr->sg_num = num;
+	}
+
+	spin_lock_irqsave(&vq->lock, flags);
+	list_for_each_entry_safe(req, next, list, queuelist) {
+		vbr = blk_mq_rq_to_pdu(req);
+		err = virtblk_add_cmd(vq->vq, req, vbr->sg_num);
+		if (err == -ENOMEM || err == -ENOSPC)
+			break;
+
+		if (err) {
+			list_move_tail(&req->queuelist, &failed);
+			continue;
+		}
+
+		/*
+		 * virtblk_done() can't see the request before we drop the
+		 * lock, so it is started in time.
+		 */
+		list_del_init(&req->queuelist);
+		blk_mq_start_request(req);
+		queued = true;
+	}
+	if (queued && virtqueue_kick_prepare(vq->vq))
+		notify = true;
+	spin_unlock_irqrestore(&vq->lock, flags);
+
+	if (notify)
+		virtqueue_notify(vq->vq);
+
+	/* ending a request may rerun the queue, so not under the lock */
+	list_for_each_entry_safe(req, next, &failed, queuelist) {
+		list_del_init(&req->queuelist);
+		blk_mq_end_request(req, -EIO);
+	}
+}
+
 /* return id (s/n) string for *disk to *id_str
  */
 static int virtblk_get_id(struct gendisk *disk, char *id_str)
@@ -594,6 +679,7 @@ static int virtblk_map_queues(struct blk_mq_tag_set *set)
 
 static const struct blk_mq_ops virtio_mq_ops = {
 	.queue_rq	= virtio_queue_rq,
+	.queue_rqs	= virtio_queue_rqs,
 	.complete	= virtblk_request_done,
 	.init_request	= virtblk_init_request,
 	.map_queues	= virtblk_map_queues,
@@ -0,0 +1,182 @@
+/*
+ * Content deduplication for zram
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+/*
+ * Every object stored by a device with use_dedup set is described by a
+ * struct zram_entry, which is hashed on a checksum of the uncompressed
+ * page.  A page being written is first looked up by its checksum; if an
+ * entry with the same contents is found, the disk page just takes a
+ * reference to it, and neither compression nor a zsmalloc allocation is
+ * needed.  Candidates are compared byte for byte, so a checksum collision
+ * never merges different pages.
+ */
+
+#include <linux/kernel.h>
+#include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/* One bucket per this many disk pages, within the bounds below */
+#define ZRAM_HASH_SHIFT		4
+#define ZRAM_HASH_MIN_SIZE	64
+#define ZRAM_HASH_MAX_SIZE	(1 << 20)
+
+static u32 zram_dedup_checksum(void *mem)
+{
+	return jhash2(mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+static struct zram_hash *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->hash[checksum & (zram->hash_size - 1)];
+}
+
+/* Check whether @entry holds the contents @mem, called with atomic maps */
+static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+			     void *mem)
+{
+	struct zcomp_strm *zstrm;
+	bool match = false;
+	void *src;
+
+	src = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	if (entry->len == PAGE_SIZE) {
+		match = !memcmp(mem, src, PAGE_SIZE);
+	} else {
+		zstrm = zcomp_stream_get(zram->comp);
+		if (!zcomp_decompress(zstrm, src, entry->len, zstrm->buffer))
+			match = !memcmp(mem, zstrm->buffer, PAGE_SIZE);
+		zcomp_stream_put(zram->comp);
+	}
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look for an entry with the contents of @page and take a reference to it.
+ * The checksum of @page is returned in @checksum, for zram_dedup_new() in
+ * case there is none.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
+				   u32 *checksum)
+{
+	struct zram_entry *entry, *found = NULL;
+	struct zram_hash *hash;
+	void *mem;
+
+	mem = kmap_atomic(page);
+	*checksum = zram_dedup_checksum(mem);
+	hash = zram_dedup_bucket(zram, *checksum);
+
+	spin_lock(&hash->lock);
+	hlist_for_each_entry(entry, &hash->head, node) {
+		if (entry->checksum != *checksum)
+			continue;
+		if (zram_dedup_match(zram, entry, mem)) {
+			entry->refcount++;
+			found = entry;
+			break;
+		}
+	}
+	spin_unlock(&hash->lock);
+	kunmap_atomic(mem);
+
+	if (found)
+		atomic64_add(found->len, &zram->stats.dup_data_size);
+	return found;
+}
+
+/* Hash a newly stored object, its only reference belongs to the caller */
+struct zram_entry *zram_dedup_new(struct zram *zram, unsigned long handle,
+				  unsigned int len, u32 checksum)
+{
+	struct zram_entry *entry;
+	struct zram_hash *hash;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+
+	hash = zram_dedup_bucket(zram, checksum);
+	spin_lock(&hash->lock);
+	hlist_add_head(&entry->node, &hash->head);
+	spin_unlock(&hash->lock);
+
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+	return entry;
+}
+
+/* Drop a reference to @entry, freeing the object with the last one */
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, entry->checksum);
+	unsigned long refcount;
+
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		hlist_del(&entry->node);
+	spin_unlock(&hash->lock);
+
+	if (refcount) {
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+		return;
+	}
+
+	zs_free(zram->mem_pool, entry->handle);
+	atomic64_sub(entry->len, &zram->stats.compr_data_size);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	kfree(entry);
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	size_t i;
+
+	if (!zram->use_dedup)
+		return 0;
+
+	zram->hash_size = clamp_t(size_t, num_pages >> ZRAM_HASH_SHIFT,
+				  ZRAM_HASH_MIN_SIZE, ZRAM_HASH_MAX_SIZE);
+	zram->hash_size = rounddown_pow_of_two(zram->hash_size);
+	zram->hash = vzalloc(zram->hash_size * sizeof(*zram->hash));
+	if (!zram->hash)
+		return -ENOMEM;
+
+	for (i = 0; i < zram->hash_size; i++) {
+		spin_lock_init(&zram->hash[i].lock);
+		INIT_HLIST_HEAD(&zram->hash[i].head);
+	}
+	atomic64_add(zram->hash_size * sizeof(*zram->hash),
+		     &zram->stats.meta_data_size);
+	return 0;
+}
+
+/* All entries must have been put already */
+void zram_dedup_fini(struct zram *zram)
+{
+	if (!zram->hash)
+		return;
+
+	atomic64_sub(zram->hash_size * sizeof(*zram->hash),
+		     &zram->stats.meta_data_size);
+	vfree(zram->hash);
+	zram->hash = NULL;
+	zram->hash_size = 0;
+}
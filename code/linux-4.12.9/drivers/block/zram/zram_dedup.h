@@ -0,0 +1,69 @@
+/*
+ * Content deduplication for zram
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+struct zram;
+struct page;
+
+/*
+ * A zsmalloc object shared by all the disk pages with the same contents.
+ * Only used when the device was initialized with use_dedup set.
+ */
+struct zram_entry {
+	struct hlist_node node;
+	unsigned long handle;
+	unsigned int len;		/* object size */
+	u32 checksum;			/* of the uncompressed page */
+	unsigned long refcount;		/* protected by the bucket lock */
+};
+
+/* A bucket of the dedup hash table */
+struct zram_hash {
+	spinlock_t lock;
+	struct hlist_head head;
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
+				   u32 *checksum);
+struct zram_entry *zram_dedup_new(struct zram *zram, unsigned long handle,
+				  unsigned int len, u32 checksum);
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+int zram_dedup_init(struct zram *zram, size_t num_pages);
+void zram_dedup_fini(struct zram *zram);
+#else
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+						 struct page *page,
+						 u32 *checksum)
+{
+	return NULL;
+}
+
+static inline struct zram_entry *zram_dedup_new(struct zram *zram,
+						unsigned long handle,
+						unsigned int len, u32 checksum)
+{
+	return NULL;
+}
+
+static inline void zram_dedup_put(struct zram *zram,
+				  struct zram_entry *entry) { }
+
+static inline int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	return 0;
+}
+
+static inline void zram_dedup_fini(struct zram *zram) { }
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
@@ -32,6 +32,7 @@
 #include <linux/idr.h>
 #include <linux/sysfs.h>
 #include <linux/cpuhotplug.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -42,6 +43,9 @@ static DEFINE_MUTEX(zram_index_mutex);
 static int zram_major;
 static const char *default_compressor = "lzo";
 
+/* Stores the pages of parallel writes, see zram_parallel_write() */
+static struct workqueue_struct *zram_write_wq;
+
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
 
@@ -57,6 +61,17 @@ static inline struct zram *dev_to_zram(struct device *dev)
 	return (struct zram *)dev_to_disk(dev)->private_data;
 }
 
+/*
+ * Whether the table holds dedup entries rather than zsmalloc handles.  This
+ * follows the hash table set up at init instead of use_dedup, which can be
+ * changed again as soon as a reset has dropped init_lock, while the pages
+ * are still being freed.
+ */
+static inline bool zram_dedup_enabled(struct zram *zram)
+{
+	return IS_ENABLED(CONFIG_ZRAM_DEDUP) && zram->hash;
+}
+
 static unsigned long zram_get_handle(struct zram *zram, u32 index)
 {
 	return zram->table[index].handle;
@@ -67,6 +82,25 @@ static void zram_set_handle(struct zram *zram, u32 index, unsigned long handle)
 	zram->table[index].handle = handle;
 }
 
+static struct zram_entry *zram_get_entry(struct zram *zram, u32 index)
+{
+	return zram->table[index].entry;
+}
+
+static void zram_set_entry(struct zram *zram, u32 index,
+			struct zram_entry *entry)
+{
+	zram->table[index].entry = entry;
+}
+
+/* zsmalloc handle of the object stored for a disk page */
+static unsigned long zram_get_obj_handle(struct zram *zram, u32 index)
+{
+	if (zram_dedup_enabled(zram))
+		return zram_get_entry(zram, index)->handle;
+	return zram_get_handle(zram, index);
+}
+
 /* flag operations require table entry bit_spin_lock() being held */
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
@@ -291,6 +325,68 @@ static ssize_t max_comp_streams_store(struct device *dev,
 	return len;
 }
 
+static ssize_t parallel_write_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+			 READ_ONCE(zram->parallel_write));
+}
+
+static ssize_t parallel_write_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(zram->parallel_write, val);
+	return len;
+}
+
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_ZRAM_DEDUP))
+		return -EINVAL;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+
 static ssize_t comp_algorithm_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -388,14 +484,16 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
-			pool_stats.pages_compacted);
+			pool_stats.pages_compacted,
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.meta_data_size));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -485,6 +583,7 @@ static void zram_meta_free(struct zram *zram, u64 disksize)
 	for (index = 0; index < num_pages; index++)
 		zram_free_page(zram, index);
 
+	zram_dedup_fini(zram);
 	zs_destroy_pool(zram->mem_pool);
 	vfree(zram->table);
 }
@@ -504,6 +603,12 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 		return false;
 	}
 
+	if (zram_dedup_init(zram, num_pages)) {
+		zs_destroy_pool(zram->mem_pool);
+		vfree(zram->table);
+		return false;
+	}
+
 	return true;
 }
 
@@ -530,10 +635,13 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (!handle)
 		return;
 
-	zs_free(zram->mem_pool, handle);
-
-	atomic64_sub(zram_get_obj_size(zram, index),
-			&zram->stats.compr_data_size);
+	if (zram_dedup_enabled(zram)) {
+		zram_dedup_put(zram, zram_get_entry(zram, index));
+	} else {
+		zs_free(zram->mem_pool, handle);
+		atomic64_sub(zram_get_obj_size(zram, index),
+				&zram->stats.compr_data_size);
+	}
 	atomic64_dec(&zram->stats.pages_stored);
 
 	zram_set_handle(zram, index, 0);
@@ -551,7 +659,7 @@ static int zram_decompress_page(struct zram *zram, struct page *page, u32 index)
 		return 0;
 
 	zram_slot_lock(zram, index);
-	handle = zram_get_handle(zram, index);
+	handle = zram_get_obj_handle(zram, index);
 	size = zram_get_obj_size(zram, index);
 
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
@@ -683,15 +791,25 @@ compress_again:
 static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index)
 {
 	int ret;
-	unsigned long handle;
+	unsigned long handle = 0;
 	unsigned int comp_len;
 	void *src, *dst;
 	struct zcomp_strm *zstrm;
 	struct page *page = bvec->bv_page;
+	struct zram_entry *entry = NULL;
+	u32 checksum = 0;
 
 	if (zram_same_page_write(zram, index, page))
 		return 0;
 
+	if (zram_dedup_enabled(zram)) {
+		entry = zram_dedup_find(zram, page, &checksum);
+		if (entry) {
+			comp_len = entry->len;
+			goto found_dup;
+		}
+	}
+
 	zstrm = zcomp_stream_get(zram->comp);
 	ret = zram_compress(zram, &zstrm, page, &handle, &comp_len);
 	if (ret) {
@@ -711,18 +829,30 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index)
 	zcomp_stream_put(zram->comp);
 	zs_unmap_object(zram->mem_pool, handle);
 
+	if (zram_dedup_enabled(zram)) {
+		entry = zram_dedup_new(zram, handle, comp_len, checksum);
+		if (!entry) {
+			zs_free(zram->mem_pool, handle);
+			return -ENOMEM;
+		}
+	}
+	atomic64_add(comp_len, &zram->stats.compr_data_size);
+
+found_dup:
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
 	 */
 	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
-	zram_set_handle(zram, index, handle);
+	if (entry)
+		zram_set_entry(zram, index, entry);
+	else
+		zram_set_handle(zram, index, handle);
 	zram_set_obj_size(zram, index, comp_len);
 	zram_slot_unlock(zram, index);
 
 	/* Update stats */
-	atomic64_add(comp_len, &zram->stats.compr_data_size);
 	atomic64_inc(&zram->stats.pages_stored);
 	return 0;
 }
@@ -837,28 +967,17 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
-static void __zram_make_request(struct zram *zram, struct bio *bio)
+/*
+ * Read or write the segments of @bio covered by @start, the first of which
+ * starts at @offset of page @index.
+ */
+static int zram_bio_rw_segments(struct zram *zram, struct bio *bio,
+				struct bvec_iter start, u32 index, int offset)
 {
-	int offset;
-	u32 index;
 	struct bio_vec bvec;
 	struct bvec_iter iter;
 
-	index = bio->bi_iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
-	offset = (bio->bi_iter.bi_sector &
-		  (SECTORS_PER_PAGE - 1)) << SECTOR_SHIFT;
-
-	switch (bio_op(bio)) {
-	case REQ_OP_DISCARD:
-	case REQ_OP_WRITE_ZEROES:
-		zram_bio_discard(zram, index, offset, bio);
-		bio_endio(bio);
-		return;
-	default:
-		break;
-	}
-
-	bio_for_each_segment(bvec, bio, iter) {
+	__bio_for_each_segment(bvec, bio, iter, start) {
 		struct bio_vec bv = bvec;
 		unsigned int unwritten = bvec.bv_len;
 
@@ -867,7 +986,7 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 							unwritten);
 			if (zram_bvec_rw(zram, &bv, index, offset,
 					op_is_write(bio_op(bio))) < 0)
-				goto out;
+				return -EIO;
 
 			bv.bv_offset += bv.bv_len;
 			unwritten -= bv.bv_len;
@@ -876,11 +995,141 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		} while (unwritten);
 	}
 
-	bio_endio(bio);
-	return;
+	return 0;
+}
 
-out:
-	bio_io_error(bio);
+/* A run of pages of a parallel write, stored by one worker */
+struct zram_write_chunk {
+	struct work_struct work;
+	struct zram_write_ctx *ctx;
+	struct bvec_iter iter;
+	u32 index;
+};
+
+struct zram_write_ctx {
+	struct zram *zram;
+	struct bio *bio;
+	atomic_t pending;	/* chunks not stored yet */
+	bool failed;
+	struct zram_write_chunk chunks[];
+};
+
+static void zram_write_chunk_fn(struct work_struct *work)
+{
+	struct zram_write_chunk *chunk =
+		container_of(work, struct zram_write_chunk, work);
+	struct zram_write_ctx *ctx = chunk->ctx;
+
+	if (zram_bio_rw_segments(ctx->zram, ctx->bio, chunk->iter,
+				 chunk->index, 0))
+		ctx->failed = true;
+
+	/* the last chunk completes the bio */
+	if (!atomic_dec_and_test(&ctx->pending))
+		return;
+	if (ctx->failed)
+		bio_io_error(ctx->bio);
+	else
+		bio_endio(ctx->bio);
+	kfree(ctx);
+}
+
+static int zram_next_cpu(struct zram *zram)
+{
+	int cpu;
+
+	cpu = (unsigned int)atomic_inc_return(&zram->next_cpu) % nr_cpu_ids;
+	if (!cpu_online(cpu)) {
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+	return cpu;
+}
+
+/*
+ * Split a page aligned write bio into up to one run of pages per online CPU
+ * and compress and store the runs from zram_write_wq on different CPUs, so
+ * that a large write is not limited to the submitting CPU.  The bio is
+ * completed once all pages are stored.  Even a single page write is handed
+ * off, which lets the submitter (e.g. kswapd) go on with the next page.
+ *
+ * Returns false, leaving the bio to the caller, if it can't be done.
+ */
+static bool zram_parallel_write(struct zram *zram, struct bio *bio,
+				u32 index, int offset)
+{
+	struct bvec_iter iter = bio->bi_iter;
+	unsigned int nr_pages, nr_chunks, per_chunk, bytes, i;
+	struct zram_write_chunk *chunk;
+	struct zram_write_ctx *ctx;
+
+	if (offset)
+		return false;
+
+	nr_pages = DIV_ROUND_UP(iter.bi_size, PAGE_SIZE);
+	nr_chunks = min(nr_pages, num_online_cpus());
+	per_chunk = DIV_ROUND_UP(nr_pages, nr_chunks);
+	nr_chunks = DIV_ROUND_UP(nr_pages, per_chunk);
+
+	ctx = kmalloc(sizeof(*ctx) + nr_chunks * sizeof(*chunk),
+		      GFP_NOIO | __GFP_NOWARN);
+	if (!ctx)
+		return false;
+
+	ctx->zram = zram;
+	ctx->bio = bio;
+	ctx->failed = false;
+	atomic_set(&ctx->pending, nr_chunks);
+
+	for (i = 0; i < nr_chunks; i++) {
+		chunk = &ctx->chunks[i];
+		bytes = min_t(unsigned int, per_chunk << PAGE_SHIFT,
+			      iter.bi_size);
+
+		INIT_WORK(&chunk->work, zram_write_chunk_fn);
+		chunk->ctx = ctx;
+		chunk->iter = iter;
+		chunk->iter.bi_size = bytes;
+		chunk->index = index + i * per_chunk;
+		bio_advance_iter(bio, &iter, bytes);
+	}
+
+	/* ctx may be gone as soon as the last chunk is queued */
+	for (i = 0; i < nr_chunks; i++)
+		queue_work_on(zram_next_cpu(zram), zram_write_wq,
+			      &ctx->chunks[i].work);
+	return true;
+}
+
+static void __zram_make_request(struct zram *zram, struct bio *bio)
+{
+	int offset;
+	u32 index;
+
+	index = bio->bi_iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	offset = (bio->bi_iter.bi_sector &
+		  (SECTORS_PER_PAGE - 1)) << SECTOR_SHIFT;
+
+	switch (bio_op(bio)) {
+	case REQ_OP_DISCARD:
+	case REQ_OP_WRITE_ZEROES:
+		zram_bio_discard(zram, index, offset, bio);
+		bio_endio(bio);
+		return;
+	case REQ_OP_WRITE:
+		if (READ_ONCE(zram->parallel_write) &&
+		    zram_parallel_write(zram, bio, index, offset))
+			return;
+		break;
+	default:
+		break;
+	}
+
+	if (zram_bio_rw_segments(zram, bio, bio->bi_iter, index, offset))
+		bio_io_error(bio);
+	else
+		bio_endio(bio);
 }
 
 /*
@@ -927,6 +1176,13 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 
 	zram = bdev->bd_disk->private_data;
 
+	/*
+	 * rw_page has to store the page before returning.  Let the caller
+	 * fall back to a bio, which we can complete from another CPU.
+	 */
+	if (is_write && READ_ONCE(zram->parallel_write))
+		return -EOPNOTSUPP;
+
 	if (!valid_io_request(zram, sector, PAGE_SIZE)) {
 		atomic64_inc(&zram->stats.invalid_io);
 		err = -EINVAL;
@@ -977,6 +1233,8 @@ static void zram_reset_device(struct zram *zram)
 	part_stat_set_all(&zram->disk->part0, 0);
 
 	up_write(&zram->init_lock);
+	/* Wait for parallel writes still being stored */
+	flush_workqueue(zram_write_wq);
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
@@ -1106,6 +1364,8 @@ static DEVICE_ATTR_WO(mem_limit);
 static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_RW(parallel_write);
+static DEVICE_ATTR_RW(use_dedup);
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -1116,6 +1376,8 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_parallel_write.attr,
+	&dev_attr_use_dedup.attr,
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
 	&dev_attr_debug_stat.attr,
@@ -1347,6 +1609,7 @@ static void destroy_devices(void)
 	idr_for_each(&zram_index_idr, &zram_remove_cb, NULL);
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
+	destroy_workqueue(zram_write_wq);
 	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 }
 
@@ -1359,9 +1622,18 @@ static int __init zram_init(void)
 	if (ret < 0)
 		return ret;
 
+	/* Writes are stored from here when swapping */
+	zram_write_wq = alloc_workqueue("zram_write",
+				       WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!zram_write_wq) {
+		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		return -ENOMEM;
+	}
+
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
+		destroy_workqueue(zram_write_wq);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 		return ret;
 	}
@@ -1370,6 +1642,7 @@ static int __init zram_init(void)
 	if (zram_major <= 0) {
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
+		destroy_workqueue(zram_write_wq);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 		return -EBUSY;
 	}
@@ -20,6 +20,7 @@
 #include <linux/crypto.h>
 
 #include "zcomp.h"
+#include "zram_dedup.h"
 
 /*-- Configurable parameters */
 
@@ -73,6 +74,7 @@ enum zram_pageflags {
 struct zram_table_entry {
 	union {
 		unsigned long handle;
+		struct zram_entry *entry;	/* use_dedup */
 		unsigned long element;
 	};
 	unsigned long value;
@@ -90,6 +92,8 @@ struct zram_stats {
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
+	atomic64_t dup_data_size;	/* compressed size of deduped pages */
+	atomic64_t meta_data_size;	/* size of dedup bookkeeping */
 };
 
 struct zram {
@@ -115,5 +119,18 @@ struct zram {
 	 * zram is claimed so open request will be failed
 	 */
 	bool claim; /* Protected by bdev->bd_mutex */
+	/*
+	 * Store pages with the same contents only once, see zram_dedup.c.
+	 * Can only be changed before the device is initialized.
+	 */
+	bool use_dedup;
+	struct zram_hash *hash;
+	size_t hash_size;
+	/*
+	 * Store the pages of write bios from workers on all online CPUs,
+	 * see zram_parallel_write()
+	 */
+	bool parallel_write;
+	atomic_t next_cpu;
 };
 #endif
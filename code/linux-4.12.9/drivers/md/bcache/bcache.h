@@ -325,10 +325,11 @@ struct cached_dev {
 	struct delayed_work	writeback_rate_update;
 
 	/*
-	 * Internal to the writeback code, so read_dirty() can keep track of
-	 * where it's at.
+	 * Internal to the writeback code, so that the writes to the backing
+	 * device go out in the order read_dirty() started them in.
 	 */
-	sector_t		last_read;
+	struct closure_waitlist	writeback_ordering_wait;
+	atomic_t		writeback_sequence_next;
 
 	/* Limit number of writeback bios in flight */
 	struct semaphore	in_flight;
@@ -359,6 +360,15 @@ struct cached_dev {
 	unsigned char		writeback_percent;
 	unsigned		writeback_delay;
 
+	/*
+	 * If nonzero, writeback is rate limited to keep the backing device busy
+	 * this percent of the time, instead of by writeback_percent.
+	 */
+	unsigned char		writeback_util_target;
+	unsigned		writeback_util;
+	unsigned long		writeback_util_ticks;
+	unsigned long		writeback_util_stamp;
+
 	uint64_t		writeback_rate_target;
 	int64_t			writeback_rate_proportional;
 	int64_t			writeback_rate_derivative;
@@ -500,7 +510,7 @@ struct cache_set {
 	/* For the btree cache */
 	struct shrinker		shrink;
 
-	/* For the btree cache and anything allocation related */
+	/* For anything allocation related */
 	struct mutex		bucket_lock;
 
 	/* log2(bucket_size), in sectors */
@@ -530,7 +540,13 @@ struct cache_set {
 	 * high order page allocations can be rather expensive, and it's quite
 	 * common to delete and allocate btree nodes in quick succession. It
 	 * should never grow past ~2-3 nodes in practice.
+	 *
+	 * The lists and the hash table of cached nodes are protected by
+	 * btree_cache_lock, which nests inside bucket_lock - so that reading
+	 * in a btree node doesn't have to wait on the allocator. Lookups in the
+	 * hash table only need rcu_read_lock().
 	 */
+	struct mutex		btree_cache_lock;
 	struct list_head	btree_cache;
 	struct list_head	btree_cache_freeable;
 	struct list_head	btree_cache_freed;
@@ -620,7 +620,7 @@ static int mca_reap(struct btree *b, unsigned min_order, bool flush)
 	struct closure cl;
 
 	closure_init_stack(&cl);
-	lockdep_assert_held(&b->c->bucket_lock);
+	lockdep_assert_held(&b->c->btree_cache_lock);
 
 	if (!down_write_trylock(&b->lock))
 		return -ENOMEM;
@@ -672,8 +672,8 @@ static unsigned long bch_mca_scan(struct shrinker *shrink,
 
 	/* Return -1 if we can't do anything right now */
 	if (sc->gfp_mask & __GFP_IO)
-		mutex_lock(&c->bucket_lock);
-	else if (!mutex_trylock(&c->bucket_lock))
+		mutex_lock(&c->btree_cache_lock);
+	else if (!mutex_trylock(&c->btree_cache_lock))
 		return -1;
 
 	/*
@@ -716,7 +716,7 @@ static unsigned long bch_mca_scan(struct shrinker *shrink,
 			b->accessed = 0;
 	}
 out:
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 	return freed;
 }
 
@@ -743,7 +743,7 @@ void bch_btree_cache_free(struct cache_set *c)
 	if (c->shrink.list.next)
 		unregister_shrinker(&c->shrink);
 
-	mutex_lock(&c->bucket_lock);
+	mutex_lock(&c->btree_cache_lock);
 
 #ifdef CONFIG_BCACHE_DEBUG
 	if (c->verify_data)
@@ -773,7 +773,7 @@ void bch_btree_cache_free(struct cache_set *c)
 		kfree(b);
 	}
 
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 }
 
 int bch_btree_cache_alloc(struct cache_set *c)
@@ -890,7 +890,7 @@ static struct btree *mca_alloc(struct cache_set *c, struct btree_op *op,
 
 	BUG_ON(current->bio_list);
 
-	lockdep_assert_held(&c->bucket_lock);
+	lockdep_assert_held(&c->btree_cache_lock);
 
 	if (mca_find(c, k))
 		return NULL;
@@ -978,9 +978,9 @@ retry:
 		if (current->bio_list)
 			return ERR_PTR(-EAGAIN);
 
-		mutex_lock(&c->bucket_lock);
+		mutex_lock(&c->btree_cache_lock);
 		b = mca_alloc(c, op, k, level);
-		mutex_unlock(&c->bucket_lock);
+		mutex_unlock(&c->btree_cache_lock);
 
 		if (!b)
 			goto retry;
@@ -1000,8 +1000,14 @@ retry:
 		BUG_ON(b->level != level);
 	}
 
-	b->parent = parent;
-	b->accessed = 1;
+	/*
+	 * Every lookup goes through the root and the interior nodes, don't
+	 * dirty their cachelines when there's nothing to change:
+	 */
+	if (b->parent != parent)
+		b->parent = parent;
+	if (!b->accessed)
+		b->accessed = 1;
 
 	for (; i <= b->keys.nsets && b->keys.set[i].size; i++) {
 		prefetch(b->keys.set[i].tree);
@@ -1025,9 +1031,9 @@ static void btree_node_prefetch(struct btree *parent, struct bkey *k)
 {
 	struct btree *b;
 
-	mutex_lock(&parent->c->bucket_lock);
+	mutex_lock(&parent->c->btree_cache_lock);
 	b = mca_alloc(parent->c, NULL, k, parent->level - 1);
-	mutex_unlock(&parent->c->bucket_lock);
+	mutex_unlock(&parent->c->btree_cache_lock);
 
 	if (!IS_ERR_OR_NULL(b)) {
 		b->parent = parent;
@@ -1056,7 +1062,9 @@ static void btree_node_free(struct btree *b)
 
 	mutex_lock(&b->c->bucket_lock);
 	bch_bucket_free(b->c, &b->key);
+	mutex_lock(&b->c->btree_cache_lock);
 	mca_bucket_free(b);
+	mutex_unlock(&b->c->btree_cache_lock);
 	mutex_unlock(&b->c->bucket_lock);
 }
 
@@ -1075,7 +1083,9 @@ retry:
 	bkey_put(c, &k.key);
 	SET_KEY_SIZE(&k.key, c->btree_pages * PAGE_SECTORS);
 
+	mutex_lock(&c->btree_cache_lock);
 	b = mca_alloc(c, op, &k.key, level);
+	mutex_unlock(&c->btree_cache_lock);
 	if (IS_ERR(b))
 		goto err_free;
 
@@ -2251,9 +2261,9 @@ void bch_btree_set_root(struct btree *b)
 	for (i = 0; i < KEY_PTRS(&b->key); i++)
 		BUG_ON(PTR_BUCKET(b->c, &b->key, i)->prio != BTREE_PRIO);
 
-	mutex_lock(&b->c->bucket_lock);
+	mutex_lock(&b->c->btree_cache_lock);
 	list_del_init(&b->list);
-	mutex_unlock(&b->c->bucket_lock);
+	mutex_unlock(&b->c->btree_cache_lock);
 
 	b->c->root = b;
 
@@ -2325,10 +2335,99 @@ static int bch_btree_map_keys_recurse(struct btree *b, struct btree_op *op,
 	return ret;
 }
 
+/*
+ * Map over the keys of the leaf that @from falls in. The interior nodes on the
+ * way down are only read locked, and each one is unlocked as soon as the child
+ * it points to is locked - so a lookup never holds the root or any other
+ * interior node while it's working in a leaf, and splits and gc only have to
+ * wait for it to step from a node to its child. On success, @end is set to the
+ * end of the leaf, or of the interior node that has nothing left after @from.
+ */
+static int bch_btree_map_leaf_keys(struct btree_op *op, struct cache_set *c,
+				   struct bkey *from, struct bkey *end,
+				   btree_map_keys_fn *fn, int flags)
+{
+	struct btree *b = c->root, *child;
+	struct btree_iter iter;
+	struct bkey *k;
+	bool w = insert_lock(op, b);
+	int ret;
+
+	rw_lock(w, b, b->level);
+	if (b != c->root || w != insert_lock(op, b)) {
+		rw_unlock(w, b);
+		return -EINTR;
+	}
+
+	while (b->level) {
+		bch_btree_iter_init(&b->keys, &iter, from);
+		k = bch_btree_iter_next_filter(&iter, &b->keys, bch_ptr_bad);
+		if (!k) {
+			/*
+			 * Nothing left under this node, carry on after it -
+			 * that's only the end of the btree at the root:
+			 */
+			if (b == c->root)
+				*end = MAX_KEY;
+			else
+				*end = KEY(KEY_INODE(&b->key),
+					   KEY_OFFSET(&b->key), 0);
+			rw_unlock(w, b);
+			return MAP_CONTINUE;
+		}
+
+		child = bch_btree_node_get(c, op, k, b->level - 1,
+					   b->level - 1 <= op->lock, b);
+		rw_unlock(w, b);
+		if (IS_ERR(child))
+			return PTR_ERR(child);
+
+		b = child;
+		w = insert_lock(op, b);
+	}
+
+	ret = bch_btree_map_keys_recurse(b, op, from, fn, flags);
+	*end = KEY(KEY_INODE(&b->key), KEY_OFFSET(&b->key), 0);
+	rw_unlock(w, b);
+
+	return ret;
+}
+
 int bch_btree_map_keys(struct btree_op *op, struct cache_set *c,
 		       struct bkey *from, btree_map_keys_fn *fn, int flags)
 {
-	return btree_root(map_keys_recurse, c, op, from, fn, flags);
+	struct bkey start, end;
+	int ret;
+
+	while (1) {
+		/*
+		 * Interior nodes that a split below them may modify have to
+		 * stay locked on the way down, take the slow path for those:
+		 */
+		if (op->lock > 0) {
+			ret = btree_root(map_keys_recurse, c, op, from, fn,
+					 flags);
+			break;
+		}
+
+		ret = bch_btree_map_leaf_keys(op, c, from, &end, fn, flags);
+		bch_cannibalize_unlock(c);
+
+		if (ret == -EINTR) {
+			schedule();
+			continue;
+		}
+
+		if (ret != MAP_CONTINUE || !bkey_cmp(&end, &MAX_KEY))
+			break;
+
+		/* On to the next leaf, starting over from the root */
+		start = end;
+		from = &start;
+	}
+
+	finish_wait(&c->btree_cache_wait, &op->wait);
+	return ret;
 }
 
 /* Keybuf code */
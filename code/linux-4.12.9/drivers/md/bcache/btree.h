@@ -86,6 +86,12 @@
  * the lock field and returns -EINTR, which causes the btree_root() macro to
  * loop.
  *
+ * bch_btree_map_keys() doesn't hold the read locked interior nodes above the
+ * leaf it's in: it drops the lock on each one once it has the child locked,
+ * and after each leaf it starts over from the root, at the end of that leaf.
+ * Lookups only ever hold one or two nodes locked this way, and don't keep
+ * splits and gc waiting while they're in a leaf.
+ *
  * Handling cache misses require a different mechanism for upgrading to a write
  * lock. We do cache lookups with only a read lock held, but if we get a cache
  * miss and we wish to insert this data into the cache, we have to insert a
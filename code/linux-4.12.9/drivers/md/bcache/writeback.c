@@ -69,6 +69,56 @@ static void __update_writeback_rate(struct cached_dev *dc)
 	dc->writeback_rate_target = target;
 }
 
+/*
+ * Sample how much of the time since the last update the backing device was
+ * busy, in percent.
+ */
+static void update_backing_util(struct cached_dev *dc)
+{
+	unsigned long now = jiffies;
+	unsigned long ticks = part_stat_read(dc->bdev->bd_part, io_ticks);
+	unsigned long elapsed = now - dc->writeback_util_stamp;
+
+	if (!elapsed)
+		return;
+
+	dc->writeback_util = min_t(unsigned long, 100,
+				   (ticks - dc->writeback_util_ticks) * 100 /
+				   elapsed);
+	dc->writeback_util_ticks = ticks;
+	dc->writeback_util_stamp = now;
+}
+
+/*
+ * Instead of holding the amount of dirty data at a target, keep the backing
+ * device busy writeback_util_target percent of the time: dirty data then
+ * drains as fast as the backing device allows, and foreground IO still gets
+ * the rest of its time - the rate comes down as foreground IO picks up.
+ */
+static void __update_writeback_rate_util(struct cached_dev *dc)
+{
+	uint64_t rate = dc->writeback_rate.rate;
+	unsigned util = dc->writeback_util;
+	unsigned target = dc->writeback_util_target;
+	uint64_t new_rate = rate;
+
+	/* Scale by target / util, but at most by a factor of two at a time */
+	if (util >= target)
+		new_rate = max(div_u64(rate * target, util), rate / 2);
+	/* Don't increase writeback rate if the device isn't keeping up */
+	else if (!time_after64(local_clock(),
+			       dc->writeback_rate.next + NSEC_PER_MSEC))
+		new_rate = min(div_u64(rate * target, max(util, 1U)), rate * 2);
+
+	dc->writeback_rate.rate = clamp_t(uint64_t, new_rate, 1, NSEC_PER_MSEC);
+
+	dc->writeback_rate_proportional = 0;
+	dc->writeback_rate_derivative = 0;
+	dc->writeback_rate_change = (int64_t) dc->writeback_rate.rate -
+				    (int64_t) rate;
+	dc->writeback_rate_target = 0;
+}
+
 static void update_writeback_rate(struct work_struct *work)
 {
 	struct cached_dev *dc = container_of(to_delayed_work(work),
@@ -77,9 +127,14 @@ static void update_writeback_rate(struct work_struct *work)
 
 	down_read(&dc->writeback_lock);
 
-	if (atomic_read(&dc->has_dirty) &&
-	    dc->writeback_percent)
-		__update_writeback_rate(dc);
+	update_backing_util(dc);
+
+	if (atomic_read(&dc->has_dirty)) {
+		if (dc->writeback_util_target)
+			__update_writeback_rate_util(dc);
+		else if (dc->writeback_percent)
+			__update_writeback_rate(dc);
+	}
 
 	up_read(&dc->writeback_lock);
 
@@ -90,7 +145,7 @@ static void update_writeback_rate(struct work_struct *work)
 static unsigned writeback_delay(struct cached_dev *dc, unsigned sectors)
 {
 	if (test_bit(BCACHE_DEV_DETACHING, &dc->disk.flags) ||
-	    !dc->writeback_percent)
+	    (!dc->writeback_percent && !dc->writeback_util_target))
 		return 0;
 
 	return bch_next_delay(&dc->writeback_rate, sectors);
@@ -99,6 +154,7 @@ static unsigned writeback_delay(struct cached_dev *dc, unsigned sectors)
 struct dirty_io {
 	struct closure		cl;
 	struct cached_dev	*dc;
+	unsigned		sequence;
 	struct bio		bio;
 };
 
@@ -109,7 +165,7 @@ static void dirty_init(struct keybuf_key *w)
 
 	bio_init(bio, bio->bi_inline_vecs,
 		 DIV_ROUND_UP(KEY_SIZE(&w->key), PAGE_SECTORS));
-	if (!io->dc->writeback_percent)
+	if (!io->dc->writeback_percent && !io->dc->writeback_util_target)
 		bio_set_prio(bio, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0));
 
 	bio->bi_iter.bi_size	= KEY_SIZE(&w->key) << 9;
@@ -173,18 +229,43 @@ static void dirty_endio(struct bio *bio)
 	closure_put(&io->cl);
 }
 
+/*
+ * The reads from the cache complete in any order, but the writes to the backing
+ * device are issued in the order read_dirty() started them in - that's the
+ * order of the keys, so contiguous keys end up as back to back writes that the
+ * backing device's queue can merge.
+ */
 static void write_dirty(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
 	struct keybuf_key *w = io->bio.bi_private;
+	struct cached_dev *dc = io->dc;
 
-	dirty_init(w);
-	bio_set_op_attrs(&io->bio, REQ_OP_WRITE, 0);
-	io->bio.bi_iter.bi_sector = KEY_START(&w->key);
-	io->bio.bi_bdev		= io->dc->bdev;
-	io->bio.bi_end_io	= dirty_endio;
+	if (atomic_read(&dc->writeback_sequence_next) != io->sequence) {
+		/* Not our turn yet, wait for the write before ours */
+		closure_wait(&dc->writeback_ordering_wait, cl);
 
-	closure_bio_submit(&io->bio, cl);
+		/* The write before ours may have gone before we were added */
+		if (atomic_read(&dc->writeback_sequence_next) == io->sequence)
+			closure_wake_up(&dc->writeback_ordering_wait);
+
+		continue_at(cl, write_dirty, system_wq);
+		return;
+	}
+
+	/* If the read failed, there's nothing to write */
+	if (KEY_DIRTY(&w->key)) {
+		dirty_init(w);
+		bio_set_op_attrs(&io->bio, REQ_OP_WRITE, 0);
+		io->bio.bi_iter.bi_sector = KEY_START(&w->key);
+		io->bio.bi_bdev		= dc->bdev;
+		io->bio.bi_end_io	= dirty_endio;
+
+		closure_bio_submit(&io->bio, cl);
+	}
+
+	atomic_set(&dc->writeback_sequence_next, io->sequence + 1);
+	closure_wake_up(&dc->writeback_ordering_wait);
 
 	continue_at(cl, write_dirty_finish, system_wq);
 }
@@ -212,66 +293,95 @@ static void read_dirty_submit(struct closure *cl)
 static void read_dirty(struct cached_dev *dc)
 {
 	unsigned delay = 0;
-	struct keybuf_key *w;
+	struct keybuf_key *next, *w, *keys[MAX_WRITEBACKS_IN_PASS];
+	unsigned i, nk, size;
+	unsigned sequence = 0;
 	struct dirty_io *io;
 	struct closure cl;
 
 	closure_init_stack(&cl);
+	atomic_set(&dc->writeback_sequence_next, sequence);
 
 	/*
 	 * XXX: if we error, background writeback just spins. Should use some
 	 * mempools.
 	 */
 
-	while (!kthread_should_stop()) {
-
-		w = bch_keybuf_next(&dc->writeback_keys);
-		if (!w)
-			break;
-
-		BUG_ON(ptr_stale(dc->disk.c, &w->key, 0));
-
-		if (KEY_START(&w->key) != dc->last_read ||
-		    jiffies_to_msecs(delay) > 50)
-			while (!kthread_should_stop() && delay)
-				delay = schedule_timeout_interruptible(delay);
-
-		dc->last_read	= KEY_OFFSET(&w->key);
-
-		io = kzalloc(sizeof(struct dirty_io) + sizeof(struct bio_vec)
-			     * DIV_ROUND_UP(KEY_SIZE(&w->key), PAGE_SECTORS),
-			     GFP_KERNEL);
-		if (!io)
-			goto err;
-
-		w->private	= io;
-		io->dc		= dc;
-
-		dirty_init(w);
-		bio_set_op_attrs(&io->bio, REQ_OP_READ, 0);
-		io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
-		io->bio.bi_bdev		= PTR_CACHE(dc->disk.c,
-						    &w->key, 0)->bdev;
-		io->bio.bi_end_io	= read_dirty_endio;
-
-		if (bio_alloc_pages(&io->bio, GFP_KERNEL))
-			goto err_free;
-
-		trace_bcache_writeback(&w->key);
+	next = bch_keybuf_next(&dc->writeback_keys);
+
+	while (!kthread_should_stop() && next) {
+		nk = 0;
+		size = 0;
+
+		/*
+		 * Gather a run of contiguous keys, so that the writes for them
+		 * go out back to back - but not too many, even if they're
+		 * small, and stop once there's a big one:
+		 */
+		do {
+			BUG_ON(ptr_stale(dc->disk.c, &next->key, 0));
+
+			if (nk == MAX_WRITEBACKS_IN_PASS ||
+			    size >= MAX_WRITESIZE_IN_PASS ||
+			    (nk && bkey_cmp(&keys[nk - 1]->key,
+					    &START_KEY(&next->key))))
+				break;
+
+			size += KEY_SIZE(&next->key);
+			keys[nk++] = next;
+		} while ((next = bch_keybuf_next(&dc->writeback_keys)));
+
+		for (i = 0; i < nk; i++) {
+			w = keys[i];
+
+			io = kzalloc(sizeof(struct dirty_io) +
+				     sizeof(struct bio_vec) *
+				     DIV_ROUND_UP(KEY_SIZE(&w->key),
+						  PAGE_SECTORS),
+				     GFP_KERNEL);
+			if (!io)
+				goto err;
+
+			w->private	= io;
+			io->dc		= dc;
+			io->sequence	= sequence++;
+
+			dirty_init(w);
+			bio_set_op_attrs(&io->bio, REQ_OP_READ, 0);
+			io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
+			io->bio.bi_bdev		= PTR_CACHE(dc->disk.c,
+							    &w->key, 0)->bdev;
+			io->bio.bi_end_io	= read_dirty_endio;
+
+			if (bio_alloc_pages(&io->bio, GFP_KERNEL))
+				goto err_free;
+
+			trace_bcache_writeback(&w->key);
+
+			down(&dc->in_flight);
+			closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+		}
 
-		down(&dc->in_flight);
-		closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+		delay = writeback_delay(dc, size);
 
-		delay = writeback_delay(dc, KEY_SIZE(&w->key));
+		while (!kthread_should_stop() && delay) {
+			schedule_timeout_interruptible(delay);
+			delay = writeback_delay(dc, 0);
+		}
 	}
 
 	if (0) {
 err_free:
 		kfree(w->private);
 err:
-		bch_keybuf_del(&dc->writeback_keys, w);
+		/* The rest of the run was never started either */
+		for (; i < nk; i++)
+			bch_keybuf_del(&dc->writeback_keys, keys[i]);
 	}
 
+	if (next)
+		bch_keybuf_del(&dc->writeback_keys, next);
+
 	/*
 	 * Wait for outstanding writeback IOs to finish (and keybuf slots to be
 	 * freed) before refilling again
@@ -507,6 +617,8 @@ void bch_cached_dev_writeback_init(struct cached_dev *dc)
 	dc->writeback_delay		= 30;
 	dc->writeback_rate.rate		= 1024;
 
+	dc->writeback_util_stamp	= jiffies;
+
 	dc->writeback_rate_update_seconds = 5;
 	dc->writeback_rate_d_term	= 30;
 	dc->writeback_rate_p_term_inverse = 6000;
@@ -128,6 +128,29 @@ static void delete_at(struct btree_node *n, unsigned index)
 	n->header.nr_entries = cpu_to_le32(nr_entries - 1);
 }
 
+/*
+ * Delete the entries [begin, end) from a leaf node.
+ */
+static void delete_range(struct btree_node *n, unsigned begin, unsigned end)
+{
+	unsigned nr_entries = le32_to_cpu(n->header.nr_entries);
+	unsigned nr_to_copy = nr_entries - end;
+	uint32_t value_size = le32_to_cpu(n->header.value_size);
+	BUG_ON(begin >= end || end > nr_entries);
+
+	if (nr_to_copy) {
+		memmove(key_ptr(n, begin),
+			key_ptr(n, end),
+			nr_to_copy * sizeof(__le64));
+
+		memmove(value_ptr(n, begin),
+			value_ptr(n, end),
+			nr_to_copy * value_size);
+	}
+
+	n->header.nr_entries = cpu_to_le32(nr_entries - (end - begin));
+}
+
 static unsigned merge_threshold(struct btree_node *n)
 {
 	return le32_to_cpu(n->header.max_entries) / 3;
@@ -594,6 +617,10 @@ static int remove_nearest(struct shadow_spine *s, struct dm_btree_info *info,
 
 		i = lower_bound(n, key);
 
+		/* the rest of the range is likely to be in the next child */
+		if (i + 1 < le32_to_cpu(n->header.nr_entries))
+			dm_bm_prefetch(dm_tm_get_bm(info->tm), value64(n, i + 1));
+
 		/*
 		 * We know the key is present, or else
 		 * rebalance_children would have returned
@@ -610,6 +637,7 @@ static int remove_one(struct dm_btree_info *info, dm_block_t root,
 		      dm_block_t *new_root, unsigned *nr_removed)
 {
 	unsigned level, last_level = info->levels - 1;
+	unsigned i, end, nr_entries;
 	int index = 0, r = 0;
 	struct shadow_spine spine;
 	struct btree_node *n;
@@ -645,12 +673,29 @@ static int remove_one(struct dm_btree_info *info, dm_block_t root,
 
 	k = le64_to_cpu(n->keys[index]);
 	if (k >= keys[last_level] && k < end_key) {
+		/*
+		 * Take out the whole run that's in range while we have the
+		 * leaf, rather than stepping down again for each key.  A
+		 * leaf other than the root keeps at least one entry, the
+		 * next call rebalances on the way down before removing it.
+		 */
+		nr_entries = le32_to_cpu(n->header.nr_entries);
+		end = index + 1;
+		while (end < nr_entries && le64_to_cpu(n->keys[end]) < end_key)
+			end++;
+
+		if (shadow_has_parent(&spine) && end - index == nr_entries &&
+		    nr_entries > 1)
+			end--;
+
 		if (info->value_type.dec)
-			info->value_type.dec(info->value_type.context,
-					     value_ptr(n, index));
+			for (i = index; i < end; i++)
+				info->value_type.dec(info->value_type.context,
+						     value_ptr(n, i));
 
-		delete_at(n, index);
-		keys[last_level] = k + 1ull;
+		keys[last_level] = le64_to_cpu(n->keys[end - 1]) + 1ull;
+		delete_range(n, index, end);
+		*nr_removed += end - index;
 
 	} else
 		r = -ENODATA;
@@ -671,8 +716,6 @@ int dm_btree_remove_leaves(struct dm_btree_info *info, dm_block_t root,
 	*nr_removed = 0;
 	do {
 		r = remove_one(info, root, first_key, end_key, &root, nr_removed);
-		if (!r)
-			(*nr_removed)++;
 	} while (!r);
 
 	*new_root = root;
@@ -0,0 +1,310 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Runtime tests for dm_btree_insert_sorted().  The btrees are built in a
+ * single transaction on the block device given by the 'dev' parameter,
+ * whose contents are destroyed, and never committed.
+ */
+
+#include "dm-btree.h"
+#include "dm-space-map.h"
+#include "dm-transaction-manager.h"
+
+#include <linux/blkdev.h>
+#include <linux/device-mapper.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#define DM_MSG_PREFIX "btree test"
+
+#define TEST_BLOCK_SIZE 4096
+#define TEST_MAX_CONCURRENT_LOCKS 5
+#define TEST_NR_KEYS 4000
+
+static char *dev;
+module_param(dev, charp, 0);
+MODULE_PARM_DESC(dev, "Block device to build the btrees on, e.g. /dev/ram0");
+
+static unsigned total_tests __initdata;
+static unsigned failed_tests __initdata;
+
+static struct dm_btree_info info;
+
+/*
+ * Inserts leaf_keys[0..count) with the value of each key being key * mul,
+ * and checks the number of new entries.
+ */
+static int __init insert_run(dm_block_t *root, uint64_t *keys,
+			     uint64_t *leaf_keys, unsigned count, uint64_t mul,
+			     unsigned expect_inserted)
+{
+	int r;
+	unsigned i, nr_inserted;
+	__le64 *values;
+
+	values = kmalloc_array(count, sizeof(*values), GFP_KERNEL);
+	if (!values)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++)
+		values[i] = cpu_to_le64(leaf_keys[i] * mul);
+
+	__dm_bless_for_disk(values);
+	r = dm_btree_insert_sorted(&info, *root, keys, leaf_keys, values, count,
+				   root, &nr_inserted);
+	kfree(values);
+	if (r)
+		return r;
+
+	if (nr_inserted != expect_inserted) {
+		DMERR("%u new entries, expected %u", nr_inserted,
+		      expect_inserted);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Checks that every key in [begin, end) is present with the value key * mul
+ * if present(key), and absent otherwise.
+ */
+static int __init check_keys(dm_block_t root, uint64_t *keys, uint64_t begin,
+			     uint64_t end, bool (*present)(uint64_t),
+			     uint64_t mul)
+{
+	int r;
+	uint64_t k;
+	__le64 value;
+
+	for (k = begin; k < end; k++) {
+		keys[info.levels - 1] = k;
+		r = dm_btree_lookup(&info, root, keys, &value);
+		if (!present(k)) {
+			if (r != -ENODATA) {
+				DMERR("key %llu: lookup returned %d, expected -ENODATA",
+				      (unsigned long long)k, r);
+				return -EINVAL;
+			}
+			continue;
+		}
+
+		if (r) {
+			DMERR("key %llu: lookup failed with %d",
+			      (unsigned long long)k, r);
+			return r;
+		}
+
+		if (le64_to_cpu(value) != k * mul) {
+			DMERR("key %llu: value %llu, expected %llu",
+			      (unsigned long long)k,
+			      (unsigned long long)le64_to_cpu(value),
+			      (unsigned long long)(k * mul));
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static bool __init is_even(uint64_t k)
+{
+	return !(k & 1);
+}
+
+static bool __init always(uint64_t k)
+{
+	return true;
+}
+
+static bool __init never(uint64_t k)
+{
+	return false;
+}
+
+/*
+ * A run that spans many leaves into an empty tree, then a second run that
+ * overlaps the first half with new keys and overwrites, and the second
+ * half with new keys past its end.
+ */
+static int __init test_sorted_runs(dm_block_t *root, uint64_t *keys)
+{
+	int r;
+	unsigned i;
+	uint64_t *leaf_keys;
+
+	leaf_keys = kmalloc_array(2 * TEST_NR_KEYS, sizeof(*leaf_keys),
+				  GFP_KERNEL);
+	if (!leaf_keys)
+		return -ENOMEM;
+
+	/* 0, 2, 4, ... */
+	for (i = 0; i < TEST_NR_KEYS; i++)
+		leaf_keys[i] = 2 * i;
+
+	r = insert_run(root, keys, leaf_keys, TEST_NR_KEYS, 3, TEST_NR_KEYS);
+	if (r)
+		goto out;
+
+	r = check_keys(*root, keys, 0, 2 * TEST_NR_KEYS, is_even, 3);
+	if (r)
+		goto out;
+
+	/*
+	 * TEST_NR_KEYS .. 3 * TEST_NR_KEYS - 1: the even keys below
+	 * 2 * TEST_NR_KEYS are there already and get overwritten.
+	 */
+	for (i = 0; i < 2 * TEST_NR_KEYS; i++)
+		leaf_keys[i] = TEST_NR_KEYS + i;
+
+	r = insert_run(root, keys, leaf_keys, 2 * TEST_NR_KEYS, 5,
+		       2 * TEST_NR_KEYS - TEST_NR_KEYS / 2);
+	if (r)
+		goto out;
+
+	r = check_keys(*root, keys, 0, TEST_NR_KEYS, is_even, 3);
+	if (r)
+		goto out;
+
+	r = check_keys(*root, keys, TEST_NR_KEYS, 3 * TEST_NR_KEYS, always, 5);
+	if (r)
+		goto out;
+
+	r = check_keys(*root, keys, 3 * TEST_NR_KEYS, 3 * TEST_NR_KEYS + 16,
+		       never, 0);
+
+out:
+	kfree(leaf_keys);
+	return r;
+}
+
+/*
+ * Keys that aren't strictly increasing are refused before anything is
+ * inserted.
+ */
+static int __init test_bad_order(dm_block_t *root, uint64_t *keys)
+{
+	static uint64_t dup_keys[] __initdata = { 1, 3, 3, 5 };
+	static uint64_t unsorted_keys[] __initdata = { 1, 5, 3, 7 };
+	dm_block_t old_root = *root;
+	int r;
+
+	r = insert_run(root, keys, dup_keys, ARRAY_SIZE(dup_keys), 3, 0);
+	if (r != -EINVAL) {
+		DMERR("duplicate keys: returned %d, expected -EINVAL", r);
+		return -EINVAL;
+	}
+
+	r = insert_run(root, keys, unsorted_keys, ARRAY_SIZE(unsorted_keys),
+		       3, 0);
+	if (r != -EINVAL) {
+		DMERR("unsorted keys: returned %d, expected -EINVAL", r);
+		return -EINVAL;
+	}
+
+	if (*root != old_root) {
+		DMERR("root changed by a refused insert");
+		return -EINVAL;
+	}
+
+	return check_keys(*root, keys, 0, 16, is_even, 3);
+}
+
+static void __init run_test(const char *name,
+			    int (*test)(dm_block_t *, uint64_t *),
+			    dm_block_t *root, uint64_t *keys)
+{
+	int r;
+
+	total_tests++;
+	r = test(root, keys);
+	if (r) {
+		DMERR("%s, %u level(s): failed with %d", name, info.levels, r);
+		failed_tests++;
+	}
+}
+
+/* Runs the tests on a fresh tree with @levels levels */
+static void __init run_tests(unsigned levels)
+{
+	int r;
+	dm_block_t root;
+	uint64_t keys[2] = { 7, 0 };
+
+	info.levels = levels;
+
+	r = dm_btree_empty(&info, &root);
+	if (r) {
+		DMERR("dm_btree_empty failed with %d", r);
+		failed_tests++;
+		return;
+	}
+
+	run_test("sorted runs", test_sorted_runs, &root, keys);
+	run_test("bad key order", test_bad_order, &root, keys);
+}
+
+static int __init dm_btree_test_init(void)
+{
+	const fmode_t mode = FMODE_READ | FMODE_WRITE | FMODE_EXCL;
+	struct block_device *bdev;
+	struct dm_block_manager *bm;
+	struct dm_transaction_manager *tm;
+	struct dm_space_map *sm;
+	int r;
+
+	if (!dev) {
+		DMERR("no device given");
+		return -EINVAL;
+	}
+
+	bdev = blkdev_get_by_path(dev, mode, &info);
+	if (IS_ERR(bdev))
+		return PTR_ERR(bdev);
+
+	bm = dm_block_manager_create(bdev, TEST_BLOCK_SIZE,
+				     TEST_MAX_CONCURRENT_LOCKS);
+	if (IS_ERR(bm)) {
+		r = PTR_ERR(bm);
+		goto out_bdev;
+	}
+
+	/* block 0 would hold the superblock */
+	r = dm_tm_create_with_sm(bm, 0, &tm, &sm);
+	if (r)
+		goto out_bm;
+
+	info.tm = tm;
+	info.value_type.context = NULL;
+	info.value_type.size = sizeof(__le64);
+	info.value_type.inc = NULL;
+	info.value_type.dec = NULL;
+	info.value_type.equal = NULL;
+
+	run_tests(1);
+	run_tests(2);
+
+	if (failed_tests == 0)
+		DMINFO("all %u tests passed", total_tests);
+	else
+		DMERR("failed %u out of %u tests", failed_tests, total_tests);
+	r = failed_tests ? -EINVAL : 0;
+
+	dm_sm_destroy(sm);
+	dm_tm_destroy(tm);
+out_bm:
+	dm_block_manager_destroy(bm);
+out_bdev:
+	blkdev_put(bdev, mode);
+	return r;
+}
+
+static void __exit dm_btree_test_exit(void)
+{
+}
+
+module_init(dm_btree_test_init);
+module_exit(dm_btree_test_exit);
+
+MODULE_DESCRIPTION("Tests for the persistent-data btree");
+MODULE_LICENSE("GPL");
@@ -703,11 +703,17 @@ static int btree_split_beneath(struct shadow_spine *s, uint64_t key)
 	return 0;
 }
 
+/*
+ * If @upper is given, it's set to the (exclusive) upper bound of the keys
+ * that belong in the leaf we stop at, UINT64_MAX for the last leaf, and the
+ * next sibling at each level is prefetched on the way down.
+ */
 static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 			    struct dm_btree_value_type *vt,
-			    uint64_t key, unsigned *index)
+			    uint64_t key, unsigned *index, uint64_t *upper)
 {
 	int r, i = *index, top = 1;
+	uint64_t bound = UINT64_MAX, parent_bound = UINT64_MAX;
 	struct btree_node *node;
 
 	for (;;) {
@@ -740,6 +746,24 @@ static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 
 			if (r < 0)
 				return r;
+
+			/* splitting the top gives it a parent in this tree */
+			top = 0;
+		}
+
+		/*
+		 * Work out the bound here rather than when stepping down,
+		 * a split may have just put us in the left half.  The
+		 * spine parent of the top node belongs to the level above.
+		 */
+		if (upper && !top) {
+			struct btree_node *pn = dm_block_data(shadow_parent(s));
+			int pi = lower_bound(pn, key);
+
+			if (pi + 1 < le32_to_cpu(pn->header.nr_entries))
+				bound = le64_to_cpu(pn->keys[pi + 1]);
+			else
+				bound = parent_bound;
 		}
 
 		node = dm_block_data(shadow_current(s));
@@ -755,13 +779,20 @@ static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 			i = 0;
 		}
 
+		if (upper && i + 1 < le32_to_cpu(node->header.nr_entries))
+			dm_bm_prefetch(dm_tm_get_bm(s->info->tm),
+				       value64(node, i + 1));
+
 		root = value64(node, i);
+		parent_bound = bound;
 		top = 0;
 	}
 
 	if (i < 0 || le64_to_cpu(node->keys[i]) != key)
 		i++;
 
+	if (upper)
+		*upper = bound;
 	*index = i;
 	return 0;
 }
@@ -773,80 +804,116 @@ static bool need_insert(struct btree_node *node, uint64_t *keys,
 		(le64_to_cpu(node->keys[index]) != keys[level]));
 }
 
-static int insert(struct dm_btree_info *info, dm_block_t root,
-		  uint64_t *keys, void *value, dm_block_t *new_root,
-		  int *inserted)
-		  __dm_written_to_disk(value)
+/*
+ * Steps down the upper levels of a multi-level btree, adding any subtrees
+ * that @keys need, and returns the root of the bottom level tree in @block.
+ */
+static int insert_upper_levels(struct shadow_spine *s, dm_block_t root,
+			       uint64_t *keys, dm_block_t *block,
+			       unsigned *index)
 {
 	int r;
-	unsigned level, index = -1, last_level = info->levels - 1;
-	dm_block_t block = root;
-	struct shadow_spine spine;
+	unsigned level;
+	struct dm_btree_info *info = s->info;
 	struct btree_node *n;
 	struct dm_btree_value_type le64_type;
 
 	init_le64_type(info->tm, &le64_type);
-	init_shadow_spine(&spine, info);
+	*block = root;
 
 	for (level = 0; level < (info->levels - 1); level++) {
-		r = btree_insert_raw(&spine, block, &le64_type, keys[level], &index);
+		r = btree_insert_raw(s, *block, &le64_type, keys[level],
+				     index, NULL);
 		if (r < 0)
-			goto bad;
+			return r;
 
-		n = dm_block_data(shadow_current(&spine));
+		n = dm_block_data(shadow_current(s));
 
-		if (need_insert(n, keys, level, index)) {
+		if (need_insert(n, keys, level, *index)) {
 			dm_block_t new_tree;
 			__le64 new_le;
 
 			r = dm_btree_empty(info, &new_tree);
 			if (r < 0)
-				goto bad;
+				return r;
 
 			new_le = cpu_to_le64(new_tree);
 			__dm_bless_for_disk(&new_le);
 
-			r = insert_at(sizeof(uint64_t), n, index,
+			r = insert_at(sizeof(uint64_t), n, *index,
 				      keys[level], &new_le);
 			if (r)
-				goto bad;
+				return r;
 		}
 
-		if (level < last_level)
-			block = value64(n, index);
+		*block = value64(n, *index);
 	}
 
+	return 0;
+}
+
+/*
+ * Puts @value at @index of leaf @n, either as a new entry or over the
+ * value already there for @key.  There must be room for a new entry.
+ */
+static int insert_into_leaf(struct dm_btree_info *info, struct btree_node *n,
+			    unsigned index, uint64_t key, void *value,
+			    int *inserted)
+			    __dm_written_to_disk(value)
+{
+	if (need_insert(n, &key, 0, index)) {
+		if (inserted)
+			*inserted = 1;
+
+		return insert_at(info->value_type.size, n, index, key, value);
+	}
+
+	if (inserted)
+		*inserted = 0;
+
+	if (info->value_type.dec &&
+	    (!info->value_type.equal ||
+	     !info->value_type.equal(
+		     info->value_type.context,
+		     value_ptr(n, index),
+		     value))) {
+		info->value_type.dec(info->value_type.context,
+				     value_ptr(n, index));
+	}
+	memcpy_disk(value_ptr(n, index),
+		    value, info->value_type.size);
+
+	return 0;
+}
+
+static int insert(struct dm_btree_info *info, dm_block_t root,
+		  uint64_t *keys, void *value, dm_block_t *new_root,
+		  int *inserted)
+		  __dm_written_to_disk(value)
+{
+	int r;
+	unsigned index = -1, last_level = info->levels - 1;
+	dm_block_t block;
+	struct shadow_spine spine;
+	struct btree_node *n;
+
+	init_shadow_spine(&spine, info);
+
+	r = insert_upper_levels(&spine, root, keys, &block, &index);
+	if (r < 0)
+		goto bad;
+
 	r = btree_insert_raw(&spine, block, &info->value_type,
-			     keys[level], &index);
+			     keys[last_level], &index, NULL);
 	if (r < 0)
 		goto bad;
 
 	n = dm_block_data(shadow_current(&spine));
 
-	if (need_insert(n, keys, level, index)) {
-		if (inserted)
-			*inserted = 1;
-
-		r = insert_at(info->value_type.size, n, index,
-			      keys[level], value);
-		if (r)
-			goto bad_unblessed;
-	} else {
-		if (inserted)
-			*inserted = 0;
-
-		if (info->value_type.dec &&
-		    (!info->value_type.equal ||
-		     !info->value_type.equal(
-			     info->value_type.context,
-			     value_ptr(n, index),
-			     value))) {
-			info->value_type.dec(info->value_type.context,
-					     value_ptr(n, index));
-		}
-		memcpy_disk(value_ptr(n, index),
-			    value, info->value_type.size);
-	}
+	r = insert_into_leaf(info, n, index, keys[last_level], value,
+			     inserted);
+	if (r)
+		goto bad_unblessed;
 
 	*new_root = shadow_root(&spine);
 	exit_shadow_spine(&spine);
@@ -877,6 +944,91 @@ int dm_btree_insert_notify(struct dm_btree_info *info, dm_block_t root,
 }
 EXPORT_SYMBOL_GPL(dm_btree_insert_notify);
 
+int dm_btree_insert_sorted(struct dm_btree_info *info, dm_block_t root,
+			   uint64_t *keys, uint64_t *leaf_keys, void *values,
+			   unsigned count, dm_block_t *new_root,
+			   unsigned *nr_inserted)
+			   __dm_written_to_disk(values)
+{
+	int r, pos, inserted;
+	unsigned i, index, done = 0;
+	uint32_t value_size = info->value_type.size;
+	uint64_t upper;
+	dm_block_t block;
+	struct shadow_spine spine;
+	struct btree_node *n;
+
+	if (nr_inserted)
+		*nr_inserted = 0;
+
+	for (i = 1; i < count; i++)
+		if (leaf_keys[i] <= leaf_keys[i - 1]) {
+			__dm_unbless_for_disk(values);
+			return -EINVAL;
+		}
+
+	/*
+	 * Each pass steps down to the leaf for the next key, splitting on the
+	 * way as a single insert would, then fills in every following key
+	 * that belongs in that leaf while there's room.  Nodes this
+	 * transaction has already shadowed are just relocked on the next
+	 * pass, so the cost is mostly one lookup per leaf rather than per
+	 * key.
+	 */
+	while (done < count) {
+		index = -1;
+		init_shadow_spine(&spine, info);
+
+		r = insert_upper_levels(&spine, root, keys, &block, &index);
+		if (r < 0)
+			goto bad;
+
+		r = btree_insert_raw(&spine, block, &info->value_type,
+				     leaf_keys[done], &index, &upper);
+		if (r < 0)
+			goto bad;
+
+		n = dm_block_data(shadow_current(&spine));
+
+		for (;;) {
+			r = insert_into_leaf(info, n, index, leaf_keys[done],
+					     values + done * value_size,
+					     &inserted);
+			if (r)
+				goto bad;
+
+			if (nr_inserted)
+				*nr_inserted += inserted;
+
+			if (++done == count || leaf_keys[done] >= upper)
+				break;
+
+			pos = lower_bound(n, leaf_keys[done]);
+			if (pos < 0 ||
+			    le64_to_cpu(n->keys[pos]) != leaf_keys[done])
+				pos++;
+
+			index = pos;
+			if (need_insert(n, leaf_keys, done, index) &&
+			    n->header.nr_entries == n->header.max_entries)
+				break;
+		}
+
+		root = shadow_root(&spine);
+		exit_shadow_spine(&spine);
+	}
+
+	*new_root = root;
+	return 0;
+
+bad:
+	/* the values that weren't inserted yet */
+	__dm_unbless_for_disk(values);
+	exit_shadow_spine(&spine);
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_btree_insert_sorted);
+
 /*----------------------------------------------------------------*/
 
 static int find_key(struct ro_spine *s, dm_block_t block, bool find_highest,
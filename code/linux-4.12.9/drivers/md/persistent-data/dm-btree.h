@@ -133,6 +133,22 @@ int dm_btree_insert_notify(struct dm_btree_info *info, dm_block_t root,
 			   int *inserted)
 			   __dm_written_to_disk(value);
 
+/*
+ * Inserts (or overwrites) 'count' values in one go.  'keys' gives the
+ * upper levels as for dm_btree_insert(), 'leaf_keys' the bottom level key
+ * of each value, which must be strictly increasing, and 'values' the values
+ * back to back.  Each leaf is only looked up once for all the keys that go
+ * in it, so this is much cheaper than inserting one at a time when the
+ * keys are close together.  'nr_inserted' (which may be NULL) is set to
+ * the number of new entries.  On error some of the values may have been
+ * inserted already.
+ */
+int dm_btree_insert_sorted(struct dm_btree_info *info, dm_block_t root,
+			   uint64_t *keys, uint64_t *leaf_keys, void *values,
+			   unsigned count, dm_block_t *new_root,
+			   unsigned *nr_inserted)
+			   __dm_written_to_disk(values);
+
 /*
  * Remove a key if present.  This doesn't remove empty sub trees.  Normally
  * subtrees represent a separate entity, like a snapshot map, so this is
@@ -145,7 +161,7 @@ int dm_btree_remove(struct dm_btree_info *info, dm_block_t root,
  * Removes a _contiguous_ run of values starting from 'keys' and not
  * reaching keys2 (where keys2 is keys with the final key replaced with
  * 'end_key').  'end_key' is the one-past-the-end value.  'keys' may be
- * altered.
+ * altered.  All the values in range within a leaf are removed together.
  */
 int dm_btree_remove_leaves(struct dm_btree_info *info, dm_block_t root,
 			   uint64_t *keys, uint64_t end_key,
@@ -7,6 +7,7 @@
 
 struct blk_mq_tags;
 struct blk_flush_queue;
+struct blk_mq_poll_ctl;
 
 struct blk_mq_hw_ctx {
 	struct {
@@ -57,6 +58,11 @@ struct blk_mq_hw_ctx {
 	unsigned long		poll_considered;
 	unsigned long		poll_invoked;
 	unsigned long		poll_success;
+	unsigned long		poll_slept;
+	unsigned long		poll_spin_ns;
+	unsigned long		poll_gave_up;
+
+	struct blk_mq_poll_ctl	*poll_ctl;
 
 #ifdef CONFIG_BLK_DEBUG_FS
 	struct dentry		*debugfs_dir;
@@ -88,6 +94,7 @@ struct blk_mq_queue_data {
 };
 
 typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, const struct blk_mq_queue_data *);
+typedef void (queue_rqs_fn)(struct blk_mq_hw_ctx *, struct list_head *);
 typedef enum blk_eh_timer_return (timeout_fn)(struct request *, bool);
 typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
 typedef void (exit_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
@@ -110,6 +117,14 @@ struct blk_mq_ops {
 	 */
 	queue_rq_fn		*queue_rq;
 
+	/*
+	 * Queue a list of requests at once, optional. All of them have a
+	 * driver tag. The driver removes the requests it takes off the list,
+	 * ending those that fail itself. Requests left on the list must not
+	 * have been started, they are issued with ->queue_rq() afterwards.
+	 */
+	queue_rqs_fn		*queue_rqs;
+
 	/*
 	 * Called on request timeout
 	 */
@@ -307,6 +307,10 @@ struct blk_rq_stat {
 	s64 mean;
 	u64 min;
 	u64 max;
+	/* only filled in for callbacks with histograms, see blk-stat.h */
+	u64 p50;
+	u64 p90;
+	u64 p99;
 	s32 nr_samples;
 	s32 nr_batch;
 	u64 batch;
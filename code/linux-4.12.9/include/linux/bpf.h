@@ -14,6 +14,7 @@
 #include <linux/percpu.h>
 #include <linux/err.h>
 #include <linux/rbtree_latch.h>
+#include <linux/prcu.h>
 
 struct perf_event;
 struct bpf_map;
@@ -53,6 +54,30 @@ struct bpf_map {
 	struct bpf_map *inner_map_meta;
 };
 
+/* Elements of BPF_F_PRCU_RECLAIM maps are freed after a PRCU grace period,
+ * so accesses from outside of BPF programs (which get their PRCU reader
+ * from BPF_PROG_RUN) need a PRCU read-side critical section in addition
+ * to the RCU one.
+ */
+static inline bool bpf_map_is_prcu(const struct bpf_map *map)
+{
+	return map->map_flags & BPF_F_PRCU_RECLAIM;
+}
+
+static inline void bpf_map_read_lock(const struct bpf_map *map)
+{
+	rcu_read_lock();
+	if (bpf_map_is_prcu(map))
+		prcu_read_lock();
+}
+
+static inline void bpf_map_read_unlock(const struct bpf_map *map)
+{
+	if (bpf_map_is_prcu(map))
+		prcu_read_unlock();
+	rcu_read_unlock();
+}
+
 /* function argument constraints */
 enum bpf_arg_type {
 	ARG_DONTCARE = 0,	/* unused argument in helper function */
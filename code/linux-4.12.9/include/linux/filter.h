@@ -16,6 +16,8 @@
 #include <linux/sched.h>
 #include <linux/capability.h>
 #include <linux/cryptohash.h>
+#include <linux/jump_label.h>
+#include <linux/prcu.h>
 
 #include <net/sch_generic.h>
 
@@ -425,7 +427,8 @@ struct bpf_prog {
 				locked:1,	/* Program image locked? */
 				gpl_compatible:1, /* Is filter GPL compatible? */
 				cb_access:1,	/* Is control block accessed? */
-				dst_needed:1;	/* Do we need dst entry? */
+				dst_needed:1,	/* Do we need dst entry? */
+				prcu:1;		/* Uses BPF_F_PRCU_RECLAIM maps? */
 	kmemcheck_bitfield_end(meta);
 	enum bpf_prog_type	type;		/* Type of BPF program */
 	u32			len;		/* Number of filter blocks */
@@ -447,7 +450,26 @@ struct sk_filter {
 	struct bpf_prog	*prog;
 };
 
-#define BPF_PROG_RUN(filter, ctx)  (*filter->bpf_func)(ctx, filter->insnsi)
+/* Enabled while any program with ->prcu set is loaded */
+DECLARE_STATIC_KEY_FALSE(bpf_prog_prcu_key);
+
+/* Programs using BPF_F_PRCU_RECLAIM maps run as PRCU readers. */
+static __always_inline unsigned int __bpf_prog_run_reader(const struct bpf_prog *prog,
+							  const void *ctx)
+{
+	unsigned int ret;
+
+	if (static_branch_unlikely(&bpf_prog_prcu_key) && prog->prcu) {
+		prcu_read_lock();
+		ret = (*prog->bpf_func)(ctx, prog->insnsi);
+		prcu_read_unlock();
+		return ret;
+	}
+
+	return (*prog->bpf_func)(ctx, prog->insnsi);
+}
+
+#define BPF_PROG_RUN(filter, ctx)  __bpf_prog_run_reader(filter, ctx)
 
 #define BPF_SKB_CB_LEN QDISC_CB_PRIV_LEN
 
@@ -78,6 +78,14 @@ enum {
 	 * percpu_ref_reinit() before used.  Implies INIT_ATOMIC.
 	 */
 	PERCPU_REF_INIT_DEAD	= 1 << 1,
+
+	/*
+	 * Switch to atomic mode from a callback shared with all other such
+	 * refs switched during the same grace period, rather than queueing
+	 * an RCU callback per ref.  Meant for refs which are killed in
+	 * bulk; a single switch may take up to two grace periods.
+	 */
+	PERCPU_REF_INIT_BATCH	= 1 << 2,
 };
 
 struct percpu_ref {
@@ -90,7 +98,11 @@ struct percpu_ref {
 	percpu_ref_func_t	*release;
 	percpu_ref_func_t	*confirm_switch;
 	bool			force_atomic:1;
-	struct rcu_head		rcu;
+	bool			batch_switch:1;
+	union {
+		struct rcu_head		rcu;
+		struct percpu_ref	*batch_next;	/* PERCPU_REF_INIT_BATCH */
+	};
 };
 
 int __must_check percpu_ref_init(struct percpu_ref *ref,
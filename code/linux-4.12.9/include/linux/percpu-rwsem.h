@@ -6,6 +6,7 @@
 #include <linux/percpu.h>
 #include <linux/rcuwait.h>
 #include <linux/rcu_sync.h>
+#include <linux/prcu.h>
 #include <linux/lockdep.h>
 
 struct percpu_rw_semaphore {
@@ -16,15 +17,27 @@ struct percpu_rw_semaphore {
 	int			readers_block;
 };
 
-#define DEFINE_STATIC_PERCPU_RWSEM(name)				\
+#define __DEFINE_STATIC_PERCPU_RWSEM(name, type)			\
 static DEFINE_PER_CPU(unsigned int, __percpu_rwsem_rc_##name);		\
 static struct percpu_rw_semaphore name = {				\
-	.rss = __RCU_SYNC_INITIALIZER(name.rss, RCU_SCHED_SYNC),	\
+	.rss = __RCU_SYNC_INITIALIZER(name.rss, type),			\
 	.read_count = &__percpu_rwsem_rc_##name,			\
 	.rw_sem = __RWSEM_INITIALIZER(name.rw_sem),			\
 	.writer = __RCUWAIT_INITIALIZER(name.writer),			\
 }
 
+#define DEFINE_STATIC_PERCPU_RWSEM(name)				\
+	__DEFINE_STATIC_PERCPU_RWSEM(name, RCU_SCHED_SYNC)
+
+/*
+ * A percpu_rw_semaphore whose reader fastpath is protected by PRCU
+ * instead of RCU-sched.  Readers must use percpu_down_read_prcu() and
+ * percpu_up_read_prcu(); the writer side is shared with the RCU-sched
+ * flavor.
+ */
+#define DEFINE_STATIC_PERCPU_RWSEM_PRCU(name)				\
+	__DEFINE_STATIC_PERCPU_RWSEM(name, RCU_PRCU_SYNC)
+
 extern int __percpu_down_read(struct percpu_rw_semaphore *, int);
 extern void __percpu_up_read(struct percpu_rw_semaphore *);
 
@@ -107,11 +120,64 @@ static inline void percpu_up_read(struct percpu_rw_semaphore *sem)
 	percpu_up_read_preempt_enable(sem);
 }
 
+static inline void percpu_down_read_prcu(struct percpu_rw_semaphore *sem)
+{
+	bool idle;
+
+	might_sleep();
+
+	rwsem_acquire_read(&sem->rw_sem.dep_map, 0, 0, _RET_IP_);
+
+	/*
+	 * Same as in percpu_down_read(), except that the PRCU read-side
+	 * critical section takes the place of the preempt-disabled region:
+	 * the writer's synchronize_prcu() waits for it.  We may migrate,
+	 * so use this_cpu_inc(); the counters are only ever summed.  The
+	 * slowpath does not rely on the grace period, so leave the PRCU
+	 * read-side critical section before taking it rather than holding
+	 * up other PRCU updaters.
+	 */
+	prcu_read_lock();
+	this_cpu_inc(*sem->read_count);
+	idle = rcu_sync_is_idle(&sem->rss);
+	prcu_read_unlock();
+	if (unlikely(!idle)) {
+		preempt_disable();
+		__percpu_down_read(sem, false); /* Unconditional memory barrier */
+		preempt_enable();
+	}
+}
+
+static inline void percpu_up_read_prcu(struct percpu_rw_semaphore *sem)
+{
+	bool idle;
+
+	/*
+	 * Same as in percpu_up_read().  The slowpath is correct whether
+	 * or not a writer is still around, so only the fastpath needs to
+	 * be in the PRCU read-side critical section.
+	 */
+	prcu_read_lock();
+	idle = rcu_sync_is_idle(&sem->rss);
+	if (likely(idle))
+		this_cpu_dec(*sem->read_count);
+	prcu_read_unlock();
+	if (unlikely(!idle)) {
+		preempt_disable();
+		__percpu_up_read(sem); /* Unconditional memory barrier */
+		preempt_enable();
+	}
+
+	rwsem_release(&sem->rw_sem.dep_map, 1, _RET_IP_);
+}
+
 extern void percpu_down_write(struct percpu_rw_semaphore *);
 extern void percpu_up_write(struct percpu_rw_semaphore *);
 
 extern int __percpu_init_rwsem(struct percpu_rw_semaphore *,
 				const char *, struct lock_class_key *);
+extern int __percpu_init_rwsem_prcu(struct percpu_rw_semaphore *,
+				const char *, struct lock_class_key *);
 
 extern void percpu_free_rwsem(struct percpu_rw_semaphore *);
 
@@ -121,6 +187,12 @@ extern void percpu_free_rwsem(struct percpu_rw_semaphore *);
 	__percpu_init_rwsem(sem, #sem, &rwsem_key);		\
 })
 
+#define percpu_init_rwsem_prcu(sem)				\
+({								\
+	static struct lock_class_key rwsem_key;			\
+	__percpu_init_rwsem_prcu(sem, #sem, &rwsem_key);	\
+})
+
 #define percpu_rwsem_is_held(sem) lockdep_is_held(&(sem)->rw_sem)
 
 #define percpu_rwsem_assert_held(sem)				\
@@ -33,6 +33,12 @@ struct percpu_ida {
 	 */
 	cpumask_t			cpus_have_tags;
 
+	/*
+	 * Bitmap of cpus that (may) have stashed tags, which take_stashed_tags()
+	 * can take without pool->lock.  Same rules as cpus_have_tags.
+	 */
+	cpumask_t			cpus_have_stash;
+
 	struct {
 		spinlock_t		lock;
 		/*
@@ -14,10 +14,12 @@
 #define __LINUX_PRCU_H
 
 #include <linux/atomic.h>
+#include <linux/llist.h>
 #include <linux/types.h>
 #include <linux/mutex.h>
 #include <linux/wait.h>
 #include <linux/completion.h>
+#include <linux/rcupdate.h>
 
 #ifdef CONFIG_PRCU
 
@@ -30,7 +32,11 @@
  */
 struct prcu_version_head {
        unsigned long long version;
-       struct prcu_version_head *next;
+       union {
+               struct prcu_version_head *next;
+               struct llist_node llnode;  /* On ->pending, see call_prcu() */
+       };
+       struct rcu_head *head;             /* Only valid on ->pending */
 };
 
 /*
@@ -64,9 +70,24 @@ struct prcu_local_struct {
        unsigned long long version;    /* Local grace-period version */
        unsigned long long cb_version; /* Local callback version */
        struct rcu_head barrier_head;  /* PRCU callback list */
+       struct llist_head pending;     /* Callbacks queued by call_prcu() */
+                                      /*  not yet moved to ->cblist */
        struct prcu_cblist cblist;     /* PRCU callback version list */
 };
 
+#ifdef CONFIG_PRCU_NODE_CALLBACKS
+/*
+ * PRCU's per-node state, holding callbacks that must be invoked by
+ * a CPU on this node, see call_prcu_node().
+ */
+struct prcu_node_struct {
+       spinlock_t lock;               /* Protects ->cblist */
+       struct prcu_cblist cblist;     /* PRCU callback version list */
+       unsigned long long head_version; /* Version of the oldest callback */
+       struct rcu_head barrier_head;  /* For prcu_barrier() */
+};
+#endif /* #ifdef CONFIG_PRCU_NODE_CALLBACKS */
+
 /*
  * PRCU's global state.
  */
@@ -91,6 +112,44 @@ void synchronize_prcu(void);
 void call_prcu(struct rcu_head *head, rcu_callback_t func);
 void prcu_barrier(void);
 
+#ifdef CONFIG_PRCU_NODE_CALLBACKS
+void call_prcu_node(struct rcu_head *head, rcu_callback_t func, int nid);
+#else /* #ifdef CONFIG_PRCU_NODE_CALLBACKS */
+static inline void call_prcu_node(struct rcu_head *head, rcu_callback_t func,
+                                  int nid)
+{
+       call_prcu(head, func);
+}
+#endif /* #else #ifdef CONFIG_PRCU_NODE_CALLBACKS */
+
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+extern struct lockdep_map prcu_lock_map;
+int prcu_read_lock_held(void);
+#else /* #ifdef CONFIG_DEBUG_LOCK_ALLOC */
+static inline int prcu_read_lock_held(void)
+{
+       return 1;
+}
+#endif /* #else #ifdef CONFIG_DEBUG_LOCK_ALLOC */
+
+/**
+ * prcu_dereference_check() - fetch PRCU-protected pointer for later use
+ * @p: the pointer to fetch and protect for later dereferencing
+ * @c: condition to check for update-side use
+ *
+ * This is the PRCU counterpart to rcu_dereference_check().
+ */
+#define prcu_dereference_check(p, c) \
+       __rcu_dereference_check((p), (c) || prcu_read_lock_held(), __rcu)
+
+/**
+ * prcu_dereference() - fetch PRCU-protected pointer for later use
+ * @p: the pointer to fetch and protect for later dereferencing
+ *
+ * Makes rcu_dereference_check() do the dirty work.
+ */
+#define prcu_dereference(p) prcu_dereference_check((p), 0)
+
 /*
  * Internal non-public functions.
  */
@@ -110,7 +169,11 @@ void prcu_check_callbacks(void);
 #define prcu_read_unlock rcu_read_unlock
 #define synchronize_prcu synchronize_rcu
 #define call_prcu call_rcu
+#define call_prcu_node(head, func, nid) call_rcu(head, func)
 #define prcu_barrier rcu_barrier
+#define prcu_read_lock_held rcu_read_lock_held
+#define prcu_dereference_check rcu_dereference_check
+#define prcu_dereference rcu_dereference
 
 #define prcu_init() do {} while (0)
 #define prcu_note_context_switch() do {} while (0)
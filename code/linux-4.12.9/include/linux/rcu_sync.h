@@ -26,7 +26,7 @@
 #include <linux/wait.h>
 #include <linux/rcupdate.h>
 
-enum rcu_sync_type { RCU_SYNC, RCU_SCHED_SYNC, RCU_BH_SYNC };
+enum rcu_sync_type { RCU_SYNC, RCU_SCHED_SYNC, RCU_BH_SYNC, RCU_PRCU_SYNC };
 
 /* Structure to mediate between updaters and fastpath-using readers.  */
 struct rcu_sync {
@@ -84,4 +84,7 @@ extern void rcu_sync_dtor(struct rcu_sync *);
 #define DEFINE_RCU_BH_SYNC(name)	\
 	__DEFINE_RCU_SYNC(name, RCU_BH_SYNC)
 
+#define DEFINE_RCU_PRCU_SYNC(name)	\
+	__DEFINE_RCU_SYNC(name, RCU_PRCU_SYNC)
+
 #endif /* _LINUX_RCU_SYNC_H_ */
@@ -26,6 +26,7 @@
 #include <linux/workqueue.h>
 #include <linux/mutex.h>
 #include <linux/rculist.h>
+#include <linux/prcu.h>
 
 /*
  * The end of the chain is marked with a special nulls marks which has
@@ -129,6 +130,7 @@ struct rhashtable;
  * @min_size: Minimum size while shrinking
  * @locks_mul: Number of bucket locks to allocate per cpu (default: 128)
  * @automatic_shrinking: Enable automatic shrinking of tables
+ * @prcu: Protect readers with PRCU instead of RCU, see rhashtable_read_lock()
  * @nulls_base: Base value to generate nulls marker
  * @hashfn: Hash function (default: jhash2 if !(key_len % 4), or jhash)
  * @obj_hashfn: Function to hash object
@@ -142,6 +144,7 @@ struct rhashtable_params {
 	unsigned int		max_size;
 	u16			min_size;
 	bool			automatic_shrinking;
+	bool			prcu;
 	u8			locks_mul;
 	u32			nulls_base;
 	rht_hashfn_t		hashfn;
@@ -397,13 +400,87 @@ struct rhash_head __rcu **rht_bucket_nested_insert(struct rhashtable *ht,
 	rcu_dereference_protected(p, lockdep_rht_mutex_is_held(ht))
 
 #define rht_dereference_rcu(p, ht) \
-	rcu_dereference_check(p, lockdep_rht_mutex_is_held(ht))
+	rcu_dereference_check(p, lockdep_rht_mutex_is_held(ht) || \
+			      prcu_read_lock_held())
 
 #define rht_dereference_bucket(p, tbl, hash) \
 	rcu_dereference_protected(p, lockdep_rht_bucket_is_held(tbl, hash))
 
 #define rht_dereference_bucket_rcu(p, tbl, hash) \
-	rcu_dereference_check(p, lockdep_rht_bucket_is_held(tbl, hash))
+	rcu_dereference_check(p, lockdep_rht_bucket_is_held(tbl, hash) || \
+			      prcu_read_lock_held())
+
+/* Internal functions, @prcu is normally a compile-time constant. */
+static inline void __rht_read_lock(bool prcu)
+{
+	if (prcu)
+		prcu_read_lock();
+	else
+		rcu_read_lock();
+}
+
+static inline void __rht_read_unlock(bool prcu)
+{
+	if (prcu)
+		prcu_read_unlock();
+	else
+		rcu_read_unlock();
+}
+
+/**
+ * rhashtable_read_lock - enter a read-side critical section of a table
+ * @ht:		hash table
+ *
+ * Tables created with rhashtable_params.prcu set are protected by PRCU,
+ * so their readers must use this (or prcu_read_lock()) rather than
+ * rcu_read_lock().  For other tables it is rcu_read_lock().
+ */
+static inline void rhashtable_read_lock(const struct rhashtable *ht)
+{
+	__rht_read_lock(ht->p.prcu);
+}
+
+/**
+ * rhashtable_read_unlock - leave a read-side critical section of a table
+ * @ht:		hash table
+ */
+static inline void rhashtable_read_unlock(const struct rhashtable *ht)
+{
+	__rht_read_unlock(ht->p.prcu);
+}
+
+/**
+ * rhashtable_call_rcu - invoke a callback after readers of a table are done
+ * @ht:		hash table
+ * @head:	rcu_head of the object removed from @ht
+ * @func:	callback, typically freeing the object
+ *
+ * Uses call_prcu() or call_rcu() according to the flavor of @ht.
+ */
+static inline void rhashtable_call_rcu(const struct rhashtable *ht,
+				       struct rcu_head *head,
+				       rcu_callback_t func)
+{
+	if (ht->p.prcu)
+		call_prcu(head, func);
+	else
+		call_rcu(head, func);
+}
+
+/**
+ * rhashtable_barrier - wait for callbacks queued on behalf of a table
+ * @ht:		hash table
+ *
+ * Waits for rhashtable_call_rcu() callbacks and for the deferred
+ * freeing of bucket tables replaced by resizing.
+ */
+static inline void rhashtable_barrier(const struct rhashtable *ht)
+{
+	if (ht->p.prcu)
+		prcu_barrier();
+	else
+		rcu_barrier();
+}
 
 #define rht_entry(tpos, pos, member) \
 	({ tpos = container_of(pos, typeof(*tpos), member); 1; })
@@ -639,7 +716,8 @@ restart:
  * Computes the hash value for the key and traverses the bucket chain looking
  * for a entry with an identical key. The first matching entry is returned.
  *
- * This must only be called under the RCU read lock.
+ * This must only be called under the RCU read lock, or the PRCU read lock
+ * if the table was created with @prcu set.
  *
  * Returns the first entry on which the compare function returned true.
  */
@@ -672,9 +750,9 @@ static inline void *rhashtable_lookup_fast(
 {
 	void *obj;
 
-	rcu_read_lock();
+	__rht_read_lock(params.prcu);
 	obj = rhashtable_lookup(ht, key, params);
-	rcu_read_unlock();
+	__rht_read_unlock(params.prcu);
 
 	return obj;
 }
@@ -689,7 +767,8 @@ static inline void *rhashtable_lookup_fast(
  * for a entry with an identical key.  All matching entries are returned
  * in a list.
  *
- * This must only be called under the RCU read lock.
+ * This must only be called under the RCU read lock, or the PRCU read lock
+ * if the table was created with @prcu set.
  *
  * Returns the list of entries that match the given key.
  */
@@ -722,7 +801,7 @@ static inline void *__rhashtable_insert_fast(
 	int elasticity;
 	void *data;
 
-	rcu_read_lock();
+	__rht_read_lock(params.prcu);
 
 	tbl = rht_dereference_rcu(ht->tbl, ht);
 	hash = rht_head_hashfn(ht, tbl, obj, params);
@@ -732,7 +811,7 @@ static inline void *__rhashtable_insert_fast(
 	if (unlikely(rht_dereference_bucket(tbl->future_tbl, tbl, hash))) {
 slow_path:
 		spin_unlock_bh(lock);
-		rcu_read_unlock();
+		__rht_read_unlock(params.prcu);
 		return rhashtable_insert_slow(ht, key, obj);
 	}
 
@@ -801,7 +880,7 @@ good:
 
 out:
 	spin_unlock_bh(lock);
-	rcu_read_unlock();
+	__rht_read_unlock(params.prcu);
 
 	return data;
 }
@@ -1087,7 +1166,7 @@ static inline int __rhashtable_remove_fast(
 	struct bucket_table *tbl;
 	int err;
 
-	rcu_read_lock();
+	__rht_read_lock(params.prcu);
 
 	tbl = rht_dereference_rcu(ht->tbl, ht);
 
@@ -1101,7 +1180,7 @@ static inline int __rhashtable_remove_fast(
 	       (tbl = rht_dereference_rcu(tbl->future_tbl, ht)))
 		;
 
-	rcu_read_unlock();
+	__rht_read_unlock(params.prcu);
 
 	return err;
 }
@@ -1213,7 +1292,7 @@ static inline int rhashtable_replace_fast(
 	struct bucket_table *tbl;
 	int err;
 
-	rcu_read_lock();
+	__rht_read_lock(params.prcu);
 
 	tbl = rht_dereference_rcu(ht->tbl, ht);
 
@@ -1227,7 +1306,7 @@ static inline int rhashtable_replace_fast(
 	       (tbl = rht_dereference_rcu(tbl->future_tbl, ht)))
 		;
 
-	rcu_read_unlock();
+	__rht_read_unlock(params.prcu);
 
 	return err;
 }
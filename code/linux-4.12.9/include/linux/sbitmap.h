@@ -68,6 +68,8 @@ struct sbitmap {
 
 #define SBQ_WAIT_QUEUES 8
 #define SBQ_WAKE_BATCH 8
+#define SBQ_CACHE_SIZE 16
+#define SBQ_CACHE_BATCH (SBQ_CACHE_SIZE / 2)
 
 /**
  * struct sbq_wait_state - Wait queue in a &struct sbitmap_queue.
@@ -84,6 +86,24 @@ struct sbq_wait_state {
 	wait_queue_head_t wait;
 } ____cacheline_aligned_in_smp;
 
+/**
+ * struct sbq_cache - Per-cpu cache of free bits in a &struct sbitmap_queue.
+ *
+ * Bits in the cache are still set in the bitmap, they are only handed out
+ * without touching the shared words.
+ */
+struct sbq_cache {
+	/**
+	 * @nr: Number of cached bits.
+	 */
+	unsigned int nr;
+
+	/**
+	 * @bits: The cached bit numbers.
+	 */
+	unsigned int bits[SBQ_CACHE_SIZE];
+};
+
 /**
  * struct sbitmap_queue - Scalable bitmap with the added ability to wait on free
  * bits.
@@ -127,6 +147,12 @@ struct sbitmap_queue {
 	 * @round_robin: Allocate bits in strict round-robin order.
 	 */
 	bool round_robin;
+
+	/**
+	 * @cache: Optional per-cpu cache of free bits, see
+	 * sbitmap_queue_enable_cache().
+	 */
+	struct sbq_cache __percpu *cache;
 };
 
 /**
@@ -319,11 +345,31 @@ int sbitmap_queue_init_node(struct sbitmap_queue *sbq, unsigned int depth,
  */
 static inline void sbitmap_queue_free(struct sbitmap_queue *sbq)
 {
+	free_percpu(sbq->cache);
 	kfree(sbq->ws);
 	free_percpu(sbq->alloc_hint);
 	sbitmap_free(&sbq->sb);
 }
 
+/**
+ * sbitmap_queue_enable_cache() - Keep a small per-cpu cache of free bits in a
+ * &struct sbitmap_queue.
+ * @sbq: Bitmap queue to cache bits of.
+ * @flags: Allocation flags.
+ *
+ * With the cache enabled, __sbitmap_queue_get() refills the local cache with
+ * up to %SBQ_CACHE_BATCH bits per atomic operation, and sbitmap_queue_clear()
+ * returns bits to it without touching the bitmap unless somebody is waiting.
+ *
+ * Cached bits stay set in the bitmap, so this must not be used by callers
+ * which treat set bits as being in use, e.g. through sbitmap_for_each_set().
+ * The cache is bypassed while the depth is too small for every CPU to cache
+ * bits without starving the others.
+ *
+ * Return: Zero on success, -EINVAL for round-robin queues or -ENOMEM.
+ */
+int sbitmap_queue_enable_cache(struct sbitmap_queue *sbq, gfp_t flags);
+
 /**
  * sbitmap_queue_resize() - Resize a &struct sbitmap_queue.
  * @sbq: Bitmap queue to resize.
@@ -357,6 +403,24 @@ int __sbitmap_queue_get(struct sbitmap_queue *sbq);
 int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 				unsigned int shallow_depth);
 
+/**
+ * __sbitmap_queue_get_batch() - Try to allocate several free bits from a
+ * &struct sbitmap_queue with preemption already disabled.
+ * @sbq: Bitmap queue to allocate from.
+ * @nr_bits: Maximum number of bits to allocate.
+ * @offset: Output parameter; the bit number of bit 0 of the returned mask.
+ *
+ * All bits are taken from the same word with a single atomic operation, so
+ * fewer than @nr_bits may be returned even if more are free. Not supported
+ * for round-robin queues.
+ *
+ * Return: Mask of the allocated bits relative to @offset, 0 if none could be
+ * allocated.
+ */
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq,
+					unsigned int nr_bits,
+					unsigned int *offset);
+
 /**
  * sbitmap_queue_get() - Try to allocate a free bit from a &struct
  * sbitmap_queue.
@@ -410,6 +474,22 @@ static inline int sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu);
 
+/**
+ * sbitmap_queue_clear_batch() - Free several allocated bits and wake up
+ * waiters on a &struct sbitmap_queue.
+ * @sbq: Bitmap to free from.
+ * @bits: Bit numbers to free, preferably sorted.
+ * @nr_bits: Number of entries in @bits.
+ * @cpu: CPU the bits were allocated on.
+ *
+ * Neighbouring entries of @bits that fall into the same word are freed with a
+ * single atomic operation. The bits are always freed to the bitmap, even if
+ * the per-cpu cache is enabled.
+ */
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq,
+			       const unsigned int *bits, unsigned int nr_bits,
+			       unsigned int cpu);
+
 static inline int sbq_index_inc(int index)
 {
 	return (index + 1) & (SBQ_WAIT_QUEUES - 1);
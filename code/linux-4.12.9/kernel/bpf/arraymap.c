@@ -387,7 +387,10 @@ static void *prog_fd_array_get_ptr(struct bpf_map *map,
 	if (IS_ERR(prog))
 		return prog;
 
-	if (!bpf_prog_array_compatible(array, prog)) {
+	/* tail calls do not go through BPF_PROG_RUN(), so the callee
+	 * would run without the PRCU reader its maps require
+	 */
+	if (!bpf_prog_array_compatible(array, prog) || prog->prcu) {
 		bpf_prog_put(prog);
 		return ERR_PTR(-EINVAL);
 	}
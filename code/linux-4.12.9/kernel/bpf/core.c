@@ -1290,11 +1290,16 @@ struct bpf_prog *bpf_prog_select_runtime(struct bpf_prog *fp, int *err)
 }
 EXPORT_SYMBOL_GPL(bpf_prog_select_runtime);
 
+DEFINE_STATIC_KEY_FALSE(bpf_prog_prcu_key);
+EXPORT_SYMBOL_GPL(bpf_prog_prcu_key);
+
 static void bpf_prog_free_deferred(struct work_struct *work)
 {
 	struct bpf_prog_aux *aux;
 
 	aux = container_of(work, struct bpf_prog_aux, work);
+	if (aux->prog->prcu)
+		static_branch_dec(&bpf_prog_prcu_key);
 	bpf_jit_free(aux->prog);
 }
 
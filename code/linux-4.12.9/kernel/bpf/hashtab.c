@@ -14,6 +14,7 @@
 #include <linux/jhash.h>
 #include <linux/filter.h>
 #include <linux/rculist_nulls.h>
+#include <linux/prcu.h>
 #include "percpu_freelist.h"
 #include "bpf_lru_list.h"
 #include "map_in_map.h"
@@ -23,6 +24,20 @@ struct bucket {
 	raw_spinlock_t lock;
 };
 
+/* elements of a BPF_F_PRCU_RECLAIM map are freed in batches of this size */
+#define HTAB_ELEM_BATCH		64
+/* elem_batch_work flushes a partial per-CPU batch this long after it started */
+#define HTAB_ELEM_BATCH_DELAY	msecs_to_jiffies(10)
+
+struct htab_elem;
+
+struct htab_elem_batch {
+	struct rcu_head rcu;
+	struct bpf_htab *htab;
+	unsigned int cnt;
+	struct htab_elem *elems[HTAB_ELEM_BATCH];
+};
+
 struct bpf_htab {
 	struct bpf_map map;
 	struct bucket *buckets;
@@ -32,6 +47,8 @@ struct bpf_htab {
 		struct bpf_lru lru;
 	};
 	struct htab_elem *__percpu *extra_elems;
+	struct htab_elem_batch *__percpu *elem_batch;
+	struct delayed_work elem_batch_work;
 	atomic_t count;	/* number of elements in this hashtable */
 	u32 n_buckets;	/* number of hash buckets */
 	u32 elem_size;	/* size of each element in bytes */
@@ -58,6 +75,7 @@ struct htab_elem {
 };
 
 static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node);
+static void htab_elem_batch_work(struct work_struct *work);
 
 static bool htab_is_lru(const struct bpf_htab *htab)
 {
@@ -76,6 +94,11 @@ static bool htab_is_prealloc(const struct bpf_htab *htab)
 	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
 }
 
+static bool htab_is_prcu(const struct bpf_htab *htab)
+{
+	return htab->map.map_flags & BPF_F_PRCU_RECLAIM;
+}
+
 static inline void htab_elem_set_ptr(struct htab_elem *l, u32 key_size,
 				     void __percpu *pptr)
 {
@@ -233,6 +256,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	bool prcu = (attr->map_flags & BPF_F_PRCU_RECLAIM);
 	struct bpf_htab *htab;
 	int err, i;
 	u64 cost;
@@ -248,10 +272,15 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		 */
 		return ERR_PTR(-EPERM);
 
-	if (attr->map_flags & ~(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU))
+	if (attr->map_flags & ~(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU |
+				BPF_F_PRCU_RECLAIM))
 		/* reserved bits should not be used */
 		return ERR_PTR(-EINVAL);
 
+	if (prcu && prealloc)
+		/* preallocated elements are recycled, not reclaimed */
+		return ERR_PTR(-EINVAL);
+
 	if (!lru && percpu_lru)
 		return ERR_PTR(-EINVAL);
 
@@ -370,6 +399,14 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		}
 	}
 
+	if (prcu) {
+		err = -ENOMEM;
+		htab->elem_batch = alloc_percpu(struct htab_elem_batch *);
+		if (!htab->elem_batch)
+			goto free_buckets;
+		INIT_DELAYED_WORK(&htab->elem_batch_work, htab_elem_batch_work);
+	}
+
 	return &htab->map;
 
 free_prealloc:
@@ -615,6 +652,92 @@ static void htab_elem_free_rcu(struct rcu_head *head)
 	preempt_enable();
 }
 
+static void htab_elem_batch_free_rcu(struct rcu_head *head)
+{
+	struct htab_elem_batch *batch;
+	struct bpf_htab *htab;
+	unsigned int i;
+
+	batch = container_of(head, struct htab_elem_batch, rcu);
+	htab = batch->htab;
+
+	/* see htab_elem_free_rcu() */
+	preempt_disable();
+	__this_cpu_inc(bpf_prog_active);
+	if (htab->map.map_type == BPF_MAP_TYPE_PERCPU_HASH)
+		for (i = 0; i < batch->cnt; i++)
+			free_percpu(htab_elem_get_ptr(batch->elems[i],
+						      htab->map.key_size));
+	kfree_bulk(batch->cnt, (void **)batch->elems);
+	kfree(batch);
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable();
+}
+
+/* Called with irqs disabled, which serializes against htab_elem_batch_add() */
+static void htab_elem_batch_flush(void *info)
+{
+	struct bpf_htab *htab = info;
+	struct htab_elem_batch *batch;
+
+	batch = this_cpu_xchg(*htab->elem_batch, NULL);
+	if (batch)
+		call_prcu(&batch->rcu, htab_elem_batch_free_rcu);
+}
+
+static bool htab_elem_batch_pending(int cpu, void *info)
+{
+	struct bpf_htab *htab = info;
+
+	return READ_ONCE(*per_cpu_ptr(htab->elem_batch, cpu));
+}
+
+static void htab_elem_batch_flush_all(struct bpf_htab *htab)
+{
+	on_each_cpu_cond(htab_elem_batch_pending, htab_elem_batch_flush,
+			 htab, true, GFP_KERNEL);
+}
+
+static void htab_elem_batch_work(struct work_struct *work)
+{
+	struct bpf_htab *htab = container_of(to_delayed_work(work),
+					     struct bpf_htab, elem_batch_work);
+
+	htab_elem_batch_flush_all(htab);
+}
+
+/* Queue an element of a BPF_F_PRCU_RECLAIM map for freeing after a PRCU
+ * grace period.  One call_prcu() is issued per HTAB_ELEM_BATCH elements
+ * instead of one call_rcu() per element.
+ */
+static void htab_elem_batch_add(struct bpf_htab *htab, struct htab_elem *l)
+{
+	struct htab_elem_batch *batch;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	batch = this_cpu_read(*htab->elem_batch);
+	if (!batch) {
+		batch = kmalloc(sizeof(*batch), GFP_ATOMIC | __GFP_NOWARN);
+		if (unlikely(!batch)) {
+			local_irq_restore(flags);
+			l->htab = htab;
+			call_prcu(&l->rcu, htab_elem_free_rcu);
+			return;
+		}
+		batch->htab = htab;
+		batch->cnt = 0;
+		this_cpu_write(*htab->elem_batch, batch);
+		if (!delayed_work_pending(&htab->elem_batch_work))
+			schedule_delayed_work(&htab->elem_batch_work,
+					      HTAB_ELEM_BATCH_DELAY);
+	}
+	batch->elems[batch->cnt++] = l;
+	if (batch->cnt == HTAB_ELEM_BATCH)
+		htab_elem_batch_flush(htab);
+	local_irq_restore(flags);
+}
+
 static void free_htab_elem(struct bpf_htab *htab, struct htab_elem *l)
 {
 	struct bpf_map *map = &htab->map;
@@ -627,6 +750,9 @@ static void free_htab_elem(struct bpf_htab *htab, struct htab_elem *l)
 
 	if (htab_is_prealloc(htab)) {
 		pcpu_freelist_push(&htab->freelist, &l->fnode);
+	} else if (htab_is_prcu(htab)) {
+		atomic_dec(&htab->count);
+		htab_elem_batch_add(htab, l);
 	} else {
 		atomic_dec(&htab->count);
 		l->htab = htab;
@@ -1087,6 +1213,12 @@ static void htab_map_free(struct bpf_map *map)
 	 * not have executed. Wait for them.
 	 */
 	rcu_barrier();
+	if (htab_is_prcu(htab)) {
+		cancel_delayed_work_sync(&htab->elem_batch_work);
+		htab_elem_batch_flush_all(htab);
+		prcu_barrier();
+		free_percpu(htab->elem_batch);
+	}
 	if (!htab_is_prealloc(htab))
 		delete_all_elements(htab);
 	else
@@ -1153,7 +1285,7 @@ int bpf_percpu_hash_copy(struct bpf_map *map, void *key, void *value)
 	 * will not leak any kernel data
 	 */
 	size = round_up(map->value_size, 8);
-	rcu_read_lock();
+	bpf_map_read_lock(map);
 	l = __htab_map_lookup_elem(map, key);
 	if (!l)
 		goto out;
@@ -1167,7 +1299,7 @@ int bpf_percpu_hash_copy(struct bpf_map *map, void *key, void *value)
 	}
 	ret = 0;
 out:
-	rcu_read_unlock();
+	bpf_map_read_unlock(map);
 	return ret;
 }
 
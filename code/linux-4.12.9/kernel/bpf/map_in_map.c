@@ -28,6 +28,14 @@ struct bpf_map *bpf_map_meta_alloc(int inner_map_ufd)
 		return ERR_PTR(-ENOTSUPP);
 	}
 
+	/* Programs accessing inner maps are not known to the verifier
+	 * to need the PRCU reader of BPF_F_PRCU_RECLAIM maps.
+	 */
+	if (bpf_map_is_prcu(inner_map)) {
+		fdput(f);
+		return ERR_PTR(-ENOTSUPP);
+	}
+
 	/* Does not support >1 level map-in-map */
 	if (inner_map->inner_map_meta) {
 		fdput(f);
@@ -354,11 +354,11 @@ static int map_lookup_elem(union bpf_attr *attr)
 		   map->map_type == BPF_MAP_TYPE_HASH_OF_MAPS) {
 		err = -ENOTSUPP;
 	} else {
-		rcu_read_lock();
+		bpf_map_read_lock(map);
 		ptr = map->ops->map_lookup_elem(map, key);
 		if (ptr)
 			memcpy(value, ptr, value_size);
-		rcu_read_unlock();
+		bpf_map_read_unlock(map);
 		err = ptr ? 0 : -ENOENT;
 	}
 
@@ -553,9 +553,9 @@ static int map_get_next_key(union bpf_attr *attr)
 	if (!next_key)
 		goto free_key;
 
-	rcu_read_lock();
+	bpf_map_read_lock(map);
 	err = map->ops->map_get_next_key(map, key, next_key);
-	rcu_read_unlock();
+	bpf_map_read_unlock(map);
 	if (err)
 		goto free_next_key;
 
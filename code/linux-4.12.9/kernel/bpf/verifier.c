@@ -3296,6 +3296,14 @@ static int replace_map_fd_with_map_ptr(struct bpf_verifier_env *env)
 			}
 			env->used_maps[env->used_map_cnt++] = map;
 
+			/* elements of this map are only protected by PRCU,
+			 * see BPF_PROG_RUN()
+			 */
+			if (bpf_map_is_prcu(map) && !env->prog->prcu) {
+				env->prog->prcu = 1;
+				static_branch_inc(&bpf_prog_prcu_key);
+			}
+
 			fdput(f);
 next_insn:
 			insn++;
@@ -4045,7 +4045,9 @@ static struct cgroup_subsys_state *css_create(struct cgroup *cgrp,
 
 	init_and_link_css(css, ss, cgrp);
 
-	err = percpu_ref_init(&css->refcnt, css_release, 0, GFP_KERNEL);
+	/* whole hierarchies are usually torn down at once, batch the kills */
+	err = percpu_ref_init(&css->refcnt, css_release, PERCPU_REF_INIT_BATCH,
+			      GFP_KERNEL);
 	if (err)
 		goto err_free_css;
 
@@ -4098,7 +4100,8 @@ static struct cgroup *cgroup_create(struct cgroup *parent)
 	if (!cgrp)
 		return ERR_PTR(-ENOMEM);
 
-	ret = percpu_ref_init(&cgrp->self.refcnt, css_release, 0, GFP_KERNEL);
+	ret = percpu_ref_init(&cgrp->self.refcnt, css_release,
+			      PERCPU_REF_INIT_BATCH, GFP_KERNEL);
 	if (ret)
 		goto out_free_cgrp;
 
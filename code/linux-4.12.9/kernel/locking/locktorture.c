@@ -39,6 +39,8 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/percpu-rwsem.h>
+#include <linux/prcu.h>
+#include <linux/topology.h>
 #include <linux/torture.h>
 
 MODULE_LICENSE("GPL");
@@ -59,6 +61,8 @@ torture_param(int, stat_interval, 60,
 torture_param(int, stutter, 5, "Number of jiffies to run/halt test, 0=disable");
 torture_param(bool, verbose, true,
 	     "Enable verbose debugging printk()s");
+torture_param(bool, numa_stats, false,
+	     "Report write acquisitions per NUMA node");
 
 static char *torture_type = "spin_lock";
 module_param(torture_type, charp, 0444);
@@ -72,6 +76,9 @@ static struct task_struct **reader_tasks;
 static bool lock_is_write_held;
 static bool lock_is_read_held;
 
+/* Write acquisitions by CPU, summed per node when numa_stats is set. */
+static DEFINE_PER_CPU(long, lock_torture_cpu_writes);
+
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
@@ -98,6 +105,7 @@ struct lock_torture_ops {
 	void (*readunlock)(void);
 
 	unsigned long flags; /* for irq spinlocks */
+	bool concurrent_readers; /* readers do not exclude writers */
 	const char *name;
 };
 
@@ -109,6 +117,7 @@ struct lock_torture_cxt {
 	struct lock_torture_ops *cur_ops;
 	struct lock_stress_stats *lwsa; /* writer statistics */
 	struct lock_stress_stats *lrsa; /* reader statistics */
+	unsigned long start; /* jiffies when the kthreads were started */
 };
 static struct lock_torture_cxt cxt = { 0, 0, false,
 				       ATOMIC_INIT(0),
@@ -638,6 +647,166 @@ static struct lock_torture_ops percpu_rwsem_lock_ops = {
 	.name		= "percpu_rwsem_lock"
 };
 
+static struct percpu_rw_semaphore pcpu_rwsem_prcu;
+
+void torture_percpu_rwsem_prcu_init(void)
+{
+	BUG_ON(percpu_init_rwsem_prcu(&pcpu_rwsem_prcu));
+}
+
+static int torture_percpu_rwsem_prcu_down_write(void)
+__acquires(pcpu_rwsem_prcu)
+{
+	percpu_down_write(&pcpu_rwsem_prcu);
+	return 0;
+}
+
+static void torture_percpu_rwsem_prcu_up_write(void)
+__releases(pcpu_rwsem_prcu)
+{
+	percpu_up_write(&pcpu_rwsem_prcu);
+}
+
+static int torture_percpu_rwsem_prcu_down_read(void)
+__acquires(pcpu_rwsem_prcu)
+{
+	percpu_down_read_prcu(&pcpu_rwsem_prcu);
+	return 0;
+}
+
+static void torture_percpu_rwsem_prcu_up_read(void)
+__releases(pcpu_rwsem_prcu)
+{
+	percpu_up_read_prcu(&pcpu_rwsem_prcu);
+}
+
+static struct lock_torture_ops percpu_rwsem_prcu_lock_ops = {
+	.init		= torture_percpu_rwsem_prcu_init,
+	.writelock	= torture_percpu_rwsem_prcu_down_write,
+	.write_delay	= torture_rwsem_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_percpu_rwsem_prcu_up_write,
+	.readlock       = torture_percpu_rwsem_prcu_down_read,
+	.read_delay     = torture_rwsem_read_delay,
+	.readunlock     = torture_percpu_rwsem_prcu_up_read,
+	.name		= "percpu_rwsem_prcu_lock"
+};
+
+/*
+ * RCU and PRCU read-side critical sections paired with writers that
+ * publish the other element of a two-element ring and wait for a grace
+ * period before invalidating the old one.  Readers check that the element
+ * they picked up stays valid until they leave, so a reader that outlives
+ * a grace period is reported as a failure.  Writers exclude only each
+ * other, which makes their acquisition rate that of the update side,
+ * grace-period wait included.
+ */
+struct torture_rcu_elem {
+	int valid;
+};
+
+static struct torture_rcu_elem torture_rcu_elems[2];
+static struct torture_rcu_elem __rcu *torture_rcu_cur;
+static DEFINE_MUTEX(torture_rcu_mutex);
+
+static void torture_rcu_init(void)
+{
+	torture_rcu_elems[0].valid = 1;
+	torture_rcu_elems[1].valid = 0;
+	RCU_INIT_POINTER(torture_rcu_cur, &torture_rcu_elems[0]);
+}
+
+static int torture_rcu_write_lock(void) __acquires(torture_rcu_mutex)
+{
+	mutex_lock(&torture_rcu_mutex);
+	return 0;
+}
+
+static void torture_rcu_write_unlock_sync(void (*sync)(void))
+__releases(torture_rcu_mutex)
+{
+	struct torture_rcu_elem *old, *new;
+
+	old = rcu_dereference_protected(torture_rcu_cur,
+					lockdep_is_held(&torture_rcu_mutex));
+	new = old == &torture_rcu_elems[0] ? &torture_rcu_elems[1] :
+					     &torture_rcu_elems[0];
+	WRITE_ONCE(new->valid, 1);
+	rcu_assign_pointer(torture_rcu_cur, new);
+	sync();
+	WRITE_ONCE(old->valid, 0);
+	mutex_unlock(&torture_rcu_mutex);
+}
+
+static void torture_rcu_read_delay(struct torture_random_state *trsp)
+{
+	struct torture_rcu_elem *p;
+
+	p = rcu_dereference_check(torture_rcu_cur,
+				  rcu_read_lock_held() || prcu_read_lock_held());
+	torture_rwlock_read_delay(trsp);
+	if (WARN_ON_ONCE(!READ_ONCE(p->valid)))
+		atomic_inc(&cxt.n_lock_torture_errors);
+}
+
+static void torture_rcu_write_unlock(void) __releases(torture_rcu_mutex)
+{
+	torture_rcu_write_unlock_sync(synchronize_rcu);
+}
+
+static int torture_rcu_read_lock(void) __acquires(RCU)
+{
+	rcu_read_lock();
+	return 0;
+}
+
+static void torture_rcu_read_unlock(void) __releases(RCU)
+{
+	rcu_read_unlock();
+}
+
+static struct lock_torture_ops rcu_lock_ops = {
+	.init		= torture_rcu_init,
+	.writelock	= torture_rcu_write_lock,
+	.write_delay	= torture_rwlock_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_rcu_write_unlock,
+	.readlock       = torture_rcu_read_lock,
+	.read_delay     = torture_rcu_read_delay,
+	.readunlock     = torture_rcu_read_unlock,
+	.concurrent_readers = true,
+	.name		= "rcu_lock"
+};
+
+static void torture_prcu_write_unlock(void) __releases(torture_rcu_mutex)
+{
+	torture_rcu_write_unlock_sync(synchronize_prcu);
+}
+
+static int torture_prcu_read_lock(void) __acquires(PRCU)
+{
+	prcu_read_lock();
+	return 0;
+}
+
+static void torture_prcu_read_unlock(void) __releases(PRCU)
+{
+	prcu_read_unlock();
+}
+
+static struct lock_torture_ops prcu_lock_ops = {
+	.init		= torture_rcu_init,
+	.writelock	= torture_rcu_write_lock,
+	.write_delay	= torture_rwlock_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_prcu_write_unlock,
+	.readlock       = torture_prcu_read_lock,
+	.read_delay     = torture_rcu_read_delay,
+	.readunlock     = torture_prcu_read_unlock,
+	.concurrent_readers = true,
+	.name		= "prcu_lock"
+};
+
 /*
  * Lock torture writer kthread.  Repeatedly acquires and releases
  * the lock, checking for duplicate acquisitions.
@@ -659,10 +828,13 @@ static int lock_torture_writer(void *arg)
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lwsp->n_lock_fail++;
 		lock_is_write_held = 1;
-		if (WARN_ON_ONCE(lock_is_read_held))
+		if (!cxt.cur_ops->concurrent_readers &&
+		    WARN_ON_ONCE(lock_is_read_held))
 			lwsp->n_lock_fail++; /* rare, but... */
 
 		lwsp->n_lock_acquired++;
+		if (numa_stats)
+			this_cpu_inc(lock_torture_cpu_writes);
 		cxt.cur_ops->write_delay(&rand);
 		lock_is_write_held = 0;
 		cxt.cur_ops->writeunlock();
@@ -693,7 +865,8 @@ static int lock_torture_reader(void *arg)
 
 		cxt.cur_ops->readlock();
 		lock_is_read_held = 1;
-		if (WARN_ON_ONCE(lock_is_write_held))
+		if (!cxt.cur_ops->concurrent_readers &&
+		    WARN_ON_ONCE(lock_is_write_held))
 			lrsp->n_lock_fail++; /* rare, but... */
 
 		lrsp->n_lock_acquired++;
@@ -718,6 +891,7 @@ static void __torture_print_stats(char *page,
 	long max = 0;
 	long min = statp[0].n_lock_acquired;
 	long long sum = 0;
+	unsigned long secs;
 
 	n_stress = write ? cxt.nrealwriters_stress : cxt.nrealreaders_stress;
 	for (i = 0; i < n_stress; i++) {
@@ -729,15 +903,43 @@ static void __torture_print_stats(char *page,
 		if (min > statp[i].n_lock_fail)
 			min = statp[i].n_lock_fail;
 	}
+	secs = max_t(unsigned long, (jiffies - cxt.start) / HZ, 1);
 	page += sprintf(page,
-			"%s:  Total: %lld  Max/Min: %ld/%ld %s  Fail: %d %s\n",
+			"%s:  Total: %lld  Rate: %llu/s  Max/Min: %ld/%ld %s  Fail: %d %s\n",
 			write ? "Writes" : "Reads ",
-			sum, max, min, max / 2 > min ? "???" : "",
+			sum, div_u64(sum, secs), max, min,
+			max / 2 > min ? "???" : "",
 			fail, fail ? "!!!" : "");
 	if (fail)
 		atomic_inc(&cxt.n_lock_torture_errors);
 }
 
+/*
+ * Print write acquisitions per NUMA node, flagging runs where the most
+ * favoured node got more than twice the share of the least favoured one.
+ */
+static void lock_torture_numa_stats_print(void)
+{
+	long max = 0, min = LONG_MAX, sum;
+	int cpu, nid;
+
+	for_each_online_node(nid) {
+		if (cpumask_empty(cpumask_of_node(nid)))
+			continue;
+		sum = 0;
+		for_each_cpu(cpu, cpumask_of_node(nid))
+			sum += per_cpu(lock_torture_cpu_writes, cpu);
+		pr_alert("%s" TORTURE_FLAG " Node %d Writes: %ld\n",
+			 torture_type, nid, sum);
+		max = max(max, sum);
+		min = min(min, sum);
+	}
+	if (min == LONG_MAX)
+		return;
+	pr_alert("%s" TORTURE_FLAG " Node Max/Min: %ld/%ld %s\n",
+		 torture_type, max, min, max / 2 > min ? "???" : "");
+}
+
 /*
  * Print torture statistics.  Caller must ensure that there is only one
  * call to this function at a given time!!!  This is normally accomplished
@@ -765,6 +967,9 @@ static void lock_torture_stats_print(void)
 	pr_alert("%s", buf);
 	kfree(buf);
 
+	if (numa_stats)
+		lock_torture_numa_stats_print();
+
 	if (cxt.cur_ops->readlock) {
 		buf = kmalloc(size, GFP_KERNEL);
 		if (!buf) {
@@ -803,11 +1008,11 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d numa_stats=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
 		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
-		 onoff_interval, onoff_holdoff);
+		 onoff_interval, onoff_holdoff, numa_stats);
 }
 
 static void lock_torture_cleanup(void)
@@ -877,6 +1082,9 @@ static int __init lock_torture_init(void)
 #endif
 		&rwsem_lock_ops,
 		&percpu_rwsem_lock_ops,
+		&percpu_rwsem_prcu_lock_ops,
+		&rcu_lock_ops,
+		&prcu_lock_ops,
 	};
 
 	if (!torture_init_begin(torture_type, verbose, &torture_runnable))
@@ -933,6 +1141,8 @@ static int __init lock_torture_init(void)
 		cxt.lwsa[i].n_lock_fail = 0;
 		cxt.lwsa[i].n_lock_acquired = 0;
 	}
+	for_each_possible_cpu(i)
+		per_cpu(lock_torture_cpu_writes, i) = 0;
 
 	if (cxt.cur_ops->readlock) {
 		if (nreaders_stress >= 0)
@@ -1018,6 +1228,7 @@ static int __init lock_torture_init(void)
 	 * for very specific needs, or even let the user choose the policy, if
 	 * ever wanted.
 	 */
+	cxt.start = jiffies;
 	for (i = 0, j = 0; i < cxt.nrealwriters_stress ||
 		    j < cxt.nrealreaders_stress; i++, j++) {
 		if (i >= cxt.nrealwriters_stress)
@@ -42,6 +42,15 @@ do {									\
 	smp_store_release((l), 1)
 #endif
 
+#ifndef arch_mcs_pass_lock
+/*
+ * Like arch_mcs_spin_unlock_contended(), but hands @val rather than 1 to
+ * the next waiter, so that lock-specific state can travel with the lock.
+ */
+#define arch_mcs_pass_lock(l, val)					\
+	smp_store_release((l), (val))
+#endif
+
 /*
  * Note: the smp_load_acquire/smp_store_release pair is not
  * sufficient to form a full memory barrier across
@@ -7,22 +7,40 @@
 #include <linux/sched.h>
 #include <linux/errno.h>
 
-int __percpu_init_rwsem(struct percpu_rw_semaphore *sem,
-			const char *name, struct lock_class_key *rwsem_key)
+static int ___percpu_init_rwsem(struct percpu_rw_semaphore *sem,
+				const char *name, struct lock_class_key *rwsem_key,
+				enum rcu_sync_type type)
 {
 	sem->read_count = alloc_percpu(int);
 	if (unlikely(!sem->read_count))
 		return -ENOMEM;
 
 	/* ->rw_sem represents the whole percpu_rw_semaphore for lockdep */
-	rcu_sync_init(&sem->rss, RCU_SCHED_SYNC);
+	rcu_sync_init(&sem->rss, type);
 	__init_rwsem(&sem->rw_sem, name, rwsem_key);
 	rcuwait_init(&sem->writer);
 	sem->readers_block = 0;
 	return 0;
 }
+
+int __percpu_init_rwsem(struct percpu_rw_semaphore *sem,
+			const char *name, struct lock_class_key *rwsem_key)
+{
+	return ___percpu_init_rwsem(sem, name, rwsem_key, RCU_SCHED_SYNC);
+}
 EXPORT_SYMBOL_GPL(__percpu_init_rwsem);
 
+/*
+ * Readers of a semaphore initialized here must use the _prcu variants
+ * of percpu_down_read() and percpu_up_read().
+ */
+int __percpu_init_rwsem_prcu(struct percpu_rw_semaphore *sem,
+			     const char *name, struct lock_class_key *rwsem_key)
+{
+	return ___percpu_init_rwsem(sem, name, rwsem_key, RCU_PRCU_SYNC);
+}
+EXPORT_SYMBOL_GPL(__percpu_init_rwsem_prcu);
+
 void percpu_free_rwsem(struct percpu_rw_semaphore *sem)
 {
 	/*
@@ -183,9 +201,10 @@ void percpu_up_write(struct percpu_rw_semaphore *sem)
 	up_write(&sem->rw_sem);
 
 	/*
-	 * Once this completes (at least one RCU-sched grace period hence) the
-	 * reader fast path will be available again. Safe to use outside the
-	 * exclusive write lock because its counting.
+	 * Once this completes (at least one RCU-sched or PRCU grace period
+	 * hence, depending on the flavor of ->rss) the reader fast path will
+	 * be available again. Safe to use outside the exclusive write lock
+	 * because its counting.
 	 */
 	rcu_sync_exit(&sem->rss);
 }
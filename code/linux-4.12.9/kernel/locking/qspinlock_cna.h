@@ -0,0 +1,224 @@
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/init.h>
+#include <linux/topology.h>
+
+/*
+ * Implement a NUMA-aware version of MCS (aka CNA, or compact NUMA-aware lock).
+ *
+ * In CNA, spinning threads are organized in two queues, a primary queue for
+ * threads running on the same NUMA node as the current lock holder, and a
+ * secondary queue for threads running on other nodes.  Schematically, it
+ * looks like this:
+ *
+ *    cna_node
+ *   +----------+     +--------+         +--------+
+ *   |mcs:next  | --> |mcs:next| --> ... |mcs:next| --> NULL  [Primary queue]
+ *   |mcs:locked| -.  +--------+         +--------+
+ *   +----------+  |
+ *                 `----------------------.
+ *                                        v
+ *                 +--------+         +--------+
+ *                 |mcs:next| --> ... |mcs:next|            [Secondary queue]
+ *                 +--------+         +--------+
+ *                     ^                    |
+ *                     `--------------------'
+ *
+ * N.B. locked := 1 if secondary queue is absent. Otherwise, it contains the
+ * encoded pointer to the tail of the secondary queue, which is organized as a
+ * circular list.
+ *
+ * At unlock time, the lock holder scans the main queue looking for a thread
+ * running on the same node.  If found (call it thread T), all threads in the
+ * main queue between the current lock holder and T are moved to the end of
+ * the secondary queue.  If such T is not found, the lock is passed to the
+ * first node in the secondary queue, and the secondary queue is spliced in
+ * front of the main queue.  Finally, if the secondary queue is empty, the
+ * lock is passed to the next thread in the main queue.
+ *
+ * To keep remote waiters from starving, the lock is passed within a node at
+ * most numa_spinlock_threshold times in a row; after that the secondary
+ * queue is spliced back in front of the main queue.
+ *
+ * For more details, see https://arxiv.org/abs/1810.05600.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	struct mcs_spinlock	__res[3];
+
+	int			numa_node;
+	u32			encoded_tail;	/* self */
+	u32			intra_count;	/* consecutive local hand-offs */
+};
+
+/* Whether to switch to the NUMA-aware slowpath at boot, see below. */
+static bool numa_spinlock_enabled __initdata;
+
+/*
+ * Maximum number of consecutive hand-offs between waiters on the same node.
+ * Larger values favour throughput over fairness to waiters on other nodes.
+ */
+static unsigned int numa_spinlock_threshold __read_mostly = 1 << 16;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!strcmp(str, "on")) {
+		numa_spinlock_enabled = true;
+		return 0;
+	}
+	if (!strcmp(str, "off")) {
+		numa_spinlock_enabled = false;
+		return 0;
+	}
+	return -EINVAL;
+}
+early_param("numa_spinlock", numa_spinlock_setup);
+
+static int __init numa_spinlock_threshold_setup(char *str)
+{
+	unsigned int threshold;
+
+	if (kstrtouint(str, 0, &threshold) || !threshold)
+		return -EINVAL;
+	numa_spinlock_threshold = threshold;
+	return 0;
+}
+early_param("numa_spinlock_threshold", numa_spinlock_threshold_setup);
+
+static void cna_init_node(struct mcs_spinlock *node)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+
+	BUILD_BUG_ON(sizeof(struct cna_node) > 5*sizeof(struct mcs_spinlock));
+
+	cn->numa_node = numa_node_id();
+	cn->encoded_tail = encode_tail(smp_processor_id(),
+				       node - this_cpu_ptr(&mcs_nodes[0]));
+	cn->intra_count = 0;
+}
+
+/*
+ * Look for a waiter on the same node as @cn, starting at @next.  Waiters
+ * skipped on the way are moved to the end of the secondary queue, whose
+ * tail is updated in @sec_tail.  Returns NULL, leaving both queues
+ * untouched, if no such waiter is found before the tail of the main queue.
+ */
+static struct mcs_spinlock *cna_find_local(struct cna_node *cn,
+					   struct mcs_spinlock *next,
+					   struct mcs_spinlock **sec_tail)
+{
+	struct mcs_spinlock *cur = next, *last = NULL, *nxt;
+	int nid = cn->numa_node;
+
+	while (((struct cna_node *)cur)->numa_node != nid) {
+		/*
+		 * The tail of the main queue can not be moved since the lock
+		 * word still points to it.
+		 */
+		nxt = READ_ONCE(cur->next);
+		if (!nxt)
+			return NULL;
+		last = cur;
+		cur = nxt;
+	}
+
+	if (last) {
+		/* Move next..last to the end of the (circular) secondary queue. */
+		if (*sec_tail) {
+			WRITE_ONCE(last->next, READ_ONCE((*sec_tail)->next));
+			WRITE_ONCE((*sec_tail)->next, next);
+		} else {
+			WRITE_ONCE(last->next, next);
+		}
+		*sec_tail = last;
+	}
+	return cur;
+}
+
+static void cna_pass_lock(struct mcs_spinlock *node, struct mcs_spinlock *next)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+	struct mcs_spinlock *sec_tail = NULL, *succ = NULL;
+	u32 sec = node->locked;
+	u32 val = 1, intra = 0;
+
+	if (sec > 1)
+		sec_tail = decode_tail(sec);
+
+	if (cn->intra_count < numa_spinlock_threshold)
+		succ = cna_find_local(cn, next, &sec_tail);
+
+	if (succ) {
+		/* Keep the lock on this node; the secondary queue goes along. */
+		intra = cn->intra_count + 1;
+		if (sec_tail)
+			val = ((struct cna_node *)sec_tail)->encoded_tail;
+	} else if (sec_tail) {
+		/* Splice the secondary queue in front of the main queue. */
+		succ = READ_ONCE(sec_tail->next);
+		WRITE_ONCE(sec_tail->next, next);
+	} else {
+		succ = next;
+	}
+
+	((struct cna_node *)succ)->intra_count = intra;
+	arch_mcs_pass_lock(&succ->locked, val);
+}
+
+/*
+ * Called when @node is the only waiter in the main queue.  If there is a
+ * secondary queue, it becomes the main queue instead of leaving the queue
+ * empty.
+ */
+static u32 cna_try_clear_tail(struct qspinlock *lock, u32 val,
+			      struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *sec_tail, *sec_head;
+	u32 sec = node->locked;
+	u32 old;
+
+	if (sec <= 1)
+		return atomic_cmpxchg_relaxed(&lock->val, val, _Q_LOCKED_VAL);
+
+	sec_tail = decode_tail(sec);
+	sec_head = READ_ONCE(sec_tail->next);
+
+	/*
+	 * Break the cycle before publishing the secondary tail; the RELEASE
+	 * orders it before the next waiter's link to it.
+	 */
+	WRITE_ONCE(sec_tail->next, NULL);
+	old = atomic_cmpxchg_release(&lock->val, val, sec | _Q_LOCKED_VAL);
+	if (old == val) {
+		((struct cna_node *)sec_head)->intra_count = 0;
+		arch_mcs_pass_lock(&sec_head->locked, 1);
+		return old;
+	}
+
+	/* A new waiter queued behind us; restore the cycle. */
+	WRITE_ONCE(sec_tail->next, sec_head);
+	return old;
+}
+
+/*
+ * Switch to the NUMA-aware slowpath if requested on the command line and
+ * we are running on bare metal with more than one node.
+ */
+void __init cna_configure_spin_lock_slowpath(void)
+{
+	if (!numa_spinlock_enabled)
+		return;
+
+	if (nr_node_ids < 2 ||
+	    pv_lock_ops.queued_spin_lock_slowpath !=
+	    native_queued_spin_lock_slowpath)
+		return;
+
+	pv_lock_ops.queued_spin_lock_slowpath = __cna_queued_spin_lock_slowpath;
+
+	pr_info("Enabling CNA spinlock, threshold %u\n",
+		numa_spinlock_threshold);
+}
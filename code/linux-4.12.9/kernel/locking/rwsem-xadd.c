@@ -19,6 +19,13 @@
 #include <linux/osq_lock.h>
 
 #include "rwsem.h"
+#include "rwsem_stat.h"
+
+/*
+ * How long (in jiffies) the first waiting writer lets spinning writers
+ * steal the lock from under it before asking for a handoff, about 4ms.
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
 
 /*
  * Guide to the rw_semaphore's count field for common values.
@@ -87,6 +94,7 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	INIT_LIST_HEAD(&sem->wait_list);
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	sem->owner = NULL;
+	sem->handoff = false;
 	osq_lock_init(&sem->osq);
 #endif
 }
@@ -102,6 +110,8 @@ struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
 	enum rwsem_waiter_type type;
+	unsigned long timeout;		/* writers only, in jiffies */
+	bool handoff;			/* writers only, set sem->handoff */
 };
 
 enum rwsem_wake_type {
@@ -218,84 +228,6 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 		atomic_long_add(adjustment, &sem->count);
 }
 
-/*
- * Wait for the read lock to be granted
- */
-__visible
-struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
-{
-	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
-	struct rwsem_waiter waiter;
-	DEFINE_WAKE_Q(wake_q);
-
-	waiter.task = current;
-	waiter.type = RWSEM_WAITING_FOR_READ;
-
-	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
-		adjustment += RWSEM_WAITING_BIAS;
-	list_add_tail(&waiter.list, &sem->wait_list);
-
-	/* we're now waiting on the lock, but no longer actively locking */
-	count = atomic_long_add_return(adjustment, &sem->count);
-
-	/*
-	 * If there are no active locks, wake the front queued process(es).
-	 *
-	 * If there are no writers and we are first in the queue,
-	 * wake our own waiter to join the existing active readers !
-	 */
-	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
-		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
-
-	raw_spin_unlock_irq(&sem->wait_lock);
-	wake_up_q(&wake_q);
-
-	/* wait to be given the lock */
-	while (true) {
-		set_current_state(TASK_UNINTERRUPTIBLE);
-		if (!waiter.task)
-			break;
-		schedule();
-	}
-
-	__set_current_state(TASK_RUNNING);
-	return sem;
-}
-EXPORT_SYMBOL(rwsem_down_read_failed);
-
-/*
- * This function must be called with the sem->wait_lock held to prevent
- * race conditions between checking the rwsem wait list and setting the
- * sem->count accordingly.
- */
-static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
-{
-	/*
-	 * Avoid trying to acquire write lock if count isn't RWSEM_WAITING_BIAS.
-	 */
-	if (count != RWSEM_WAITING_BIAS)
-		return false;
-
-	/*
-	 * Acquire the lock by trying to set it to ACTIVE_WRITE_BIAS. If there
-	 * are other tasks on the wait list, we need to add on WAITING_BIAS.
-	 */
-	count = list_is_singular(&sem->wait_list) ?
-			RWSEM_ACTIVE_WRITE_BIAS :
-			RWSEM_ACTIVE_WRITE_BIAS + RWSEM_WAITING_BIAS;
-
-	if (atomic_long_cmpxchg_acquire(&sem->count, RWSEM_WAITING_BIAS, count)
-							== RWSEM_WAITING_BIAS) {
-		rwsem_set_owner(sem);
-		return true;
-	}
-
-	return false;
-}
-
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 /*
  * Try to acquire write lock before the writer has been put on wait queue.
@@ -308,6 +240,10 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
 			return false;
 
+		/* a waiter has waited for too long, don't steal from it */
+		if (count == RWSEM_WAITING_BIAS && READ_ONCE(sem->handoff))
+			return false;
+
 		old = atomic_long_cmpxchg_acquire(&sem->count, count,
 				      count + RWSEM_ACTIVE_WRITE_BIAS);
 		if (old == count) {
@@ -417,6 +353,13 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 			break;
 		}
 
+		/*
+		 * The lock has been handed off to the first waiter, queue up
+		 * behind it instead of spinning.
+		 */
+		if (READ_ONCE(sem->handoff))
+			break;
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
@@ -448,6 +391,67 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 	return osq_is_locked(&sem->osq);
 }
 
+/*
+ * Readers don't queue on the osq: each one already holds its read bias
+ * and only waits for a running writer to go away.  As long as nobody is
+ * queued, the read lock is ours as soon as the count turns positive,
+ * which is exactly the fast path condition of __down_read().
+ *
+ * Spinning stops as soon as someone is queued on the wait list, so that
+ * spinning readers never overtake a waiting writer.
+ */
+static bool rwsem_optimistic_spin_read(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	bool taken = false;
+
+	preempt_disable();
+	rcu_read_lock();
+	while (true) {
+		if (atomic_long_read(&sem->count) > 0) {
+			/* ACQUIRE for the read lock, pairs with up_write() */
+			smp_acquire__after_ctrl_dep();
+			taken = true;
+			break;
+		}
+
+		if (!list_empty(&sem->wait_list) || need_resched())
+			break;
+
+		owner = READ_ONCE(sem->owner);
+		if (rwsem_owner_is_writer(owner)) {
+			/*
+			 * The rcu_read_lock() keeps the task_struct valid,
+			 * see rwsem_spin_on_owner().
+			 */
+			if (!owner->on_cpu || vcpu_is_preempted(task_cpu(owner)))
+				break;
+		} else if (rt_task(current)) {
+			/*
+			 * The writer may have been preempted before setting
+			 * the owner field, don't live-lock it.
+			 */
+			break;
+		}
+
+		cpu_relax();
+	}
+	rcu_read_unlock();
+	preempt_enable();
+
+	return taken;
+}
+
+static inline bool rwsem_handoff(struct rw_semaphore *sem)
+{
+	return sem->handoff;
+}
+
+static inline void rwsem_set_handoff(struct rw_semaphore *sem, bool handoff)
+{
+	WRITE_ONCE(sem->handoff, handoff);
+}
+
 #else
 static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 {
@@ -458,8 +462,157 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 {
 	return false;
 }
+
+static inline bool rwsem_optimistic_spin_read(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+/* Without optimistic spinning the lock can't be stolen from the waiters. */
+static inline bool rwsem_handoff(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline void rwsem_set_handoff(struct rw_semaphore *sem, bool handoff)
+{
+}
 #endif
 
+/*
+ * Wait for the read lock to be granted
+ */
+__visible
+struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
+{
+	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	struct rwsem_waiter waiter;
+	DEFINE_WAKE_Q(wake_q);
+	u64 start;
+
+	/* keep our read bias and spin while a running writer holds the lock */
+	if (rwsem_optimistic_spin_read(sem)) {
+		rwstat_inc(rwstat_rlock_spin);
+		return sem;
+	}
+
+	start = rwstat_clock();
+	waiter.task = current;
+	waiter.type = RWSEM_WAITING_FOR_READ;
+
+	raw_spin_lock_irq(&sem->wait_lock);
+	if (list_empty(&sem->wait_list))
+		adjustment += RWSEM_WAITING_BIAS;
+	list_add_tail(&waiter.list, &sem->wait_list);
+
+	/* we're now waiting on the lock, but no longer actively locking */
+	count = atomic_long_add_return(adjustment, &sem->count);
+
+	/*
+	 * If there are no active locks, wake the front queued process(es).
+	 *
+	 * If there are no writers and we are first in the queue,
+	 * wake our own waiter to join the existing active readers !
+	 */
+	if (count == RWSEM_WAITING_BIAS ||
+	    (count > RWSEM_WAITING_BIAS &&
+	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
+		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
+
+	raw_spin_unlock_irq(&sem->wait_lock);
+	wake_up_q(&wake_q);
+
+	/* wait to be given the lock */
+	while (true) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		if (!waiter.task)
+			break;
+		schedule();
+	}
+
+	__set_current_state(TASK_RUNNING);
+	rwstat_slept(rwstat_rlock_sleep, start);
+	return sem;
+}
+EXPORT_SYMBOL(rwsem_down_read_failed);
+
+/*
+ * This function must be called with the sem->wait_lock held to prevent
+ * race conditions between checking the rwsem wait list and setting the
+ * sem->count accordingly.
+ */
+static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem,
+					struct rwsem_waiter *waiter)
+{
+	/*
+	 * Avoid trying to acquire write lock if count isn't RWSEM_WAITING_BIAS.
+	 */
+	if (count != RWSEM_WAITING_BIAS)
+		return false;
+
+	/*
+	 * Once the first waiter has asked for a handoff, the lock is reserved
+	 * for it.
+	 */
+	if (rwsem_handoff(sem) &&
+	    list_first_entry(&sem->wait_list, struct rwsem_waiter, list) != waiter)
+		return false;
+
+	/*
+	 * Acquire the lock by trying to set it to ACTIVE_WRITE_BIAS. If there
+	 * are other tasks on the wait list, we need to add on WAITING_BIAS.
+	 */
+	count = list_is_singular(&sem->wait_list) ?
+			RWSEM_ACTIVE_WRITE_BIAS :
+			RWSEM_ACTIVE_WRITE_BIAS + RWSEM_WAITING_BIAS;
+
+	if (atomic_long_cmpxchg_acquire(&sem->count, RWSEM_WAITING_BIAS, count)
+							== RWSEM_WAITING_BIAS) {
+		rwsem_set_owner(sem);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Whether a queued writer has waited long enough to ask for a handoff.
+ */
+static inline bool rwsem_handoff_due(struct rwsem_waiter *waiter)
+{
+	return IS_ENABLED(CONFIG_RWSEM_SPIN_ON_OWNER) && !waiter->handoff &&
+	       time_after(jiffies, waiter->timeout);
+}
+
+/*
+ * Called with the wait_lock held by a queued writer which failed to get
+ * the lock.
+ *
+ * The first waiter asks for a handoff once it has waited longer than
+ * RWSEM_WAIT_TIMEOUT, bounding the time spinning writers can keep the
+ * lock away from the wait queue.  The others make sure that a free lock
+ * reserved for the first waiter isn't left unnoticed: a spinner which
+ * backed off because of the handoff doesn't take the lock, so whoever
+ * skipped the wakeup in rwsem_wake() because of it has to be covered.
+ */
+static void rwsem_check_handoff(struct rw_semaphore *sem, long count,
+				struct rwsem_waiter *waiter,
+				struct wake_q_head *wake_q)
+{
+	struct rwsem_waiter *first;
+
+	first = list_first_entry(&sem->wait_list, struct rwsem_waiter, list);
+	if (first == waiter) {
+		if (rwsem_handoff_due(waiter)) {
+			waiter->handoff = true;
+			rwsem_set_handoff(sem, true);
+			rwstat_inc(rwstat_wlock_handoff);
+		}
+	} else if (rwsem_handoff(sem) && count == RWSEM_WAITING_BIAS) {
+		wake_q_add(wake_q, first->task);
+	}
+}
+
 /*
  * Wait until we successfully acquire the write lock
  */
@@ -471,20 +624,26 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	struct rwsem_waiter waiter;
 	struct rw_semaphore *ret = sem;
 	DEFINE_WAKE_Q(wake_q);
+	u64 start;
 
 	/* undo write bias from down_write operation, stop active locking */
 	count = atomic_long_sub_return(RWSEM_ACTIVE_WRITE_BIAS, &sem->count);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem)) {
+		rwstat_inc(rwstat_wlock_spin);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
 	 * and block until we can acquire the sem.
 	 */
+	start = rwstat_clock();
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
+	waiter.handoff = false;
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -526,24 +685,34 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	/* wait until we successfully acquire the lock */
 	set_current_state(state);
 	while (true) {
-		if (rwsem_try_write_lock(count, sem))
+		if (rwsem_try_write_lock(count, sem, &waiter))
 			break;
+		rwsem_check_handoff(sem, count, &waiter, &wake_q);
 		raw_spin_unlock_irq(&sem->wait_lock);
+		wake_up_q(&wake_q);
+		wake_q_init(&wake_q);
 
-		/* Block until there are no active lockers. */
+		/*
+		 * Block until there are no active lockers, or until it is
+		 * time to ask for a handoff while the lock keeps being stolen.
+		 */
 		do {
 			if (signal_pending_state(state, current))
 				goto out_nolock;
 
 			schedule();
 			set_current_state(state);
-		} while ((count = atomic_long_read(&sem->count)) & RWSEM_ACTIVE_MASK);
+		} while (((count = atomic_long_read(&sem->count)) &
+			  RWSEM_ACTIVE_MASK) && !rwsem_handoff_due(&waiter));
 
 		raw_spin_lock_irq(&sem->wait_lock);
 	}
 	__set_current_state(TASK_RUNNING);
 	list_del(&waiter.list);
+	if (waiter.handoff)
+		rwsem_set_handoff(sem, false);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	rwstat_slept(rwstat_wlock_sleep, start);
 
 	return ret;
 
@@ -551,6 +720,8 @@ out_nolock:
 	__set_current_state(TASK_RUNNING);
 	raw_spin_lock_irq(&sem->wait_lock);
 	list_del(&waiter.list);
+	if (waiter.handoff)
+		rwsem_set_handoff(sem, false);
 	if (list_empty(&sem->wait_list))
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
 	else
@@ -0,0 +1,187 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * /proc/lock_stat already reports the contention and wait time of each
+ * rwsem class, but it can not tell how the lock was eventually obtained.
+ * With CONFIG_LOCK_STAT the rwsem slowpaths additionally keep the
+ * following counters, reported through debugfs:
+ *
+ * <debugfs>/rwsem_stat/
+ *   rlock_spin		- # of read locks acquired by optimistic spinning
+ *   rlock_sleep	- # of read locks acquired after sleeping
+ *   rlock_wait		- average time (ns) slept by readers
+ *   wlock_spin		- # of write locks acquired by optimistic spinning
+ *   wlock_sleep	- # of write locks acquired after sleeping
+ *   wlock_wait		- average time (ns) slept by writers
+ *   wlock_handoff	- # of times a waiting writer stopped lock stealing
+ *
+ * Writing to the "reset_counters" file will reset all the above counter
+ * values.
+ *
+ * As with the qspinlock statistics, the counters are per-cpu variables
+ * which are only summed when read.
+ */
+enum rwsem_stats {
+	rwstat_rlock_spin,
+	rwstat_rlock_sleep,
+	rwstat_rlock_wait,
+	rwstat_wlock_spin,
+	rwstat_wlock_sleep,
+	rwstat_wlock_wait,
+	rwstat_wlock_handoff,
+	rwstat_num,	/* Total number of statistical counters */
+	rwstat_reset_cnts = rwstat_num,
+};
+
+#ifdef CONFIG_LOCK_STAT
+#include <linux/debugfs.h>
+#include <linux/sched/clock.h>
+#include <linux/fs.h>
+
+static const char * const rwstat_names[rwstat_num + 1] = {
+	[rwstat_rlock_spin]	= "rlock_spin",
+	[rwstat_rlock_sleep]	= "rlock_sleep",
+	[rwstat_rlock_wait]	= "rlock_wait",
+	[rwstat_wlock_spin]	= "wlock_spin",
+	[rwstat_wlock_sleep]	= "wlock_sleep",
+	[rwstat_wlock_wait]	= "wlock_wait",
+	[rwstat_wlock_handoff]	= "wlock_handoff",
+	[rwstat_reset_cnts]	= "reset_counters",
+};
+
+/*
+ * Per-cpu counters
+ */
+static DEFINE_PER_CPU(unsigned long, rwstats[rwstat_num]);
+
+/*
+ * The wait time counters are reported as an average over the number of
+ * sleeping acquisitions of the same kind.
+ */
+static ssize_t rwstat_read(struct file *file, char __user *user_buf,
+			   size_t count, loff_t *ppos)
+{
+	char buf[64];
+	int cpu, counter, len;
+	u64 stat = 0, nr = 0;
+
+	counter = (long)file_inode(file)->i_private;
+
+	if (counter >= rwstat_num)
+		return -EBADF;
+
+	for_each_possible_cpu(cpu) {
+		stat += per_cpu(rwstats[counter], cpu);
+
+		switch (counter) {
+		case rwstat_rlock_wait:
+			nr += per_cpu(rwstats[rwstat_rlock_sleep], cpu);
+			break;
+
+		case rwstat_wlock_wait:
+			nr += per_cpu(rwstats[rwstat_wlock_sleep], cpu);
+			break;
+		}
+	}
+
+	if ((counter == rwstat_rlock_wait || counter == rwstat_wlock_wait) &&
+	    nr)
+		stat = DIV_ROUND_CLOSEST_ULL(stat, nr);
+
+	len = snprintf(buf, sizeof(buf) - 1, "%llu\n", stat);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+/*
+ * Writing to reset_counters clears all the counters, see qstat_write()
+ * for why this is done without any synchronization.
+ */
+static ssize_t rwstat_write(struct file *file, const char __user *user_buf,
+			    size_t count, loff_t *ppos)
+{
+	int cpu;
+
+	if ((long)file_inode(file)->i_private != rwstat_reset_cnts)
+		return count;
+
+	for_each_possible_cpu(cpu) {
+		int i;
+		unsigned long *ptr = per_cpu_ptr(rwstats, cpu);
+
+		for (i = 0 ; i < rwstat_num; i++)
+			WRITE_ONCE(ptr[i], 0);
+	}
+	return count;
+}
+
+static const struct file_operations fops_rwstat = {
+	.read = rwstat_read,
+	.write = rwstat_write,
+	.llseek = default_llseek,
+};
+
+static int __init init_rwsem_stat(void)
+{
+	struct dentry *d_rwstat = debugfs_create_dir("rwsem_stat", NULL);
+	int i;
+
+	if (!d_rwstat)
+		goto out;
+
+	for (i = 0; i < rwstat_num; i++)
+		if (!debugfs_create_file(rwstat_names[i], 0400, d_rwstat,
+					 (void *)(long)i, &fops_rwstat))
+			goto fail_undo;
+
+	if (!debugfs_create_file(rwstat_names[rwstat_reset_cnts], 0200,
+				 d_rwstat, (void *)(long)rwstat_reset_cnts,
+				 &fops_rwstat))
+		goto fail_undo;
+
+	return 0;
+fail_undo:
+	debugfs_remove_recursive(d_rwstat);
+out:
+	pr_warn("Could not create 'rwsem_stat' debugfs entries\n");
+	return -ENOMEM;
+}
+fs_initcall(init_rwsem_stat);
+
+static inline void rwstat_inc(enum rwsem_stats stat)
+{
+	this_cpu_inc(rwstats[stat]);
+}
+
+static inline u64 rwstat_clock(void)
+{
+	return local_clock();
+}
+
+/*
+ * Account a sleeping acquisition that started waiting at @start.  @stat is
+ * one of the *_sleep counters, the matching *_wait counter follows it.
+ */
+static inline void rwstat_slept(enum rwsem_stats stat, u64 start)
+{
+	this_cpu_inc(rwstats[stat]);
+	this_cpu_add(rwstats[stat + 1], local_clock() - start);
+}
+
+#else /* CONFIG_LOCK_STAT */
+
+static inline void rwstat_inc(enum rwsem_stats stat)		{ }
+static inline u64 rwstat_clock(void)				{ return 0; }
+static inline void rwstat_slept(enum rwsem_stats stat, u64 start) { }
+
+#endif /* CONFIG_LOCK_STAT */
@@ -22,6 +22,9 @@
 #include <linux/interrupt.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
 #include <asm/barrier.h>
 
 #include "rcu.h"
@@ -59,8 +62,22 @@ static void prcu_cblist_init(struct prcu_cblist *rclp)
 }
 
 /*
- * Dequeue the oldest rcu_head structure from the specified callback list.
- * Store the callback version number into the version pointer.
+ * Enqueue an rcu_head structure and its callback version
+ * onto the specified callback list.
+ */
+static void prcu_cblist_enqueue(struct prcu_cblist *rclp, struct rcu_head *rhp,
+                                struct prcu_version_head *vhp)
+{
+       rclp->len++;
+       *rclp->tail = rhp;
+       rclp->tail = &rhp->next;
+       *rclp->version_tail = vhp;
+       rclp->version_tail = &vhp->next;
+}
+
+/*
+ * Dequeue the oldest rcu_head structure from the specified callback list,
+ * freeing its version structure.
  */
 static struct rcu_head *prcu_cblist_dequeue(struct prcu_cblist *rclp)
 {
@@ -69,7 +86,7 @@ static struct rcu_head *prcu_cblist_dequeue(struct prcu_cblist *rclp)
 
        rhp = rclp->head;
        if (!rhp) {
-               WARN_ON(vhp);
+               WARN_ON(rclp->version_head);
                WARN_ON(rclp->len);
                return NULL;
        }
@@ -78,6 +95,7 @@ static struct rcu_head *prcu_cblist_dequeue(struct prcu_cblist *rclp)
        rclp->version_head = vhp->next;
        rclp->head = rhp->next;
        rclp->len--;
+       kfree(vhp);
 
        if (!rclp->head) {
                rclp->tail = &rclp->head;
@@ -103,12 +121,45 @@ static inline void prcu_report(struct prcu_local_struct *local)
                cmpxchg(&local->version, local_version, global_version);
 }
 
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+static struct lock_class_key prcu_lock_key;
+struct lockdep_map prcu_lock_map =
+       STATIC_LOCKDEP_MAP_INIT("prcu_read_lock", &prcu_lock_key);
+EXPORT_SYMBOL_GPL(prcu_lock_map);
+
+/**
+ * prcu_read_lock_held() - might we be in PRCU read-side critical section?
+ *
+ * If CONFIG_DEBUG_LOCK_ALLOC is selected, returns nonzero iff in a PRCU
+ * read-side critical section.  In absence of CONFIG_DEBUG_LOCK_ALLOC,
+ * this assumes we are in a PRCU read-side critical section unless it can
+ * prove otherwise.
+ *
+ * Unlike rcu_read_lock_held(), idle and offline CPUs need not be checked:
+ * synchronize_prcu() interrupts any CPU that has PRCU readers, whatever
+ * RCU thinks of it.
+ */
+int prcu_read_lock_held(void)
+{
+       if (!debug_lockdep_rcu_enabled())
+               return 1;
+       return lock_is_held(&prcu_lock_map);
+}
+EXPORT_SYMBOL_GPL(prcu_read_lock_held);
+#endif /* #ifdef CONFIG_DEBUG_LOCK_ALLOC */
+
 /*
  * Mark the beginning of a PRCU read-side critical section.
  *
  * A PRCU quiescent state of a CPU is when its local ->locked and
  * ->online variables become 0.
  *
+ * This may be called from any context, including hardirq and NMI
+ * handlers: ->locked is only ever modified by single per-CPU
+ * read-modify-write operations, so a reader interrupting another reader
+ * on the same CPU cannot lose an update.  Interrupting readers always
+ * leave ->locked as they found it.
+ *
  * See prcu_read_unlock() and synchronize_prcu() for more information.
  * Also see rcu_read_lock() comment header.
  */
@@ -117,7 +168,7 @@ void prcu_read_lock(void)
        struct prcu_local_struct *local;
 
        local = get_cpu_ptr(&prcu_local);
-       if (!local->online) {
+       if (!READ_ONCE(local->online)) {
                WRITE_ONCE(local->online, 1);
                /*
                 * Memory barrier is needed for PRCU writers
@@ -125,12 +176,13 @@ void prcu_read_lock(void)
                 */
                smp_mb();
        }
-       local->locked++;
+       this_cpu_inc(prcu_local.locked);
        /*
         * Critical section after entry code.
         * put_cpu_ptr() provides the needed barrier().
         */
        put_cpu_ptr(&prcu_local);
+       rcu_lock_acquire(&prcu_lock_map);
 }
 EXPORT_SYMBOL(prcu_read_lock);
 
@@ -142,22 +194,30 @@ EXPORT_SYMBOL(prcu_read_lock);
  */
 void prcu_read_unlock(void)
 {
-       int locked;
        struct prcu_local_struct *local;
 
+       rcu_lock_release(&prcu_lock_map);
        barrier(); /* Critical section before exit code. */
        local = get_cpu_ptr(&prcu_local);
-       locked = local->locked;
-       if (locked) {
-               local->locked--;
+       /*
+        * Interrupting readers cannot change ->locked under us, and
+        * preemption is disabled, so it cannot be moved to ->active_ctr
+        * between this check and the decrement either.
+        */
+       if (READ_ONCE(local->locked)) {
                /*
                 * If we are executing the last PRCU task,
                 * update the CPU-local PRCU state.
                 */
-               if (locked == 1)
+               if (!this_cpu_dec_return(prcu_local.locked))
                        prcu_report(local);
                put_cpu_ptr(&prcu_local);
        } else {
+               /*
+                * The task was context-switched inside its critical
+                * section, which cannot happen to hardirq or NMI readers,
+                * so it is safe to call wake_up() here.
+                */
                put_cpu_ptr(&prcu_local);
                /*
                 * If we are executing the last outstanding
@@ -251,14 +311,17 @@ EXPORT_SYMBOL(synchronize_prcu);
  */
 void prcu_note_context_switch(void)
 {
+       unsigned int locked;
        struct prcu_local_struct *local;
 
        local = get_cpu_ptr(&prcu_local);
-       /* Update local and global outstanding PRCU task number. */
-       if (local->locked) {
-               atomic_add(local->locked, &prcu->active_ctr);
-               local->locked = 0;
-       }
+       /*
+        * Update local and global outstanding PRCU task number.
+        * Use xchg so that an NMI reader cannot slip in between.
+        */
+       locked = this_cpu_xchg(prcu_local.locked, 0);
+       if (locked)
+               atomic_add(locked, &prcu->active_ctr);
        /* Indicate a context-switch has occurred on this CPU. */
        local->online = 0;
        /* Update this CPU's local PRCU state. */
@@ -266,20 +329,47 @@ void prcu_note_context_switch(void)
        put_cpu_ptr(&prcu_local);
 }
 
+/*
+ * PRCU's callback version only advances in synchronize_prcu(), so
+ * callbacks queued while no updater is waiting would otherwise sit on
+ * the callback list forever.  call_prcu() arms prcu_gp_work, which runs
+ * synchronize_prcu() after PRCU_GP_DELAY unless it is already pending,
+ * so all the callbacks queued in that window share one grace period,
+ * and one set of IPIs.  The work item has not sampled the global
+ * version until it runs, so it covers every callback queued before.
+ */
+#define PRCU_GP_DELAY (HZ / 10)
+
+static void prcu_gp_workfn(struct work_struct *work)
+{
+       synchronize_prcu();
+}
+static DECLARE_DELAYED_WORK(prcu_gp_work, prcu_gp_workfn);
+
+static void prcu_kick_gp(void)
+{
+       if (!delayed_work_pending(&prcu_gp_work))
+               schedule_delayed_work(&prcu_gp_work, PRCU_GP_DELAY);
+}
+
 /*
  * Queue a PRCU callback to the current CPU for invocation
  * after a grace period.
+ *
+ * The callback is pushed onto the CPU's lock-less ->pending list,
+ * which prcu_process_callbacks() moves to ->cblist in one batch, so
+ * IRQs need not be disabled here.  An interrupt between reading the
+ * version and the push may queue a callback with a newer version
+ * ahead of ours, which merely delays ours by a grace period.
  */
 void call_prcu(struct rcu_head *head, rcu_callback_t func)
 {
-       unsigned long flags;
        struct prcu_local_struct *local;
-       struct prcu_cblist *rclp;
        struct prcu_version_head *vhp;
 
        debug_rcu_head_queue(head);
 
-       /* Use GFP_ATOMIC with IRQs disabled. */
+       /* We may be called with IRQs disabled. */
        vhp = kmalloc(sizeof(struct prcu_version_head), GFP_ATOMIC);
        /*
         * Complain about kmalloc() failure.  This could be handled
@@ -292,41 +382,212 @@ void call_prcu(struct rcu_head *head, rcu_callback_t func)
 
        head->func = func;
        head->next = NULL;
-       vhp->next = NULL;
+       vhp->head = head;
 
-       /* Disable IRQs to prevent races with prcu_process_callbacks(). */
-       local_irq_save(flags);
-       local = this_cpu_ptr(&prcu_local);
+       local = get_cpu_ptr(&prcu_local);
        /*
         * Assign the CPU-local callback version to the given callback
-        * and add it to the PRCU callback list of the current CPU.
+        * and add it to the pending list of the current CPU.
         */
-       vhp->version = local->version;
-       rclp = &local->cblist;
-       rclp->len++;
-       *rclp->tail = head;
-       rclp->tail = &head->next;
-       *rclp->version_tail = vhp;
-       rclp->version_tail = &vhp->next;
-       local_irq_restore(flags);
+       vhp->version = READ_ONCE(local->version);
+       llist_add(&vhp->llnode, &local->pending);
+       put_cpu_ptr(&prcu_local);
+
+       /* Make sure a grace period ends after this callback. */
+       prcu_kick_gp();
 }
 EXPORT_SYMBOL(call_prcu);
 
+#ifdef CONFIG_PRCU_NODE_CALLBACKS
+
+static struct prcu_node_struct *prcu_node[MAX_NUMNODES];
+
+/*
+ * Queue a PRCU callback to the given node.
+ */
+static void prcu_node_enqueue(struct prcu_node_struct *pnp,
+                              struct rcu_head *head, rcu_callback_t func)
+{
+       unsigned long flags;
+       struct prcu_version_head *vhp;
+
+       debug_rcu_head_queue(head);
+
+       vhp = kmalloc(sizeof(struct prcu_version_head), GFP_ATOMIC);
+       if (!vhp) {
+               WARN_ON(1);
+               return;
+       }
+
+       head->func = func;
+       head->next = NULL;
+       vhp->next = NULL;
+
+       local_irq_save(flags);
+       /* Same callback version as call_prcu() would have assigned. */
+       vhp->version = this_cpu_ptr(&prcu_local)->version;
+       spin_lock(&pnp->lock);
+       if (!pnp->cblist.head)
+               WRITE_ONCE(pnp->head_version, vhp->version);
+       prcu_cblist_enqueue(&pnp->cblist, head, vhp);
+       spin_unlock(&pnp->lock);
+       local_irq_restore(flags);
+
+       /* Make sure a grace period ends after this callback. */
+       prcu_kick_gp();
+}
+
+/*
+ * Queue a PRCU callback for invocation after a grace period by a CPU
+ * on node @nid.  If @nid is NUMA_NO_NODE, use the node of the memory
+ * holding @head, which suits callbacks freeing the enclosing object.
+ *
+ * Falls back to call_prcu() if the node is the current one, or if it
+ * has no online CPU to invoke the callback.  Like the per-CPU lists,
+ * callbacks already queued on a node are not migrated when its last
+ * CPU goes offline.
+ */
+void call_prcu_node(struct rcu_head *head, rcu_callback_t func, int nid)
+{
+       struct prcu_node_struct *pnp = NULL;
+
+       if (nid == NUMA_NO_NODE && virt_addr_valid(head))
+               nid = page_to_nid(virt_to_page(head));
+       if (nid != NUMA_NO_NODE && nid != numa_node_id() &&
+           cpumask_intersects(cpumask_of_node(nid), cpu_online_mask))
+               pnp = prcu_node[nid];
+       if (!pnp) {
+               call_prcu(head, func);
+               return;
+       }
+       prcu_node_enqueue(pnp, head, func);
+}
+EXPORT_SYMBOL(call_prcu_node);
+
+static bool prcu_node_pending(unsigned long long cb_version)
+{
+       struct prcu_node_struct *pnp = prcu_node[numa_node_id()];
+
+       return pnp && READ_ONCE(pnp->cblist.head) &&
+              READ_ONCE(pnp->head_version) < cb_version;
+}
+
+/*
+ * Invoke the callbacks of the current CPU's node whose grace period has
+ * completed.  Unlike the per-CPU list, the node list is shared, so the
+ * ready callbacks are moved off it before being invoked with IRQs enabled.
+ */
+static void prcu_process_node_callbacks(unsigned long long cb_version)
+{
+       unsigned long flags;
+       struct prcu_node_struct *pnp = prcu_node[numa_node_id()];
+       struct prcu_cblist *rclp;
+       struct rcu_head *list = NULL;
+       struct rcu_head **tail = &list;
+       struct rcu_head *rhp;
+
+       if (!pnp || !READ_ONCE(pnp->cblist.head))
+               return;
+
+       spin_lock_irqsave(&pnp->lock, flags);
+       rclp = &pnp->cblist;
+       while (rclp->version_head && rclp->version_head->version < cb_version) {
+               rhp = prcu_cblist_dequeue(rclp);
+               *tail = rhp;
+               tail = &rhp->next;
+       }
+       *tail = NULL;
+       if (rclp->version_head)
+               WRITE_ONCE(pnp->head_version, rclp->version_head->version);
+       spin_unlock_irqrestore(&pnp->lock, flags);
+
+       while (list) {
+               rhp = list;
+               list = rhp->next;
+               debug_rcu_head_unqueue(rhp);
+               rhp->func(rhp);
+       }
+}
+
+static void prcu_barrier_callback(struct rcu_head *rhp);
+
+/*
+ * Register a prcu_barrier() callback behind the callbacks of each node
+ * that can still invoke them.
+ */
+static void prcu_barrier_nodes(void)
+{
+       int nid;
+       struct prcu_node_struct *pnp;
+
+       for_each_node(nid) {
+               pnp = prcu_node[nid];
+               if (!pnp ||
+                   !cpumask_intersects(cpumask_of_node(nid), cpu_online_mask))
+                       continue;
+               atomic_inc(&prcu->barrier_cpu_count);
+               prcu_node_enqueue(pnp, &pnp->barrier_head,
+                                 prcu_barrier_callback);
+       }
+}
+
+static void __init prcu_init_nodes(void)
+{
+       int nid;
+       struct prcu_node_struct *pnp;
+
+       for_each_online_node(nid) {
+               pnp = kzalloc_node(sizeof(*pnp), GFP_KERNEL, nid);
+               if (WARN_ON(!pnp))
+                       continue;
+               spin_lock_init(&pnp->lock);
+               prcu_cblist_init(&pnp->cblist);
+               prcu_node[nid] = pnp;
+       }
+}
+
+#else /* #ifdef CONFIG_PRCU_NODE_CALLBACKS */
+
+static bool prcu_node_pending(unsigned long long cb_version)
+{
+       return false;
+}
+
+static void prcu_process_node_callbacks(unsigned long long cb_version)
+{
+}
+
+static void prcu_barrier_nodes(void)
+{
+}
+
+static void __init prcu_init_nodes(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_PRCU_NODE_CALLBACKS */
+
 /*
  * Check to see if there is any immediate PRCU-related work
  * to be done by the current CPU, returning 1 if so.
  *
- * Currently, it only checks whether this CPU has callbacks
- * that are ready to invoke.
+ * Currently, it only checks whether this CPU, or its node, has
+ * callbacks that are ready to invoke.
  */
 int prcu_pending(void)
 {
        struct prcu_local_struct *local = get_cpu_ptr(&prcu_local);
        unsigned long long cb_version = local->cb_version;
        struct prcu_cblist *rclp = &local->cblist;
+       unsigned long long global_cb_version;
+       int ret;
 
+       global_cb_version = atomic64_read(&prcu->cb_version);
+       ret = (cb_version < global_cb_version &&
+              (rclp->head || !llist_empty(&local->pending))) ||
+             prcu_node_pending(global_cb_version);
        put_cpu_ptr(&prcu_local);
-       return cb_version < atomic64_read(&prcu->cb_version) && rclp->head;
+       return ret;
 }
 
 /*
@@ -350,15 +611,37 @@ void prcu_check_callbacks(void)
                invoke_prcu_core();
 }
 
+/*
+ * Move the callbacks queued by call_prcu() since the last call to the
+ * tail of ->cblist, oldest first.
+ */
+static void prcu_drain_pending(struct prcu_local_struct *local)
+{
+       struct llist_node *llnode;
+       struct prcu_version_head *vhp, *next;
+
+       llnode = llist_del_all(&local->pending);
+       if (!llnode)
+               return;
+       llnode = llist_reverse_order(llnode);
+       llist_for_each_entry_safe(vhp, next, llnode, llnode) {
+               vhp->next = NULL;
+               prcu_cblist_enqueue(&local->cblist, vhp->head, vhp);
+       }
+}
+
 /*
  * Process PRCU callbacks whose grace period has completed.
  * Do this using softirq for each CPU.
  *
+ * ->cblist is only ever modified here, call_prcu() queues to the
+ * ->pending list instead, so the callbacks are invoked with IRQs
+ * enabled.
+ *
  * Also see the prcu_barrier() comment header.
  */
 static __latent_entropy void prcu_process_callbacks(struct softirq_action *unused)
 {
-       unsigned long flags;
        unsigned long long cb_version;
        struct prcu_local_struct *local;
        struct prcu_cblist *rclp;
@@ -370,9 +653,8 @@ static __latent_entropy void prcu_process_callbacks(struct softirq_action *unuse
 
        cb_version = atomic64_read(&prcu->cb_version);
 
-       /* Disable IRQs to prevent races with call_prcu(). */
-       local_irq_save(flags);
        local = this_cpu_ptr(&prcu_local);
+       prcu_drain_pending(local);
        rclp = &local->cblist;
        rhp = rclp->head;
        vhp = rclp->version_head;
@@ -389,7 +671,8 @@ static __latent_entropy void prcu_process_callbacks(struct softirq_action *unuse
        }
        /* Record the version number of callbacks to be processed. */
        local->cb_version = cb_version;
-       local_irq_restore(flags);
+
+       prcu_process_node_callbacks(cb_version);
 }
 
 /*
@@ -418,12 +701,8 @@ static void prcu_barrier_func(void *info)
  *
  * NOTE: The current PRCU implementation relies on synchronize_prcu()
  * to update its global grace-period and callback version numbers.
- * If there is no synchronize_prcu() running and call_prcu() is called,
- * rcu_process_callbacks() wont't make progress and prcu_barrier() will
- * -not- return.
- *
- * This needs to be fixed, e.g. using a grace-period expediting mechanism
- * as found in the Linux-kernel RCU implementation.
+ * Rather than wait for prcu_gp_work, run one here once the barrier
+ * callbacks are queued, so that they are all ready to be invoked.
  */
 void prcu_barrier(void)
 {
@@ -452,6 +731,8 @@ void prcu_barrier(void)
         */
        for_each_possible_cpu(cpu)
                smp_call_function_single(cpu, prcu_barrier_func, NULL, 1);
+       prcu_barrier_nodes();
+       synchronize_prcu();
 
        /* Decrement the count as we initialize it to one. */
        if (atomic_dec_and_test(&prcu->barrier_cpu_count))
@@ -481,6 +762,7 @@ void prcu_init_local_struct(int cpu)
        local->online = 0;
        local->version = 0;
        local->cb_version = 0;
+       init_llist_head(&local->pending);
        prcu_cblist_init(&local->cblist);
 }
 
@@ -494,4 +776,5 @@ void __init prcu_init(void)
        open_softirq(PRCU_SOFTIRQ, prcu_process_callbacks);
        for_each_possible_cpu(cpu)
                prcu_init_local_struct(cpu);
+       prcu_init_nodes();
 }
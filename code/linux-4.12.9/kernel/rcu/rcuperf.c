@@ -60,6 +60,8 @@ MODULE_AUTHOR("Paul E. McKenney <paulmck@linux.vnet.ibm.com>");
 #define VERBOSE_PERFOUT_ERRSTRING(s) \
 	do { if (verbose) pr_alert("%s" PERF_FLAG "!!! %s\n", perf_type, s); } while (0)
 
+torture_param(bool, gp_async, false, "Use asynchronous GP wait primitives");
+torture_param(int, gp_async_max, 1000, "Max # outstanding waits per writer");
 torture_param(bool, gp_exp, true, "Use expedited GP wait primitives");
 torture_param(int, holdoff, 10, "Holdoff time before test start (s)");
 torture_param(int, nreaders, -1, "Number of RCU reader threads");
@@ -87,6 +89,7 @@ static u64 t_rcu_perf_writer_started;
 static u64 t_rcu_perf_writer_finished;
 static unsigned long b_rcu_perf_writer_started;
 static unsigned long b_rcu_perf_writer_finished;
+static atomic_t n_rcu_perf_async_inflight;
 
 static int rcu_perf_writer_state;
 #define RTWS_INIT		0
@@ -94,6 +97,7 @@ static int rcu_perf_writer_state;
 #define RTWS_SYNC		2
 #define RTWS_IDLE		2
 #define RTWS_STOPPING		3
+#define RTWS_ASYNC		4
 
 #define MAX_MEAS 10000
 #define MIN_MEAS 100
@@ -117,6 +121,8 @@ struct rcu_perf_ops {
 	unsigned long (*exp_completed)(void);
 	void (*sync)(void);
 	void (*exp_sync)(void);
+	void (*async)(struct rcu_head *head, rcu_callback_t func);
+	void (*async_barrier)(void);
 	const char *name;
 };
 
@@ -156,6 +162,8 @@ static struct rcu_perf_ops rcu_ops = {
 	.exp_completed	= rcu_exp_batches_completed,
 	.sync		= synchronize_rcu,
 	.exp_sync	= synchronize_rcu_expedited,
+	.async		= call_rcu,
+	.async_barrier	= rcu_barrier,
 	.name		= "rcu"
 };
 
@@ -184,6 +192,8 @@ static struct rcu_perf_ops rcu_bh_ops = {
 	.exp_completed	= rcu_exp_batches_completed_sched,
 	.sync		= synchronize_rcu_bh,
 	.exp_sync	= synchronize_rcu_bh_expedited,
+	.async		= call_rcu_bh,
+	.async_barrier	= rcu_barrier_bh,
 	.name		= "rcu_bh"
 };
 
@@ -209,6 +219,16 @@ static unsigned long srcu_perf_completed(void)
 	return srcu_batches_completed(srcu_ctlp);
 }
 
+static void srcu_call_rcu(struct rcu_head *head, rcu_callback_t func)
+{
+	call_srcu(srcu_ctlp, head, func);
+}
+
+static void srcu_perf_barrier(void)
+{
+	srcu_barrier(srcu_ctlp);
+}
+
 static void srcu_perf_synchronize(void)
 {
 	synchronize_srcu(srcu_ctlp);
@@ -229,6 +249,8 @@ static struct rcu_perf_ops srcu_ops = {
 	.exp_completed	= srcu_perf_completed,
 	.sync		= srcu_perf_synchronize,
 	.exp_sync	= srcu_perf_synchronize_expedited,
+	.async		= srcu_call_rcu,
+	.async_barrier	= srcu_perf_barrier,
 	.name		= "srcu"
 };
 
@@ -257,6 +279,8 @@ static struct rcu_perf_ops sched_ops = {
 	.exp_completed	= rcu_exp_batches_completed_sched,
 	.sync		= synchronize_sched,
 	.exp_sync	= synchronize_sched_expedited,
+	.async		= call_rcu_sched,
+	.async_barrier	= rcu_barrier_sched,
 	.name		= "sched"
 };
 
@@ -284,6 +308,8 @@ static struct rcu_perf_ops tasks_ops = {
 	.completed	= rcu_no_completed,
 	.sync		= synchronize_rcu_tasks,
 	.exp_sync	= synchronize_rcu_tasks,
+	.async		= call_rcu_tasks,
+	.async_barrier	= rcu_barrier_tasks,
 	.name		= "tasks"
 };
 
@@ -330,6 +356,8 @@ static struct rcu_perf_ops prcu_ops = {
        .exp_completed  = rcu_no_completed,
        .sync           = synchronize_prcu,
        .exp_sync       = synchronize_prcu,
+       .async          = call_prcu,
+       .async_barrier  = prcu_barrier,
        .name           = "prcu"
 };
 
@@ -372,6 +400,60 @@ rcu_perf_reader(void *arg)
 	return 0;
 }
 
+/*
+ * Callback-latency measurement for gp_async.  The writer stores the
+ * queuing timestamp into its duration slot, and the callback replaces
+ * it with the time taken for the callback to be invoked.
+ */
+struct rcu_perf_async {
+	struct rcu_head rh;
+	u64 *wdp;
+};
+
+static void rcu_perf_async_cb(struct rcu_head *rhp)
+{
+	struct rcu_perf_async *rpap;
+
+	rpap = container_of(rhp, struct rcu_perf_async, rh);
+	*rpap->wdp = ktime_get_mono_fast_ns() - *rpap->wdp;
+	kfree(rpap);
+	atomic_dec(&n_rcu_perf_async_inflight);
+}
+
+/*
+ * Wait for the number of outstanding gp_async callbacks to drop to
+ * the specified limit.  Grace periods are driven by the synchronous
+ * primitive because some flavors (PRCU) only advance their callback
+ * version from synchronize_prcu(), which call_prcu() otherwise batches
+ * behind a delayed work item.
+ */
+static void rcu_perf_async_wait(int limit)
+{
+	while (atomic_read(&n_rcu_perf_async_inflight) > limit) {
+		cur_ops->sync();
+		schedule_timeout_uninterruptible(1);
+	}
+}
+
+/*
+ * Queue one gp_async callback, recording its queuing time in *wdp.
+ */
+static void rcu_perf_async_queue(u64 *wdp)
+{
+	struct rcu_perf_async *rpap;
+
+	rcu_perf_async_wait(gp_async_max * nrealwriters - 1);
+	rpap = kmalloc(sizeof(*rpap), GFP_KERNEL);
+	if (!rpap) {
+		*wdp = 0;
+		return;
+	}
+	rpap->wdp = wdp;
+	atomic_inc(&n_rcu_perf_async_inflight);
+	*wdp = ktime_get_mono_fast_ns();
+	cur_ops->async(&rpap->rh, rcu_perf_async_cb);
+}
+
 /*
  * RCU perf writer kthread.  Repeatedly does a grace period.
  */
@@ -379,7 +461,7 @@ static int
 rcu_perf_writer(void *arg)
 {
 	int i = 0;
-	int i_max;
+	int i_max = -1;
 	long me = (long)arg;
 	struct sched_param sp;
 	bool started = false, done = false, alldone = false;
@@ -410,17 +492,26 @@ rcu_perf_writer(void *arg)
 
 	do {
 		wdp = &wdpp[i];
-		*wdp = ktime_get_mono_fast_ns();
-		if (gp_exp) {
-			rcu_perf_writer_state = RTWS_EXP_SYNC;
-			cur_ops->exp_sync();
+		if (gp_async) {
+			/* Don't recycle a slot whose callback is pending. */
+			if (i == i_max)
+				rcu_perf_async_wait(0);
+			rcu_perf_writer_state = RTWS_ASYNC;
+			rcu_perf_async_queue(wdp);
+			t = ktime_get_mono_fast_ns();
 		} else {
-			rcu_perf_writer_state = RTWS_SYNC;
-			cur_ops->sync();
+			*wdp = ktime_get_mono_fast_ns();
+			if (gp_exp) {
+				rcu_perf_writer_state = RTWS_EXP_SYNC;
+				cur_ops->exp_sync();
+			} else {
+				rcu_perf_writer_state = RTWS_SYNC;
+				cur_ops->sync();
+			}
+			t = ktime_get_mono_fast_ns();
+			*wdp = t - *wdp;
 		}
 		rcu_perf_writer_state = RTWS_IDLE;
-		t = ktime_get_mono_fast_ns();
-		*wdp = t - *wdp;
 		i_max = i;
 		if (!started &&
 		    atomic_read(&n_rcu_perf_writer_started) >= nrealwriters)
@@ -468,8 +559,9 @@ static inline void
 rcu_perf_print_module_parms(struct rcu_perf_ops *cur_ops, const char *tag)
 {
 	pr_alert("%s" PERF_FLAG
-		 "--- %s: nreaders=%d nwriters=%d verbose=%d shutdown=%d\n",
-		 perf_type, tag, nrealreaders, nrealwriters, verbose, shutdown);
+		 "--- %s: nreaders=%d nwriters=%d gp_async=%d gp_exp=%d verbose=%d shutdown=%d\n",
+		 perf_type, tag, nrealreaders, nrealwriters, gp_async, gp_exp,
+		 verbose, shutdown);
 }
 
 static void
@@ -495,6 +587,17 @@ rcu_perf_cleanup(void)
 		for (i = 0; i < nrealwriters; i++) {
 			torture_stop_kthread(rcu_perf_writer,
 					     writer_tasks[i]);
+		}
+		/*
+		 * Wait for gp_async callbacks to fill in their durations,
+		 * then for the last of them to return before the module
+		 * text can go away.
+		 */
+		if (gp_async) {
+			rcu_perf_async_wait(0);
+			cur_ops->async_barrier();
+		}
+		for (i = 0; i < nrealwriters; i++) {
 			if (!writer_n_durations)
 				continue;
 			j = writer_n_durations[i];
@@ -606,6 +709,11 @@ rcu_perf_init(void)
 		firsterr = -EINVAL;
 		goto unwind;
 	}
+	if (gp_async && (!cur_ops->async || !cur_ops->async_barrier)) {
+		pr_alert("rcu-perf: gp_async without primitives.\n");
+		firsterr = -EINVAL;
+		goto unwind;
+	}
 	if (cur_ops->init)
 		cur_ops->init();
 
@@ -614,6 +722,7 @@ rcu_perf_init(void)
 	atomic_set(&n_rcu_perf_reader_started, 0);
 	atomic_set(&n_rcu_perf_writer_started, 0);
 	atomic_set(&n_rcu_perf_writer_finished, 0);
+	atomic_set(&n_rcu_perf_async_inflight, 0);
 	rcu_perf_print_module_parms(cur_ops, "Start of test");
 
 	/* Start up the kthreads. */
@@ -21,6 +21,7 @@
  */
 
 #include <linux/rcu_sync.h>
+#include <linux/prcu.h>
 #include <linux/sched.h>
 
 #ifdef CONFIG_PROVE_RCU
@@ -55,6 +56,12 @@ static const struct {
 		.wait = rcu_barrier_bh,
 		__INIT_HELD(rcu_read_lock_bh_held)
 	},
+	[RCU_PRCU_SYNC] = {
+		.sync = synchronize_prcu,
+		.call = call_prcu,
+		.wait = prcu_barrier,
+		__INIT_HELD(prcu_read_lock_held)
+	},
 };
 
 enum { GP_IDLE = 0, GP_PENDING, GP_PASSED };
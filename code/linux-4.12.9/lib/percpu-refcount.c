@@ -3,6 +3,7 @@
 #include <linux/kernel.h>
 #include <linux/sched.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/percpu-refcount.h>
 
 /*
@@ -36,6 +37,26 @@
 static DEFINE_SPINLOCK(percpu_ref_switch_lock);
 static DECLARE_WAIT_QUEUE_HEAD(percpu_ref_switch_waitq);
 
+/*
+ * Refs initialized with PERCPU_REF_INIT_BATCH are switched to atomic mode
+ * in batches.  They are chained on the pending list and, with at most one
+ * batch in flight, the whole list waits for a single sched-RCU grace
+ * period.  Killing many such refs at once then costs a couple of grace
+ * periods and callbacks instead of one callback per ref, which RCU only
+ * invokes a few at a time.  Summing the percpu counters of a big batch
+ * would keep a softirq busy for far longer than RCU allows a batch of
+ * callbacks, so the callback leaves that to a work item, which can
+ * reschedule between refs.
+ *
+ * The pending list and the busy flag are protected by
+ * percpu_ref_switch_lock.  The in-flight list belongs to the callback
+ * and then the work item.
+ */
+static struct percpu_ref *percpu_ref_batch_pending;
+static struct percpu_ref *percpu_ref_batch_inflight;
+static struct rcu_head percpu_ref_batch_rcu;
+static bool percpu_ref_batch_busy;
+
 static unsigned long __percpu *percpu_count_ptr(struct percpu_ref *ref)
 {
 	return (unsigned long __percpu *)
@@ -69,6 +90,7 @@ int percpu_ref_init(struct percpu_ref *ref, percpu_ref_func_t *release,
 		return -ENOMEM;
 
 	ref->force_atomic = flags & PERCPU_REF_INIT_ATOMIC;
+	ref->batch_switch = flags & PERCPU_REF_INIT_BATCH;
 
 	if (flags & (PERCPU_REF_INIT_ATOMIC | PERCPU_REF_INIT_DEAD))
 		ref->percpu_count_ptr |= __PERCPU_REF_ATOMIC;
@@ -111,10 +133,8 @@ void percpu_ref_exit(struct percpu_ref *ref)
 }
 EXPORT_SYMBOL_GPL(percpu_ref_exit);
 
-static void percpu_ref_call_confirm_rcu(struct rcu_head *rcu)
+static void percpu_ref_call_confirm(struct percpu_ref *ref)
 {
-	struct percpu_ref *ref = container_of(rcu, struct percpu_ref, rcu);
-
 	ref->confirm_switch(ref);
 	ref->confirm_switch = NULL;
 	wake_up_all(&percpu_ref_switch_waitq);
@@ -123,9 +143,8 @@ static void percpu_ref_call_confirm_rcu(struct rcu_head *rcu)
 	percpu_ref_put(ref);
 }
 
-static void percpu_ref_switch_to_atomic_rcu(struct rcu_head *rcu)
+static void __percpu_ref_switch_to_atomic_rcu(struct percpu_ref *ref)
 {
-	struct percpu_ref *ref = container_of(rcu, struct percpu_ref, rcu);
 	unsigned long __percpu *percpu_count = percpu_count_ptr(ref);
 	unsigned long count = 0;
 	int cpu;
@@ -155,7 +174,56 @@ static void percpu_ref_switch_to_atomic_rcu(struct rcu_head *rcu)
 		  ref->release, atomic_long_read(&ref->count));
 
 	/* @ref is viewed as dead on all CPUs, send out switch confirmation */
-	percpu_ref_call_confirm_rcu(rcu);
+	percpu_ref_call_confirm(ref);
+}
+
+static void percpu_ref_switch_to_atomic_rcu(struct rcu_head *rcu)
+{
+	__percpu_ref_switch_to_atomic_rcu(container_of(rcu, struct percpu_ref,
+						       rcu));
+}
+
+static void percpu_ref_batch_switch_workfn(struct work_struct *work);
+static DECLARE_WORK(percpu_ref_batch_work, percpu_ref_batch_switch_workfn);
+
+/* the grace period has elapsed, the summing can be done at leisure */
+static void percpu_ref_batch_switch_rcu(struct rcu_head *rcu)
+{
+	schedule_work(&percpu_ref_batch_work);
+}
+
+static void percpu_ref_batch_start(void)
+{
+	lockdep_assert_held(&percpu_ref_switch_lock);
+
+	percpu_ref_batch_inflight = percpu_ref_batch_pending;
+	percpu_ref_batch_pending = NULL;
+	percpu_ref_batch_busy = true;
+	call_rcu_sched(&percpu_ref_batch_rcu, percpu_ref_batch_switch_rcu);
+}
+
+static void percpu_ref_batch_switch_workfn(struct work_struct *work)
+{
+	struct percpu_ref *ref, *next;
+	unsigned long flags;
+
+	/*
+	 * Each ref may be released, or queued for switching again, as soon
+	 * as it has been confirmed; fetch the next one before.
+	 */
+	for (ref = percpu_ref_batch_inflight; ref; ref = next) {
+		next = ref->batch_next;
+		__percpu_ref_switch_to_atomic_rcu(ref);
+		cond_resched();
+	}
+
+	/* refs queued meanwhile need a grace period of their own */
+	spin_lock_irqsave(&percpu_ref_switch_lock, flags);
+	if (percpu_ref_batch_pending)
+		percpu_ref_batch_start();
+	else
+		percpu_ref_batch_busy = false;
+	spin_unlock_irqrestore(&percpu_ref_switch_lock, flags);
 }
 
 static void percpu_ref_noop_confirm_switch(struct percpu_ref *ref)
@@ -181,6 +249,15 @@ static void __percpu_ref_switch_to_atomic(struct percpu_ref *ref,
 	ref->confirm_switch = confirm_switch ?: percpu_ref_noop_confirm_switch;
 
 	percpu_ref_get(ref);	/* put after confirmation */
+
+	if (ref->batch_switch) {
+		ref->batch_next = percpu_ref_batch_pending;
+		percpu_ref_batch_pending = ref;
+		if (!percpu_ref_batch_busy)
+			percpu_ref_batch_start();
+		return;
+	}
+
 	call_rcu_sched(&ref->rcu, percpu_ref_switch_to_atomic_rcu);
 }
 
@@ -28,6 +28,13 @@
 #include <linux/spinlock.h>
 #include <linux/percpu_ida.h>
 
+/* states of percpu_ida_cpu->stash_state */
+enum {
+	IDA_STASH_EMPTY,
+	IDA_STASH_BUSY,
+	IDA_STASH_FULL,
+};
+
 struct percpu_ida_cpu {
 	/*
 	 * Even though this is percpu, we need a lock for tag stealing by remote
@@ -37,6 +44,26 @@ struct percpu_ida_cpu {
 
 	/* nr_free/freelist form a stack of free IDs */
 	unsigned			nr_free;
+
+	/*
+	 * Number of IDs moved at a time when the freelist is refilled or
+	 * spilled, adapted to this cpu's traffic by ida_adapt_batch().
+	 */
+	unsigned			batch;
+	/* allocations and frees since the last refill or spill */
+	unsigned			nr_ops;
+
+	/*
+	 * IDs spilled by a full freelist, which any cpu can take without
+	 * locking: the owner fills the stash while it is IDA_STASH_BUSY and
+	 * publishes it as IDA_STASH_FULL, whoever claims it back to
+	 * IDA_STASH_BUSY empties it and marks it IDA_STASH_EMPTY again.
+	 */
+	atomic_t			stash_state;
+	unsigned			stash_nr;
+	unsigned			*stash;
+
+	/* percpu_max_size entries for the freelist, then the stash */
 	unsigned			freelist[];
 };
 
@@ -101,15 +128,15 @@ static inline void steal_tags(struct percpu_ida *pool,
 }
 
 /*
- * Pop up to IDA_PCPU_BATCH_MOVE IDs off the global freelist, and push them onto
- * our percpu freelist:
+ * Pop up to tags->batch IDs off the global freelist, and push them onto our
+ * percpu freelist:
  */
 static inline void alloc_global_tags(struct percpu_ida *pool,
 				     struct percpu_ida_cpu *tags)
 {
 	move_tags(tags->freelist, &tags->nr_free,
 		  pool->freelist, &pool->nr_free,
-		  min(pool->nr_free, pool->percpu_batch_size));
+		  min(pool->nr_free, tags->batch));
 }
 
 static inline unsigned alloc_local_tag(struct percpu_ida_cpu *tags)
@@ -117,13 +144,112 @@ static inline unsigned alloc_local_tag(struct percpu_ida_cpu *tags)
 	int tag = -ENOSPC;
 
 	spin_lock(&tags->lock);
-	if (tags->nr_free)
+	if (tags->nr_free) {
 		tag = tags->freelist[--tags->nr_free];
+		tags->nr_ops++;
+	}
 	spin_unlock(&tags->lock);
 
 	return tag;
 }
 
+/*
+ * A cpu which has to refill or spill its freelist again shortly after the
+ * last time mostly allocates or mostly frees, e.g. the submission or the
+ * completion side of a driver; move more IDs at a time.  A cpu which rarely
+ * needs to is balanced; move fewer so that they don't sit idle on it.
+ *
+ * Called on the owning cpu with irqs disabled.
+ */
+static void ida_adapt_batch(struct percpu_ida *pool,
+			    struct percpu_ida_cpu *tags)
+{
+	if (tags->nr_ops < 2 * tags->batch)
+		tags->batch = min(tags->batch * 2, pool->percpu_max_size);
+	else if (tags->nr_ops > 16 * tags->batch)
+		tags->batch = max(tags->batch / 2,
+				  max(pool->percpu_batch_size / 4, 1U));
+	tags->nr_ops = 0;
+}
+
+/*
+ * Move up to tags->batch IDs of our full freelist to the stash, if it is
+ * empty.  Called on the owning cpu with irqs disabled.
+ */
+static bool stash_tags(struct percpu_ida *pool, struct percpu_ida_cpu *tags)
+{
+	if (atomic_cmpxchg(&tags->stash_state, IDA_STASH_EMPTY,
+			   IDA_STASH_BUSY) != IDA_STASH_EMPTY)
+		return false;
+
+	spin_lock(&tags->lock);
+	move_tags(tags->stash, &tags->stash_nr,
+		  tags->freelist, &tags->nr_free,
+		  min(tags->nr_free, tags->batch));
+	spin_unlock(&tags->lock);
+
+	/* pairs with the cmpxchg in take_stash() */
+	atomic_set_release(&tags->stash_state, IDA_STASH_FULL);
+	cpumask_set_cpu(smp_processor_id(), &pool->cpus_have_stash);
+	return true;
+}
+
+/*
+ * Move the stash of @remote, which may be our own, to our empty freelist.
+ */
+static bool take_stash(struct percpu_ida_cpu *tags,
+		       struct percpu_ida_cpu *remote)
+{
+	if (atomic_cmpxchg(&remote->stash_state, IDA_STASH_FULL,
+			   IDA_STASH_BUSY) != IDA_STASH_FULL)
+		return false;
+
+	spin_lock(&tags->lock);
+	move_tags(tags->freelist, &tags->nr_free,
+		  remote->stash, &remote->stash_nr,
+		  min(remote->stash_nr,
+		      (unsigned)(remote->stash - remote->freelist) -
+		      tags->nr_free));
+	spin_unlock(&tags->lock);
+
+	/* leftovers, if any, stay stashed */
+	atomic_set_release(&remote->stash_state, remote->stash_nr ?
+			   IDA_STASH_FULL : IDA_STASH_EMPTY);
+	return true;
+}
+
+/*
+ * Lock-free counterpart of steal_tags(): take a stash, preferably our own,
+ * with a single cmpxchg.
+ */
+static void take_stashed_tags(struct percpu_ida *pool,
+			      struct percpu_ida_cpu *tags)
+{
+	struct percpu_ida_cpu *remote;
+	unsigned cpu;
+
+	if (take_stash(tags, tags))
+		return;
+
+	for_each_cpu(cpu, &pool->cpus_have_stash) {
+		remote = per_cpu_ptr(pool->tag_cpu, cpu);
+		if (remote != tags && take_stash(tags, remote))
+			return;
+
+		/*
+		 * Clear the bit of an empty stash.  Re-check after clearing
+		 * so that we can't wipe the bit of a stash refilled meanwhile:
+		 * stash_tags() sets it only after publishing the stash.
+		 */
+		if (atomic_read(&remote->stash_state) != IDA_STASH_EMPTY)
+			continue;
+		cpumask_clear_cpu(cpu, &pool->cpus_have_stash);
+		smp_mb__after_atomic();
+		if (atomic_read(&remote->stash_state) == IDA_STASH_FULL)
+			cpumask_set_cpu(cpu, &pool->cpus_have_stash);
+	}
+}
+
 /**
  * percpu_ida_alloc - allocate a tag
  * @pool: pool to allocate from
@@ -159,32 +285,38 @@ int percpu_ida_alloc(struct percpu_ida *pool, int state)
 		return tag;
 	}
 
-	while (1) {
-		spin_lock(&pool->lock);
+	ida_adapt_batch(pool, tags);
 
+	while (1) {
 		/*
-		 * prepare_to_wait() must come before steal_tags(), in case
-		 * percpu_ida_free() on another cpu flips a bit in
-		 * cpus_have_tags
-		 *
-		 * global lock held and irqs disabled, don't need percpu lock
+		 * prepare_to_wait() must come before take_stashed_tags() and
+		 * steal_tags(), in case percpu_ida_free() on another cpu
+		 * flips a bit in cpus_have_stash or cpus_have_tags
 		 */
 		if (state != TASK_RUNNING)
 			prepare_to_wait(&pool->wait, &wait, state);
 
 		if (!tags->nr_free)
+			take_stashed_tags(pool, tags);
+
+		if (!tags->nr_free) {
+			/*
+			 * global lock held and irqs disabled, don't need
+			 * percpu lock
+			 */
+			spin_lock(&pool->lock);
 			alloc_global_tags(pool, tags);
-		if (!tags->nr_free)
-			steal_tags(pool, tags);
-
-		if (tags->nr_free) {
-			tag = tags->freelist[--tags->nr_free];
-			if (tags->nr_free)
-				cpumask_set_cpu(smp_processor_id(),
-						&pool->cpus_have_tags);
+			if (!tags->nr_free)
+				steal_tags(pool, tags);
+			spin_unlock(&pool->lock);
 		}
 
-		spin_unlock(&pool->lock);
+		/* remote cpus may steal from us again without the global lock */
+		tag = alloc_local_tag(tags);
+		if (tag >= 0 && tags->nr_free)
+			cpumask_set_cpu(smp_processor_id(),
+					&pool->cpus_have_tags);
+
 		local_irq_restore(flags);
 
 		if (tag >= 0 || state == TASK_RUNNING)
@@ -227,6 +359,7 @@ void percpu_ida_free(struct percpu_ida *pool, unsigned tag)
 
 	spin_lock(&tags->lock);
 	tags->freelist[tags->nr_free++] = tag;
+	tags->nr_ops++;
 
 	nr_free = tags->nr_free;
 	spin_unlock(&tags->lock);
@@ -238,6 +371,14 @@ void percpu_ida_free(struct percpu_ida *pool, unsigned tag)
 	}
 
 	if (nr_free == pool->percpu_max_size) {
+		ida_adapt_batch(pool, tags);
+
+		/* prefer the stash, which other cpus can take without locks */
+		if (stash_tags(pool, tags)) {
+			wake_up(&pool->wait);
+			goto out;
+		}
+
 		spin_lock(&pool->lock);
 
 		/*
@@ -247,13 +388,13 @@ void percpu_ida_free(struct percpu_ida *pool, unsigned tag)
 		if (tags->nr_free == pool->percpu_max_size) {
 			move_tags(pool->freelist, &pool->nr_free,
 				  tags->freelist, &tags->nr_free,
-				  pool->percpu_batch_size);
+				  tags->batch);
 
 			wake_up(&pool->wait);
 		}
 		spin_unlock(&pool->lock);
 	}
-
+out:
 	local_irq_restore(flags);
 }
 EXPORT_SYMBOL_GPL(percpu_ida_free);
@@ -314,13 +455,19 @@ int __percpu_ida_init(struct percpu_ida *pool, unsigned long nr_tags,
 	pool->nr_free = nr_tags;
 
 	pool->tag_cpu = __alloc_percpu(sizeof(struct percpu_ida_cpu) +
-				       pool->percpu_max_size * sizeof(unsigned),
-				       sizeof(unsigned));
+				       2 * pool->percpu_max_size * sizeof(unsigned),
+				       sizeof(void *));
 	if (!pool->tag_cpu)
 		goto err;
 
-	for_each_possible_cpu(cpu)
-		spin_lock_init(&per_cpu_ptr(pool->tag_cpu, cpu)->lock);
+	for_each_possible_cpu(cpu) {
+		struct percpu_ida_cpu *tags = per_cpu_ptr(pool->tag_cpu, cpu);
+
+		spin_lock_init(&tags->lock);
+		tags->batch = pool->percpu_batch_size;
+		atomic_set(&tags->stash_state, IDA_STASH_EMPTY);
+		tags->stash = tags->freelist + pool->percpu_max_size;
+	}
 
 	return 0;
 err:
@@ -358,6 +505,15 @@ int percpu_ida_for_each_free(struct percpu_ida *pool, percpu_ida_cb fn,
 		spin_unlock(&remote->lock);
 		if (err)
 			goto out;
+
+		/* racy, but so is everything else here */
+		if (atomic_read(&remote->stash_state) != IDA_STASH_FULL)
+			continue;
+		for (i = 0; i < READ_ONCE(remote->stash_nr); i++) {
+			err = fn(remote->stash[i], data);
+			if (err)
+				goto out;
+		}
 	}
 
 	spin_lock(&pool->lock);
@@ -383,9 +539,14 @@ EXPORT_SYMBOL_GPL(percpu_ida_for_each_free);
 unsigned percpu_ida_free_tags(struct percpu_ida *pool, int cpu)
 {
 	struct percpu_ida_cpu *remote;
+	unsigned nr_free;
+
 	if (cpu == nr_cpu_ids)
 		return pool->nr_free;
 	remote = per_cpu_ptr(pool->tag_cpu, cpu);
-	return remote->nr_free;
+	nr_free = remote->nr_free;
+	if (atomic_read(&remote->stash_state) == IDA_STASH_FULL)
+		nr_free += remote->stash_nr;
+	return nr_free;
 }
 EXPORT_SYMBOL_GPL(percpu_ida_free_tags);
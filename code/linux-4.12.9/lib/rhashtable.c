@@ -33,6 +33,10 @@
 #define HASH_MIN_SIZE		4U
 #define BUCKET_LOCKS_PER_CPU	32UL
 
+/* rcu_dereference() that also accepts readers of PRCU-protected tables. */
+#define rht_dereference_reader(p) \
+	rcu_dereference_check(p, prcu_read_lock_held())
+
 union nested_table {
 	union nested_table __rcu *table;
 	struct rhash_head __rcu *bucket;
@@ -157,7 +161,7 @@ static union nested_table *nested_table_alloc(struct rhashtable *ht,
 	union nested_table *ntbl;
 	int i;
 
-	ntbl = rcu_dereference(*prev);
+	ntbl = rht_dereference_reader(*prev);
 	if (ntbl)
 		return ntbl;
 
@@ -379,7 +383,7 @@ static int rhashtable_rehash_table(struct rhashtable *ht)
 	 * table, and thus no references to the old table will
 	 * remain.
 	 */
-	call_rcu(&old_tbl->rcu, bucket_table_free_rcu);
+	rhashtable_call_rcu(ht, &old_tbl->rcu, bucket_table_free_rcu);
 
 	return rht_dereference(new_tbl->future_tbl, ht) ? -EAGAIN : 0;
 }
@@ -577,7 +581,7 @@ static struct bucket_table *rhashtable_insert_one(struct rhashtable *ht,
 	if (PTR_ERR(data) != -EAGAIN && PTR_ERR(data) != -ENOENT)
 		return ERR_CAST(data);
 
-	new_tbl = rcu_dereference(tbl->future_tbl);
+	new_tbl = rht_dereference_reader(tbl->future_tbl);
 	if (new_tbl)
 		return new_tbl;
 
@@ -622,7 +626,7 @@ static void *rhashtable_try_insert(struct rhashtable *ht, const void *key,
 	spinlock_t *lock;
 	void *data;
 
-	tbl = rcu_dereference(ht->tbl);
+	tbl = rht_dereference_reader(ht->tbl);
 
 	/* All insertions must grab the oldest table containing
 	 * the hashed bucket that is yet to be rehashed.
@@ -636,7 +640,7 @@ static void *rhashtable_try_insert(struct rhashtable *ht, const void *key,
 			break;
 
 		spin_unlock_bh(lock);
-		tbl = rcu_dereference(tbl->future_tbl);
+		tbl = rht_dereference_reader(tbl->future_tbl);
 	}
 
 	data = rhashtable_lookup_one(ht, tbl, hash, key, obj);
@@ -673,9 +677,9 @@ void *rhashtable_insert_slow(struct rhashtable *ht, const void *key,
 	void *data;
 
 	do {
-		rcu_read_lock();
+		rhashtable_read_lock(ht);
 		data = rhashtable_try_insert(ht, key, obj);
-		rcu_read_unlock();
+		rhashtable_read_unlock(ht);
 	} while (PTR_ERR(data) == -EAGAIN);
 
 	return data;
@@ -736,9 +740,9 @@ EXPORT_SYMBOL_GPL(rhashtable_walk_exit);
  * rhashtable_walk_start - Start a hash table walk
  * @iter:	Hash table iterator
  *
- * Start a hash table walk.  Note that we take the RCU lock in all
- * cases including when we return an error.  So you must always call
- * rhashtable_walk_stop to clean up.
+ * Start a hash table walk.  Note that we take the RCU lock (or the PRCU
+ * lock for PRCU-protected tables) in all cases including when we return
+ * an error.  So you must always call rhashtable_walk_stop to clean up.
  *
  * Returns zero if successful.
  *
@@ -751,7 +755,7 @@ int rhashtable_walk_start(struct rhashtable_iter *iter)
 {
 	struct rhashtable *ht = iter->ht;
 
-	rcu_read_lock();
+	rhashtable_read_lock(ht);
 
 	spin_lock(&ht->lock);
 	if (iter->walker.tbl)
@@ -788,8 +792,8 @@ void *rhashtable_walk_next(struct rhashtable_iter *iter)
 	bool rhlist = ht->rhlist;
 
 	if (p) {
-		if (!rhlist || !(list = rcu_dereference(list->next))) {
-			p = rcu_dereference(p->next);
+		if (!rhlist || !(list = rht_dereference_reader(list->next))) {
+			p = rht_dereference_reader(p->next);
 			list = container_of(p, struct rhlist_head, rhead);
 		}
 		goto next;
@@ -806,7 +810,7 @@ void *rhashtable_walk_next(struct rhashtable_iter *iter)
 					if (!skip)
 						goto next;
 					skip--;
-					list = rcu_dereference(list->next);
+					list = rht_dereference_reader(list->next);
 				} while (list);
 
 				continue;
@@ -852,14 +856,12 @@ EXPORT_SYMBOL_GPL(rhashtable_walk_next);
 void rhashtable_walk_stop(struct rhashtable_iter *iter)
 	__releases(RCU)
 {
-	struct rhashtable *ht;
+	struct rhashtable *ht = iter->ht;
 	struct bucket_table *tbl = iter->walker.tbl;
 
 	if (!tbl)
 		goto out;
 
-	ht = iter->ht;
-
 	spin_lock(&ht->lock);
 	if (tbl->rehash < tbl->size)
 		list_add(&iter->walker.list, &tbl->walkers);
@@ -870,7 +872,7 @@ void rhashtable_walk_stop(struct rhashtable_iter *iter)
 	iter->p = NULL;
 
 out:
-	rcu_read_unlock();
+	rhashtable_read_unlock(ht);
 }
 EXPORT_SYMBOL_GPL(rhashtable_walk_stop);
 
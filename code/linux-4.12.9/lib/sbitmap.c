@@ -323,10 +323,25 @@ int sbitmap_queue_init_node(struct sbitmap_queue *sbq, unsigned int depth,
 	}
 
 	sbq->round_robin = round_robin;
+	sbq->cache = NULL;
 	return 0;
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_init_node);
 
+int sbitmap_queue_enable_cache(struct sbitmap_queue *sbq, gfp_t flags)
+{
+	if (sbq->round_robin)
+		return -EINVAL;
+	if (sbq->cache)
+		return 0;
+
+	sbq->cache = alloc_percpu_gfp(struct sbq_cache, flags);
+	if (!sbq->cache)
+		return -ENOMEM;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_enable_cache);
+
 void sbitmap_queue_resize(struct sbitmap_queue *sbq, unsigned int depth)
 {
 	unsigned int wake_batch = sbq_calc_wake_batch(depth);
@@ -346,11 +361,65 @@ void sbitmap_queue_resize(struct sbitmap_queue *sbq, unsigned int depth)
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_resize);
 
+/*
+ * Bits cached on other CPUs are invisible to an allocator that runs out of
+ * bits. Only cache while they can add up to at most half of the depth, so
+ * that the bits in flight are enough to keep waiters going.
+ */
+static inline bool sbq_cache_usable(unsigned int depth)
+{
+	return depth >= 2 * SBQ_CACHE_SIZE * nr_cpu_ids;
+}
+
+static int sbq_cache_get(struct sbitmap_queue *sbq)
+{
+	unsigned int depth = READ_ONCE(sbq->sb.depth);
+	struct sbq_cache *cache;
+	unsigned int offset;
+	unsigned long mask, flags;
+	int nr = -1;
+
+	/* sbitmap_queue_clear() may be called from interrupt context */
+	local_irq_save(flags);
+	cache = this_cpu_ptr(sbq->cache);
+	while (cache->nr) {
+		nr = cache->bits[--cache->nr];
+		if (likely(nr < depth))
+			goto out;
+		/* Left over from before the bitmap was shrunk. */
+		sbitmap_clear_bit(&sbq->sb, nr);
+		nr = -1;
+	}
+
+	if (!sbq_cache_usable(depth))
+		goto out;
+
+	mask = __sbitmap_queue_get_batch(sbq, SBQ_CACHE_BATCH, &offset);
+	if (!mask)
+		goto out;
+
+	nr = offset + __ffs(mask);
+	mask &= mask - 1;
+	while (mask) {
+		cache->bits[cache->nr++] = offset + __ffs(mask);
+		mask &= mask - 1;
+	}
+out:
+	local_irq_restore(flags);
+	return nr;
+}
+
 int __sbitmap_queue_get(struct sbitmap_queue *sbq)
 {
 	unsigned int hint, depth;
 	int nr;
 
+	if (sbq->cache) {
+		nr = sbq_cache_get(sbq);
+		if (nr >= 0)
+			return nr;
+	}
+
 	hint = this_cpu_read(*sbq->alloc_hint);
 	depth = READ_ONCE(sbq->sb.depth);
 	if (unlikely(hint >= depth)) {
@@ -403,6 +472,70 @@ int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 }
 EXPORT_SYMBOL_GPL(__sbitmap_queue_get_shallow);
 
+/*
+ * Take up to @nr_bits of the free bits in @val.
+ */
+static unsigned long sbq_take_bits(unsigned long val, unsigned long depth,
+				   unsigned int nr_bits)
+{
+	unsigned long free = ~val & BITMAP_LAST_WORD_MASK(depth);
+	unsigned long mask = 0;
+
+	while (free && nr_bits--) {
+		mask |= free & -free;
+		free &= free - 1;
+	}
+	return mask;
+}
+
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq,
+					unsigned int nr_bits,
+					unsigned int *offset)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned int hint, depth, index, i;
+	unsigned long val, old, mask;
+
+	if (WARN_ON_ONCE(sbq->round_robin) || !nr_bits)
+		return 0;
+
+	hint = this_cpu_read(*sbq->alloc_hint);
+	depth = READ_ONCE(sb->depth);
+	if (unlikely(hint >= depth)) {
+		hint = depth ? prandom_u32() % depth : 0;
+		this_cpu_write(*sbq->alloc_hint, hint);
+	}
+
+	index = SB_NR_TO_INDEX(sb, hint);
+	for (i = 0; i < sb->map_nr; i++) {
+		struct sbitmap_word *word = &sb->map[index];
+
+		val = READ_ONCE(word->word);
+		while ((mask = sbq_take_bits(val, READ_ONCE(word->depth),
+					     nr_bits))) {
+			old = cmpxchg(&word->word, val, val | mask);
+			if (old == val) {
+				*offset = index << sb->shift;
+				hint = *offset + __fls(mask) + 1;
+				if (hint >= depth - 1)
+					hint = 0;
+				this_cpu_write(*sbq->alloc_hint, hint);
+				return mask;
+			}
+			val = old;
+		}
+
+		/* Jump to next index. */
+		if (++index >= sb->map_nr)
+			index = 0;
+	}
+
+	/* If the map is full, a hint won't do us much good. */
+	this_cpu_write(*sbq->alloc_hint, 0);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__sbitmap_queue_get_batch);
+
 static struct sbq_wait_state *sbq_wake_ptr(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
@@ -425,24 +558,15 @@ static struct sbq_wait_state *sbq_wake_ptr(struct sbitmap_queue *sbq)
 	return NULL;
 }
 
-static void sbq_wake_up(struct sbitmap_queue *sbq)
+static bool __sbq_wake_up(struct sbitmap_queue *sbq)
 {
 	struct sbq_wait_state *ws;
 	unsigned int wake_batch;
 	int wait_cnt;
 
-	/*
-	 * Pairs with the memory barrier in set_current_state() to ensure the
-	 * proper ordering of clear_bit()/waitqueue_active() in the waker and
-	 * test_and_set_bit()/prepare_to_wait()/finish_wait() in the waiter. See
-	 * the comment on waitqueue_active(). This is __after_atomic because we
-	 * just did clear_bit() in the caller.
-	 */
-	smp_mb__after_atomic();
-
 	ws = sbq_wake_ptr(sbq);
 	if (!ws)
-		return;
+		return false;
 
 	wait_cnt = atomic_dec_return(&ws->wait_cnt);
 	if (wait_cnt <= 0) {
@@ -464,18 +588,136 @@ static void sbq_wake_up(struct sbitmap_queue *sbq)
 		sbq_index_atomic_inc(&sbq->wake_index);
 		wake_up(&ws->wait);
 	}
+
+	return true;
+}
+
+/*
+ * Account @nr freed bits against the wait queues.
+ */
+static void sbq_wake_up(struct sbitmap_queue *sbq, unsigned int nr)
+{
+	/*
+	 * Pairs with the memory barrier in set_current_state() to ensure the
+	 * proper ordering of clear_bit()/waitqueue_active() in the waker and
+	 * test_and_set_bit()/prepare_to_wait()/finish_wait() in the waiter. See
+	 * the comment on waitqueue_active(). This is __after_atomic because we
+	 * just did clear_bit() in the caller.
+	 */
+	smp_mb__after_atomic();
+
+	while (nr-- && __sbq_wake_up(sbq))
+		;
+}
+
+static void __sbitmap_queue_clear_batch(struct sbitmap_queue *sbq,
+					const unsigned int *bits,
+					unsigned int nr_bits)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned long *addr = NULL, *this_addr;
+	unsigned long mask = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_bits; i++) {
+		this_addr = __sbitmap_word(sb, bits[i]);
+		if (addr && this_addr != addr) {
+			atomic_long_andnot(mask, (atomic_long_t *)addr);
+			mask = 0;
+		}
+		addr = this_addr;
+		mask |= 1UL << SB_NR_TO_BIT(sb, bits[i]);
+	}
+	if (mask)
+		atomic_long_andnot(mask, (atomic_long_t *)addr);
+}
+
+/*
+ * Give the local cache back to the bitmap, called when there are waiters
+ * which can't see the cached bits.
+ */
+static void sbq_cache_flush(struct sbitmap_queue *sbq)
+{
+	struct sbq_cache *cache;
+	unsigned int bits[SBQ_CACHE_SIZE];
+	unsigned long flags;
+	unsigned int nr;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(sbq->cache);
+	nr = cache->nr;
+	memcpy(bits, cache->bits, nr * sizeof(bits[0]));
+	cache->nr = 0;
+	local_irq_restore(flags);
+
+	if (nr) {
+		__sbitmap_queue_clear_batch(sbq, bits, nr);
+		sbq_wake_up(sbq, nr);
+	}
+}
+
+static bool sbq_cache_put(struct sbitmap_queue *sbq, unsigned int nr)
+{
+	unsigned int depth = READ_ONCE(sbq->sb.depth);
+	struct sbq_cache *cache;
+	unsigned long flags;
+	bool cached = false;
+
+	if (nr >= depth || !sbq_cache_usable(depth))
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(sbq->cache);
+	if (cache->nr < SBQ_CACHE_SIZE) {
+		cache->bits[cache->nr++] = nr;
+		cached = true;
+	}
+	local_irq_restore(flags);
+
+	if (cached) {
+		/*
+		 * Like in sbq_wake_up(), order the store to the cache against
+		 * waitqueue_active(). Waiters only look at the bitmap, so
+		 * return our bits to it if there are any.
+		 */
+		smp_mb();
+		if (sbq_wake_ptr(sbq))
+			sbq_cache_flush(sbq);
+	}
+	return cached;
 }
 
 void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu)
 {
+	if (sbq->cache && sbq_cache_put(sbq, nr))
+		return;
+
 	sbitmap_clear_bit(&sbq->sb, nr);
-	sbq_wake_up(sbq);
+	sbq_wake_up(sbq, 1);
 	if (likely(!sbq->round_robin && nr < sbq->sb.depth))
 		*per_cpu_ptr(sbq->alloc_hint, cpu) = nr;
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_clear);
 
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq,
+			       const unsigned int *bits, unsigned int nr_bits,
+			       unsigned int cpu)
+{
+	unsigned int last;
+
+	if (!nr_bits)
+		return;
+
+	__sbitmap_queue_clear_batch(sbq, bits, nr_bits);
+	sbq_wake_up(sbq, nr_bits);
+
+	last = bits[nr_bits - 1];
+	if (likely(!sbq->round_robin && last < sbq->sb.depth))
+		*per_cpu_ptr(sbq->alloc_hint, cpu) = last;
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_clear_batch);
+
 void sbitmap_queue_wake_all(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
@@ -528,5 +770,17 @@ void sbitmap_queue_show(struct sbitmap_queue *sbq, struct seq_file *m)
 	seq_puts(m, "}\n");
 
 	seq_printf(m, "round_robin=%d\n", sbq->round_robin);
+
+	if (sbq->cache) {
+		seq_puts(m, "cache={");
+		first = true;
+		for_each_possible_cpu(i) {
+			if (!first)
+				seq_puts(m, ", ");
+			first = false;
+			seq_printf(m, "%u", per_cpu_ptr(sbq->cache, i)->nr);
+		}
+		seq_puts(m, "}\n");
+	}
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_show);
@@ -0,0 +1,280 @@
+/*
+ * call_prcu() enqueue cost
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * A kthread_worker bound to each of the first nr_threads online CPUs
+ * queues nr_cbs callbacks back to back, and the average time per enqueue
+ * is reported for:
+ *
+ *   irqsave	- the former call_prcu() enqueue, a version allocation and
+ *		  an append to a tail-pointer list with IRQs disabled
+ *   llist	- the current one, the same allocation and an llist_add()
+ *		  to a staging list with preemption disabled
+ *   call_prcu	- call_prcu() itself, which also arms the grace-period work
+ *
+ * The first two are replicas run on private lists of each CPU, so
+ * that they only differ in the enqueue itself; their callbacks are never
+ * invoked.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/llist.h>
+#include <linux/module.h>
+#include <linux/prcu.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+static unsigned int nr_cbs = 100000;
+module_param(nr_cbs, uint, 0);
+MODULE_PARM_DESC(nr_cbs, "Number of callbacks queued by each CPU (default: 100000)");
+
+static unsigned int nr_threads;
+module_param(nr_threads, uint, 0);
+MODULE_PARM_DESC(nr_threads, "Number of CPUs queuing callbacks (default: all online CPUs)");
+
+/* Mirrors struct prcu_version_head. */
+struct prcu_bench_version {
+	unsigned long long version;
+	union {
+		struct prcu_bench_version *next;
+		struct llist_node llnode;
+	};
+	struct rcu_head *head;
+};
+
+/*
+ * A kthread_worker bound to one CPU, and the private lists the replicas
+ * queue to on it.
+ */
+struct prcu_bench_cpu {
+	struct kthread_worker *worker;
+	struct kthread_work work;
+	const struct prcu_bench_flavor *flavor;
+	struct rcu_head *heads;
+	u64 duration;
+
+	/* irqsave */
+	struct rcu_head *cb_head, **cb_tail;
+	struct prcu_bench_version *version_head, **version_tail;
+
+	/* llist */
+	struct llist_head pending;
+};
+
+/*
+ * ->enqueue() queues one callback on @pc's CPU, ->drain() frees what the
+ * replicas queued once the run is over.
+ */
+struct prcu_bench_flavor {
+	const char *name;
+	int (*enqueue)(struct prcu_bench_cpu *pc, struct rcu_head *head);
+	void (*drain)(struct prcu_bench_cpu *pc);
+};
+
+static atomic_t nr_invoked;
+
+static void prcu_bench_cb(struct rcu_head *rhp)
+{
+	atomic_inc(&nr_invoked);
+}
+
+static struct prcu_bench_version *prcu_bench_version(struct rcu_head *head)
+{
+	struct prcu_bench_version *vhp;
+
+	vhp = kmalloc(sizeof(*vhp), GFP_ATOMIC);
+	if (!vhp)
+		return NULL;
+	head->func = prcu_bench_cb;
+	head->next = NULL;
+	vhp->head = head;
+	vhp->next = NULL;
+	return vhp;
+}
+
+static int prcu_bench_irqsave(struct prcu_bench_cpu *pc,
+			      struct rcu_head *head)
+{
+	struct prcu_bench_version *vhp = prcu_bench_version(head);
+	unsigned long flags;
+
+	if (!vhp)
+		return -ENOMEM;
+
+	local_irq_save(flags);
+	vhp->version = 0;
+	*pc->cb_tail = head;
+	pc->cb_tail = &head->next;
+	*pc->version_tail = vhp;
+	pc->version_tail = &vhp->next;
+	local_irq_restore(flags);
+	return 0;
+}
+
+static void prcu_bench_irqsave_drain(struct prcu_bench_cpu *pc)
+{
+	struct prcu_bench_version *vhp, *next;
+
+	for (vhp = pc->version_head; vhp; vhp = next) {
+		next = vhp->next;
+		kfree(vhp);
+	}
+	pc->version_head = NULL;
+	pc->version_tail = &pc->version_head;
+	pc->cb_head = NULL;
+	pc->cb_tail = &pc->cb_head;
+}
+
+static int prcu_bench_llist(struct prcu_bench_cpu *pc, struct rcu_head *head)
+{
+	struct prcu_bench_version *vhp = prcu_bench_version(head);
+
+	if (!vhp)
+		return -ENOMEM;
+
+	preempt_disable();
+	vhp->version = 0;
+	llist_add(&vhp->llnode, &pc->pending);
+	preempt_enable();
+	return 0;
+}
+
+static void prcu_bench_llist_drain(struct prcu_bench_cpu *pc)
+{
+	struct prcu_bench_version *vhp, *next;
+
+	llist_for_each_entry_safe(vhp, next, llist_del_all(&pc->pending),
+				  llnode)
+		kfree(vhp);
+}
+
+static int prcu_bench_call_prcu(struct prcu_bench_cpu *pc,
+				struct rcu_head *head)
+{
+	call_prcu(head, prcu_bench_cb);
+	return 0;
+}
+
+static const struct prcu_bench_flavor prcu_bench_flavors[] __initconst = {
+	{ "irqsave",	prcu_bench_irqsave,	prcu_bench_irqsave_drain },
+	{ "llist",	prcu_bench_llist,	prcu_bench_llist_drain },
+	{ "call_prcu",	prcu_bench_call_prcu,	NULL },
+};
+
+static void prcu_bench_workfn(struct kthread_work *work)
+{
+	struct prcu_bench_cpu *pc = container_of(work, struct prcu_bench_cpu,
+						 work);
+	unsigned int i;
+	u64 start;
+
+	start = ktime_get_ns();
+	for (i = 0; i < nr_cbs; i++) {
+		if (pc->flavor->enqueue(pc, &pc->heads[i]))
+			break;
+	}
+	pc->duration = ktime_get_ns() - start;
+	if (pc->flavor->drain)
+		pc->flavor->drain(pc);
+}
+
+/* Queue the run of @flavor on every worker at once and wait for them */
+static void __init prcu_bench_run(const struct prcu_bench_flavor *flavor,
+				  struct prcu_bench_cpu *pcs, unsigned int n)
+{
+	u64 duration = 0;
+	unsigned int i;
+
+	atomic_set(&nr_invoked, 0);
+	for (i = 0; i < n; i++) {
+		pcs[i].flavor = flavor;
+		kthread_init_work(&pcs[i].work, prcu_bench_workfn);
+		kthread_queue_work(pcs[i].worker, &pcs[i].work);
+	}
+	for (i = 0; i < n; i++) {
+		kthread_flush_work(&pcs[i].work);
+		duration += pcs[i].duration;
+	}
+
+	pr_info("%s: %llu ns per enqueue on %u cpus\n", flavor->name,
+		div64_u64(duration, (u64)n * nr_cbs), n);
+}
+
+static int __init test_call_prcu_init(void)
+{
+	const struct prcu_bench_flavor *flavor;
+	struct prcu_bench_cpu *pcs, *pc;
+	unsigned int i, n = 0, cpu;
+	int err = 0;
+
+	if (!nr_cbs)
+		return -EINVAL;
+	if (!nr_threads || nr_threads > num_online_cpus())
+		nr_threads = num_online_cpus();
+
+	pcs = kcalloc(nr_threads, sizeof(*pcs), GFP_KERNEL);
+	if (!pcs)
+		return -ENOMEM;
+
+	for_each_online_cpu(cpu) {
+		if (n == nr_threads)
+			break;
+		pc = &pcs[n];
+		pc->cb_tail = &pc->cb_head;
+		pc->version_tail = &pc->version_head;
+		init_llist_head(&pc->pending);
+		pc->heads = vzalloc(nr_cbs * sizeof(*pc->heads));
+		if (!pc->heads) {
+			err = -ENOMEM;
+			break;
+		}
+		pc->worker = kthread_create_worker_on_cpu(cpu, 0,
+							  "call_prcu_bench/%u",
+							  cpu);
+		if (IS_ERR(pc->worker)) {
+			err = PTR_ERR(pc->worker);
+			vfree(pc->heads);
+			break;
+		}
+		n++;
+	}
+
+	if (!err) {
+		for (flavor = prcu_bench_flavors;
+		     flavor < prcu_bench_flavors +
+			      ARRAY_SIZE(prcu_bench_flavors);
+		     flavor++)
+			prcu_bench_run(flavor, pcs, n);
+
+		/* The heads must outlive their callbacks. */
+		prcu_barrier();
+	}
+
+	for (i = 0; i < n; i++) {
+		kthread_destroy_worker(pcs[i].worker);
+		vfree(pcs[i].heads);
+	}
+	kfree(pcs);
+	return err;
+}
+
+static void __exit test_call_prcu_exit(void)
+{
+}
+
+module_init(test_call_prcu_init);
+module_exit(test_call_prcu_exit);
+
+MODULE_LICENSE("GPL v2");
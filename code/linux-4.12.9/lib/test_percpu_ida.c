@@ -0,0 +1,271 @@
+/*
+ * Tag allocation throughput of percpu_ida
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Two patterns are measured, each with a work item running for the whole
+ * run on each of the first 2 * nr_pairs online CPUs:
+ *
+ *   balanced	- every CPU allocates a window of tags and frees them
+ *		  again itself
+ *   imbalanced	- half of the CPUs only allocate tags and pass them
+ *		  through a ring to a partner CPU, which frees them;
+ *		  this is what a SCSI target does when commands are
+ *		  received on one CPU and completed on another
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/cpumask.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/percpu_ida.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+static unsigned int nr_tags = 1024;
+module_param(nr_tags, uint, 0);
+MODULE_PARM_DESC(nr_tags, "Number of tags in the pool (default: 1024)");
+
+static unsigned int nr_pairs;
+module_param(nr_pairs, uint, 0);
+MODULE_PARM_DESC(nr_pairs, "Number of allocating/freeing CPU pairs (default: half of the online CPUs)");
+
+static unsigned int window = 16;
+module_param(window, uint, 0);
+MODULE_PARM_DESC(window, "Tags held by each CPU at a time in the balanced run (default: 16)");
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0);
+MODULE_PARM_DESC(duration_ms, "Duration of each run in ms (default: 1000)");
+
+/* tags in flight between a producer and its consumer, a power of two */
+#define IDA_BENCH_RING_SIZE	256
+
+/* single producer, single consumer */
+struct ida_bench_ring {
+	unsigned int		head ____cacheline_aligned_in_smp;
+	unsigned int		tail ____cacheline_aligned_in_smp;
+	unsigned int		tags[IDA_BENCH_RING_SIZE];
+};
+
+/*
+ * Work item queued on one CPU for the whole run.  Balanced ones hold a
+ * window of @tags, imbalanced ones share a @ring with their partner.
+ */
+struct ida_bench_work {
+	struct work_struct	work;
+	struct ida_bench_ring	*ring;
+	unsigned int		*tags;
+	unsigned long		nr_tags;
+	unsigned long		failed;
+};
+
+static struct percpu_ida pool;
+static struct workqueue_struct *ida_bench_wq;
+static ktime_t ida_bench_end;
+
+/*
+ * The work items return by themselves once the run is over, so there is
+ * nothing to stop.  The clock is only read every 1024 loops.
+ */
+static bool ida_bench_more(unsigned long *loops)
+{
+	if (++*loops & 0x3ff)
+		return true;
+	cond_resched();
+	return ktime_before(ktime_get(), ida_bench_end);
+}
+
+static void ida_bench_balanced(struct work_struct *work)
+{
+	struct ida_bench_work *bw = container_of(work, struct ida_bench_work,
+						 work);
+	unsigned long loops = 0;
+	unsigned int i, n;
+	int tag;
+
+	while (ida_bench_more(&loops)) {
+		for (n = 0; n < window; n++) {
+			tag = percpu_ida_alloc(&pool, TASK_RUNNING);
+			if (tag < 0) {
+				bw->failed++;
+				break;
+			}
+			bw->tags[n] = tag;
+		}
+		for (i = 0; i < n; i++)
+			percpu_ida_free(&pool, bw->tags[i]);
+		bw->nr_tags += n;
+	}
+}
+
+static void ida_bench_produce(struct work_struct *work)
+{
+	struct ida_bench_work *bw = container_of(work, struct ida_bench_work,
+						 work);
+	struct ida_bench_ring *ring = bw->ring;
+	unsigned long loops = 0;
+	unsigned int head;
+	int tag;
+
+	while (ida_bench_more(&loops)) {
+		/* wait for the consumer to make room, it may be behind */
+		head = ring->head;
+		if (head - smp_load_acquire(&ring->tail) ==
+		    IDA_BENCH_RING_SIZE) {
+			cpu_relax();
+			continue;
+		}
+
+		tag = percpu_ida_alloc(&pool, TASK_RUNNING);
+		if (tag < 0) {
+			bw->failed++;
+			cpu_relax();
+			continue;
+		}
+		ring->tags[head & (IDA_BENCH_RING_SIZE - 1)] = tag;
+		smp_store_release(&ring->head, head + 1);
+		bw->nr_tags++;
+	}
+}
+
+static void ida_bench_consume(struct work_struct *work)
+{
+	struct ida_bench_work *bw = container_of(work, struct ida_bench_work,
+						 work);
+	struct ida_bench_ring *ring = bw->ring;
+	unsigned long loops = 0;
+	unsigned int tail, tag;
+
+	while (ida_bench_more(&loops)) {
+		tail = ring->tail;
+		if (tail == smp_load_acquire(&ring->head)) {
+			cpu_relax();
+			continue;
+		}
+
+		tag = ring->tags[tail & (IDA_BENCH_RING_SIZE - 1)];
+		smp_store_release(&ring->tail, tail + 1);
+		percpu_ida_free(&pool, tag);
+	}
+}
+
+/*
+ * Queue one work item on each of the first 2 * nr_pairs online CPUs.  In
+ * the imbalanced run, the item on the i-th CPU allocates and the one
+ * nr_pairs CPUs later frees what it allocated.
+ */
+static int __init ida_bench_run(bool imbalanced)
+{
+	unsigned int nr_works = 2 * nr_pairs;
+	struct ida_bench_ring *rings = NULL;
+	struct ida_bench_work *works;
+	unsigned long nr = 0, failed = 0;
+	unsigned int i = 0, cpu;
+	int err;
+
+	err = percpu_ida_init(&pool, nr_tags);
+	if (err)
+		return err;
+
+	works = kcalloc(nr_works, sizeof(*works), GFP_KERNEL);
+	if (!works) {
+		err = -ENOMEM;
+		goto out_destroy;
+	}
+	if (imbalanced) {
+		rings = kcalloc(nr_pairs, sizeof(*rings), GFP_KERNEL);
+		if (!rings) {
+			err = -ENOMEM;
+			goto out_free;
+		}
+		for (i = 0; i < nr_works; i++) {
+			works[i].ring = &rings[i % nr_pairs];
+			INIT_WORK(&works[i].work, i < nr_pairs ?
+				  ida_bench_produce : ida_bench_consume);
+		}
+	} else {
+		for (i = 0; i < nr_works; i++) {
+			works[i].tags = kcalloc(window, sizeof(*works[i].tags),
+						GFP_KERNEL);
+			if (!works[i].tags) {
+				err = -ENOMEM;
+				goto out_free;
+			}
+			INIT_WORK(&works[i].work, ida_bench_balanced);
+		}
+	}
+
+	ida_bench_end = ktime_add_ms(ktime_get(), duration_ms);
+	i = 0;
+	for_each_online_cpu(cpu) {
+		if (i == nr_works)
+			break;
+		queue_work_on(cpu, ida_bench_wq, &works[i++].work);
+	}
+	flush_workqueue(ida_bench_wq);
+
+	for (i = 0; i < nr_works; i++) {
+		nr += works[i].nr_tags;
+		failed += works[i].failed;
+	}
+	pr_info("%s: %llu tags/s on %u cpus, %lu failed allocs\n",
+		imbalanced ? "imbalanced" : "balanced",
+		div_u64((u64)nr * MSEC_PER_SEC, duration_ms), nr_works,
+		failed);
+
+out_free:
+	for (i = 0; i < nr_works; i++)
+		kfree(works[i].tags);
+	kfree(rings);
+	kfree(works);
+out_destroy:
+	percpu_ida_destroy(&pool);
+	return err;
+}
+
+static int __init test_percpu_ida_init(void)
+{
+	int err;
+
+	if (!nr_tags || !window || !duration_ms)
+		return -EINVAL;
+	if (!nr_pairs)
+		nr_pairs = num_online_cpus() / 2;
+	if (!nr_pairs || 2 * nr_pairs > num_online_cpus()) {
+		pr_err("need at least %u online cpus\n", 2 * max(nr_pairs, 1U));
+		return -EINVAL;
+	}
+
+	/* bound to the CPU each item is queued on, and not throttled */
+	ida_bench_wq = alloc_workqueue("percpu_ida_bench", WQ_CPU_INTENSIVE,
+				       0);
+	if (!ida_bench_wq)
+		return -ENOMEM;
+
+	pr_info("%u tags, %u cpu pairs, %u ms per run\n", nr_tags, nr_pairs,
+		duration_ms);
+
+	err = ida_bench_run(false);
+	if (!err)
+		err = ida_bench_run(true);
+
+	destroy_workqueue(ida_bench_wq);
+	return err;
+}
+
+static void __exit test_percpu_ida_exit(void)
+{
+}
+
+module_init(test_percpu_ida_init);
+module_exit(test_percpu_ida_exit);
+
+MODULE_LICENSE("GPL v2");
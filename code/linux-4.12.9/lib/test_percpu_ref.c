@@ -0,0 +1,137 @@
+/*
+ * Bulk percpu_ref kill latency
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Kill nr_refs percpu refs back to back with percpu_ref_kill_and_confirm()
+ * and measure how long it takes until all of them are confirmed and until
+ * all of them are released, once with a switch callback per ref and once
+ * with PERCPU_REF_INIT_BATCH.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/percpu-refcount.h>
+#include <linux/vmalloc.h>
+
+static unsigned int nr_refs = 10000;
+module_param(nr_refs, uint, 0);
+MODULE_PARM_DESC(nr_refs, "Number of refs to kill (default: 10000)");
+
+static unsigned int runs = 3;
+module_param(runs, uint, 0);
+MODULE_PARM_DESC(runs, "Number of runs per flavor (default: 3)");
+
+static struct percpu_ref *refs;
+static atomic_t nr_unconfirmed, nr_unreleased;
+static DECLARE_COMPLETION(all_confirmed);
+static DECLARE_COMPLETION(all_released);
+
+static void test_ref_confirm(struct percpu_ref *ref)
+{
+	if (atomic_dec_and_test(&nr_unconfirmed))
+		complete(&all_confirmed);
+}
+
+static void test_ref_release(struct percpu_ref *ref)
+{
+	if (atomic_dec_and_test(&nr_unreleased))
+		complete(&all_released);
+}
+
+static int __init test_percpu_ref_run(unsigned int flags, u64 *confirm_ns,
+				      u64 *release_ns)
+{
+	unsigned int i;
+	u64 start;
+	int err;
+
+	for (i = 0; i < nr_refs; i++) {
+		err = percpu_ref_init(&refs[i], test_ref_release, flags,
+				      GFP_KERNEL);
+		if (err)
+			goto out_exit;
+		/* take a ref like a user would, dropped after the kill */
+		percpu_ref_get(&refs[i]);
+	}
+
+	atomic_set(&nr_unconfirmed, nr_refs);
+	atomic_set(&nr_unreleased, nr_refs);
+	reinit_completion(&all_confirmed);
+	reinit_completion(&all_released);
+
+	start = ktime_get_ns();
+	for (i = 0; i < nr_refs; i++)
+		percpu_ref_kill_and_confirm(&refs[i], test_ref_confirm);
+	wait_for_completion(&all_confirmed);
+	*confirm_ns = ktime_get_ns() - start;
+
+	for (i = 0; i < nr_refs; i++)
+		percpu_ref_put(&refs[i]);
+	wait_for_completion(&all_released);
+	*release_ns = ktime_get_ns() - start;
+	err = 0;
+
+out_exit:
+	while (i--)
+		percpu_ref_exit(&refs[i]);
+	return err;
+}
+
+static int __init test_percpu_ref_init(void)
+{
+	static const struct {
+		const char *name;
+		unsigned int flags;
+	} flavors[] = {
+		{ "per-ref", 0 },
+		{ "batch", PERCPU_REF_INIT_BATCH },
+	};
+	u64 confirm_ns, release_ns;
+	unsigned int f, r;
+	int err = 0;
+
+	if (!nr_refs)
+		return -EINVAL;
+
+	refs = vzalloc(nr_refs * sizeof(*refs));
+	if (!refs)
+		return -ENOMEM;
+
+	for (f = 0; f < ARRAY_SIZE(flavors); f++) {
+		for (r = 0; r < runs; r++) {
+			err = test_percpu_ref_run(flavors[f].flags, &confirm_ns,
+						  &release_ns);
+			if (err) {
+				pr_err("%s: init failed: %d\n",
+				       flavors[f].name, err);
+				goto out;
+			}
+			pr_info("%-7s %u refs: confirmed in %llu us, released in %llu us\n",
+				flavors[f].name, nr_refs,
+				div_u64(confirm_ns, NSEC_PER_USEC),
+				div_u64(release_ns, NSEC_PER_USEC));
+		}
+	}
+out:
+	vfree(refs);
+	return err;
+}
+
+static void __exit test_percpu_ref_exit(void)
+{
+}
+
+module_init(test_percpu_ref_init);
+module_exit(test_percpu_ref_exit);
+
+MODULE_LICENSE("GPL v2");
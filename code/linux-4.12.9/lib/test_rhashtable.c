@@ -18,6 +18,7 @@
 #include <linux/kernel.h>
 #include <linux/kthread.h>
 #include <linux/module.h>
+#include <linux/random.h>
 #include <linux/rcupdate.h>
 #include <linux/rhashtable.h>
 #include <linux/semaphore.h>
@@ -56,6 +57,14 @@ static bool enomem_retry = false;
 module_param(enomem_retry, bool, 0);
 MODULE_PARM_DESC(enomem_retry, "Retry insert even if -ENOMEM was returned (default: off)");
 
+static bool prcu = false;
+module_param(prcu, bool, 0);
+MODULE_PARM_DESC(prcu, "Protect tables with PRCU instead of RCU (default: off)");
+
+static int bench_ms = 0;
+module_param(bench_ms, int, 0);
+MODULE_PARM_DESC(bench_ms, "Duration of lookup/resize benchmark per flavor in ms (default: 0, off)");
+
 struct test_obj {
 	int			value;
 	struct rhash_head	node;
@@ -67,6 +76,12 @@ struct thread_data {
 	struct test_obj *objs;
 };
 
+struct bench_data {
+	struct task_struct *task;
+	unsigned long lookups;
+	unsigned long misses;
+};
+
 static struct test_obj array[MAX_ENTRIES];
 
 static struct rhashtable_params test_rht_params = {
@@ -131,7 +146,9 @@ static int __init test_rht_lookup(struct rhashtable *ht)
 			}
 		}
 
-		cond_resched_rcu();
+		rhashtable_read_unlock(ht);
+		cond_resched();
+		rhashtable_read_lock(ht);
 	}
 
 	return 0;
@@ -208,9 +225,9 @@ static s64 __init test_rhashtable(struct rhashtable *ht)
 			insert_retries);
 
 	test_bucket_stats(ht);
-	rcu_read_lock();
+	rhashtable_read_lock(ht);
 	test_rht_lookup(ht);
-	rcu_read_unlock();
+	rhashtable_read_unlock(ht);
 
 	test_bucket_stats(ht);
 
@@ -323,6 +340,199 @@ out:
 	return err;
 }
 
+static bool bench_stop;
+
+static int bench_lookup_thread(void *data)
+{
+	struct bench_data *bdata = data;
+	struct test_obj *obj;
+	int key;
+
+	up(&prestart_sem);
+	if (down_interruptible(&startup_sem))
+		pr_err("  bench thread: down_interruptible failed\n");
+
+	while (!READ_ONCE(bench_stop)) {
+		/* Keys of the resident entries are even. */
+		key = prandom_u32_max(entries) * 2;
+		obj = rhashtable_lookup_fast(&ht, &key, test_rht_params);
+		if (!obj || obj->value != key)
+			bdata->misses++;
+		if (!(++bdata->lookups & 0x3ff))
+			cond_resched();
+	}
+
+	/*
+	 * kthread_stop() follows bench_stop closely, so the state has to be
+	 * set before the flag is tested for its wakeup not to be lost.
+	 */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static unsigned int rht_table_size(struct rhashtable *ht)
+{
+	unsigned int size;
+
+	rhashtable_read_lock(ht);
+	size = rht_dereference_rcu(ht->tbl, ht)->size;
+	rhashtable_read_unlock(ht);
+	return size;
+}
+
+/*
+ * Measure lookup throughput of tcount threads while the table is
+ * repeatedly grown and shrunk by adding and removing a second batch of
+ * entries.  The resize latency is the time from the end of a batch until
+ * the deferred rehash has completed, and the reclaim latency is the time
+ * for the replaced bucket tables to be freed after a grace period.
+ */
+static int __init test_rht_bench(bool use_prcu)
+{
+	unsigned int i, phase, size, resizes = 0, cycles = 0;
+	unsigned long lookups = 0, misses = 0;
+	u64 rehash_ns = 0, reclaim_ns = 0;
+	struct bench_data *bdata;
+	unsigned long end;
+	s64 start, t, duration;
+	int err;
+
+	test_rht_params.prcu = use_prcu;
+	test_rht_params.automatic_shrinking = true;
+	test_rht_params.max_size = max_size ? : roundup_pow_of_two(4 * entries);
+
+	bdata = vzalloc(max(tcount, 1) * sizeof(struct bench_data));
+	if (!bdata)
+		return -ENOMEM;
+
+	memset(&array, 0, sizeof(array));
+	err = rhashtable_init(&ht, &test_rht_params);
+	if (err < 0) {
+		pr_warn("Test failed: Unable to initialize hashtable: %d\n",
+			err);
+		vfree(bdata);
+		return err;
+	}
+
+	for (i = 0; i < entries; i++) {
+		array[i].value = i * 2;
+		err = insert_retry(&ht, &array[i].node, test_rht_params);
+		if (err < 0) {
+			pr_warn("Test failed: insertion failed: %d\n", err);
+			goto out;
+		}
+	}
+	while (flush_work(&ht.run_work))
+		;
+
+	WRITE_ONCE(bench_stop, false);
+	sema_init(&prestart_sem, 1 - tcount);
+	sema_init(&startup_sem, 0);
+	for (i = 0; i < tcount; i++) {
+		bdata[i].task = kthread_run(bench_lookup_thread, &bdata[i],
+					    "rhashtable_bench[%d]", i);
+		if (IS_ERR(bdata[i].task)) {
+			pr_err(" kthread_run failed for thread %d\n", i);
+			up(&prestart_sem);
+		}
+	}
+	if (down_interruptible(&prestart_sem))
+		pr_err("  down interruptible failed\n");
+	for (i = 0; i < tcount; i++)
+		up(&startup_sem);
+
+	start = ktime_get_ns();
+	end = jiffies + msecs_to_jiffies(bench_ms);
+	do {
+		for (phase = 0; phase < 2; phase++) {
+			size = rht_table_size(&ht);
+			for (i = entries; i < 2 * entries; i++) {
+				struct test_obj *obj = &array[i];
+
+				if (!phase) {
+					obj->value = (i - entries) * 2 + 1;
+					if (insert_retry(&ht, &obj->node,
+							 test_rht_params) < 0)
+						obj->value = TEST_INSERT_FAIL;
+				} else if (obj->value != TEST_INSERT_FAIL) {
+					rhashtable_remove_fast(&ht, &obj->node,
+							       test_rht_params);
+				}
+				cond_resched();
+			}
+			t = ktime_get_ns();
+			while (flush_work(&ht.run_work))
+				;
+			if (rht_table_size(&ht) != size) {
+				rehash_ns += ktime_get_ns() - t;
+				resizes++;
+			}
+		}
+		t = ktime_get_ns();
+		rhashtable_barrier(&ht);
+		reclaim_ns += ktime_get_ns() - t;
+		cycles++;
+
+		/*
+		 * The removed objects are inserted again next cycle, and a
+		 * reader still standing on one would follow its new ->next
+		 * into another chain.  rhashtable_barrier() only waits for
+		 * callbacks, so wait for the readers as well.
+		 */
+		if (use_prcu)
+			synchronize_prcu();
+		else
+			synchronize_rcu();
+	} while (time_before(jiffies, end));
+	duration = ktime_get_ns() - start;
+
+	WRITE_ONCE(bench_stop, true);
+	for (i = 0; i < tcount; i++) {
+		if (IS_ERR(bdata[i].task))
+			continue;
+		kthread_stop(bdata[i].task);
+		lookups += bdata[i].lookups;
+		misses += bdata[i].misses;
+	}
+
+	pr_info("  %s: %llu lookups/s from %d threads, %lu misses, %u resizes avg %llu ns, %u reclaims avg %llu ns\n",
+		use_prcu ? "prcu" : "rcu",
+		div64_u64((u64)lookups * MSEC_PER_SEC,
+			  max_t(u64, div_u64(duration, NSEC_PER_MSEC), 1)),
+		tcount, misses,
+		resizes, resizes ? div_u64(rehash_ns, resizes) : 0,
+		cycles, div_u64(reclaim_ns, cycles));
+	if (misses)
+		pr_warn("Test failed: resident entries not found ^^^\n");
+	err = 0;
+out:
+	rhashtable_destroy(&ht);
+	rhashtable_barrier(&ht);
+	vfree(bdata);
+	return err;
+}
+
+static int __init test_rht_bench_all(void)
+{
+	int err;
+
+	if (!bench_ms)
+		return 0;
+
+	entries = min(entries, MAX_ENTRIES / 2);
+	pr_info("Benchmarking lookups during resizes for %d ms per flavor\n",
+		bench_ms);
+	err = test_rht_bench(false);
+	if (!err)
+		err = test_rht_bench(true);
+	return err;
+}
+
 static int __init test_rht_init(void)
 {
 	int i, err, started_threads = 0, failed_threads = 0;
@@ -335,9 +545,10 @@ static int __init test_rht_init(void)
 	test_rht_params.automatic_shrinking = shrinking;
 	test_rht_params.max_size = max_size ? : roundup_pow_of_two(entries);
 	test_rht_params.nelem_hint = size;
+	test_rht_params.prcu = prcu;
 
-	pr_info("Running rhashtable test nelem=%d, max_size=%d, shrinking=%d\n",
-		size, max_size, shrinking);
+	pr_info("Running rhashtable test nelem=%d, max_size=%d, shrinking=%d, prcu=%d\n",
+		size, max_size, shrinking, prcu);
 
 	for (i = 0; i < runs; i++) {
 		s64 time;
@@ -365,7 +576,7 @@ static int __init test_rht_init(void)
 	pr_info("Average test time: %llu\n", total_time);
 
 	if (!tcount)
-		return 0;
+		return test_rht_bench_all();
 
 	pr_info("Testing concurrent rhashtable access from %d threads\n",
 	        tcount);
@@ -417,7 +628,7 @@ static int __init test_rht_init(void)
 	rhashtable_destroy(&ht);
 	vfree(tdata);
 	vfree(objs);
-	return 0;
+	return test_rht_bench_all();
 }
 
 static void __exit test_rht_exit(void)
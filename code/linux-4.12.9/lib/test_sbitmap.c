@@ -0,0 +1,264 @@
+/*
+ * Tag allocation throughput of sbitmap_queue
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Each thread is bound to its own CPU and repeatedly allocates a window of
+ * tags and frees them again, the way a submitter with a few requests in
+ * flight would.  Three flavors are compared for an increasing number of
+ * CPUs:
+ *
+ *   single	- __sbitmap_queue_get()/sbitmap_queue_clear() per tag
+ *   batch	- __sbitmap_queue_get_batch()/sbitmap_queue_clear_batch()
+ *   cached	- as single, with sbitmap_queue_enable_cache()
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/sbitmap.h>
+#include <linux/slab.h>
+
+static unsigned int depth;
+module_param(depth, uint, 0);
+MODULE_PARM_DESC(depth, "Number of tags (default: enough to enable the cache on all CPUs)");
+
+static unsigned int window = SBQ_CACHE_BATCH;
+module_param(window, uint, 0);
+MODULE_PARM_DESC(window, "Tags held by each thread at a time (default: 8)");
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0);
+MODULE_PARM_DESC(duration_ms, "Duration of each run in ms (default: 1000)");
+
+/*
+ * A way of taking tags from and returning them to a sbitmap_queue.  ->get()
+ * fills in up to window tags and returns how many it got.
+ */
+struct sbq_bench_flavor {
+	const char *name;
+	bool cache;
+	unsigned int (*get)(struct sbitmap_queue *sbq, unsigned int *tags);
+	void (*put)(struct sbitmap_queue *sbq, unsigned int *tags,
+		    unsigned int nr);
+};
+
+static unsigned int sbq_get_single(struct sbitmap_queue *sbq,
+				   unsigned int *tags)
+{
+	unsigned int n;
+	int nr;
+
+	preempt_disable();
+	for (n = 0; n < window; n++) {
+		nr = __sbitmap_queue_get(sbq);
+		if (nr < 0)
+			break;
+		tags[n] = nr;
+	}
+	preempt_enable();
+	return n;
+}
+
+static void sbq_put_single(struct sbitmap_queue *sbq, unsigned int *tags,
+			   unsigned int nr)
+{
+	unsigned int cpu = raw_smp_processor_id();
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		sbitmap_queue_clear(sbq, tags[i], cpu);
+}
+
+static unsigned int sbq_get_batch(struct sbitmap_queue *sbq,
+				  unsigned int *tags)
+{
+	unsigned int offset, n = 0;
+	unsigned long mask;
+
+	preempt_disable();
+	while (n < window) {
+		mask = __sbitmap_queue_get_batch(sbq, window - n, &offset);
+		if (!mask)
+			break;
+		for (; mask; mask &= mask - 1)
+			tags[n++] = offset + __ffs(mask);
+	}
+	preempt_enable();
+	return n;
+}
+
+static void sbq_put_batch(struct sbitmap_queue *sbq, unsigned int *tags,
+			  unsigned int nr)
+{
+	sbitmap_queue_clear_batch(sbq, tags, nr, raw_smp_processor_id());
+}
+
+static const struct sbq_bench_flavor sbq_bench_flavors[] __initconst = {
+	{ "single",	false,	sbq_get_single,	sbq_put_single },
+	{ "batch",	false,	sbq_get_batch,	sbq_put_batch },
+	{ "cached",	true,	sbq_get_single,	sbq_put_single },
+};
+
+/* A kthread bound to one CPU, taking and returning tags until stopped */
+struct sbq_bench_worker {
+	struct task_struct *task;
+	struct sbitmap_queue *sbq;
+	const struct sbq_bench_flavor *flavor;
+	unsigned int *tags;
+	unsigned long nr_tags;
+	unsigned long failed;
+	u64 ns;
+};
+
+static int sbq_bench_fn(void *data)
+{
+	struct sbq_bench_worker *w = data;
+	u64 start = ktime_get_ns();
+	unsigned int n;
+
+	/*
+	 * Spin until kthread_stop() rather than on a flag of our own, so
+	 * there is no sleep to miss its wakeup.
+	 */
+	while (!kthread_should_stop()) {
+		n = w->flavor->get(w->sbq, w->tags);
+		if (!n)
+			w->failed++;
+		w->flavor->put(w->sbq, w->tags, n);
+		w->nr_tags += n;
+		if (!(w->nr_tags & 0x3ff))
+			cond_resched();
+	}
+	w->ns = ktime_get_ns() - start;
+	return 0;
+}
+
+/*
+ * Run @flavor on the first @nr_cpus online CPUs.  Each worker is timed up
+ * to its own kthread_stop(), and the rates of all of them are added up.
+ */
+static int __init sbq_bench(const struct sbq_bench_flavor *flavor,
+			    unsigned int nr_cpus)
+{
+	struct sbq_bench_worker *workers, *w;
+	struct sbitmap_queue sbq;
+	unsigned long failed = 0;
+	unsigned int i, nr = 0, cpu;
+	u64 rate = 0;
+	int err;
+
+	err = sbitmap_queue_init_node(&sbq, depth, -1, false, GFP_KERNEL,
+				      NUMA_NO_NODE);
+	if (err)
+		return err;
+	if (flavor->cache) {
+		err = sbitmap_queue_enable_cache(&sbq, GFP_KERNEL);
+		if (err)
+			goto out_free_sbq;
+	}
+
+	workers = kcalloc(nr_cpus, sizeof(*workers), GFP_KERNEL);
+	if (!workers) {
+		err = -ENOMEM;
+		goto out_free_sbq;
+	}
+
+	for_each_online_cpu(cpu) {
+		if (nr == nr_cpus)
+			break;
+		w = &workers[nr];
+		w->sbq = &sbq;
+		w->flavor = flavor;
+		w->tags = kcalloc(window, sizeof(*w->tags), GFP_KERNEL);
+		if (!w->tags) {
+			err = -ENOMEM;
+			break;
+		}
+		w->task = kthread_create(sbq_bench_fn, w, "sbitmap_bench/%u",
+					 cpu);
+		if (IS_ERR(w->task)) {
+			err = PTR_ERR(w->task);
+			kfree(w->tags);
+			break;
+		}
+		kthread_bind(w->task, cpu);
+		nr++;
+	}
+
+	/* kthread_stop() on a worker that never ran just reaps it */
+	if (!err) {
+		for (i = 0; i < nr; i++)
+			wake_up_process(workers[i].task);
+		msleep(duration_ms);
+	}
+
+	for (i = 0; i < nr; i++) {
+		w = &workers[i];
+		kthread_stop(w->task);
+		if (w->ns)
+			rate += div64_u64((u64)w->nr_tags * NSEC_PER_SEC, w->ns);
+		failed += w->failed;
+		kfree(w->tags);
+	}
+	kfree(workers);
+
+	if (!err)
+		pr_info("%s: %u cpus, %llu tags/s, %lu failed gets\n",
+			flavor->name, nr, rate, failed);
+
+out_free_sbq:
+	sbitmap_queue_free(&sbq);
+	return err;
+}
+
+static int __init test_sbitmap_init(void)
+{
+	const struct sbq_bench_flavor *flavor;
+	unsigned int nr_cpus = num_online_cpus();
+	unsigned int nr;
+	int err;
+
+	if (!window || window > BITS_PER_LONG)
+		return -EINVAL;
+	if (!depth)
+		depth = max(1024U, 2 * SBQ_CACHE_SIZE * nr_cpu_ids);
+
+	pr_info("depth %u, window %u, %u ms per run\n", depth, window,
+		duration_ms);
+
+	for (flavor = sbq_bench_flavors;
+	     flavor < sbq_bench_flavors + ARRAY_SIZE(sbq_bench_flavors);
+	     flavor++) {
+		for (nr = 1; ; nr = min(nr * 2, nr_cpus)) {
+			err = sbq_bench(flavor, nr);
+			if (err) {
+				pr_err("%s on %u cpus: %d\n", flavor->name,
+				       nr, err);
+				return err;
+			}
+			if (nr == nr_cpus)
+				break;
+		}
+	}
+	return 0;
+}
+
+static void __exit test_sbitmap_exit(void)
+{
+}
+
+module_init(test_sbitmap_init);
+module_exit(test_sbitmap_exit);
+
+MODULE_LICENSE("GPL v2");
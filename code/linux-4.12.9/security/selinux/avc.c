@@ -23,6 +23,12 @@
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
 #include <linux/list.h>
+#include <linux/llist.h>
+#include <linux/prcu.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -44,6 +50,18 @@
 #define avc_cache_stats_incr(field)	do {} while (0)
 #endif
 
+#ifdef CONFIG_SECURITY_SELINUX_AVC_PRCU
+#define avc_read_lock()			prcu_read_lock()
+#define avc_read_unlock()		prcu_read_unlock()
+/* Evicted nodes are handed to call_prcu() in batches of this size */
+#define AVC_RECLAIM_BATCH		64
+/* avc_reclaim_work hands a partial batch over this long after eviction */
+#define AVC_RECLAIM_DELAY		msecs_to_jiffies(10)
+#else
+#define avc_read_lock()			rcu_read_lock()
+#define avc_read_unlock()		rcu_read_unlock()
+#endif
+
 struct avc_entry {
 	u32			ssid;
 	u32			tsid;
@@ -56,6 +74,9 @@ struct avc_node {
 	struct avc_entry	ae;
 	struct hlist_node	list; /* anchored in avc_cache->slots[i] */
 	struct rcu_head		rhead;
+#ifdef CONFIG_SECURITY_SELINUX_AVC_PRCU
+	struct llist_node	reclaim; /* anchored in avc_reclaim_list */
+#endif
 };
 
 struct avc_xperms_decision_node {
@@ -207,7 +228,7 @@ int avc_get_hash_stats(char *page)
 	struct avc_node *node;
 	struct hlist_head *head;
 
-	rcu_read_lock();
+	avc_read_lock();
 
 	slots_used = 0;
 	max_chain_len = 0;
@@ -223,7 +244,7 @@ int avc_get_hash_stats(char *page)
 		}
 	}
 
-	rcu_read_unlock();
+	avc_read_unlock();
 
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
@@ -490,10 +511,70 @@ static void avc_node_free(struct rcu_head *rhead)
 	avc_cache_stats_incr(frees);
 }
 
+#ifdef CONFIG_SECURITY_SELINUX_AVC_PRCU
+static LLIST_HEAD(avc_reclaim_list);
+static atomic_t avc_reclaim_count = ATOMIC_INIT(0);
+
+static void avc_reclaim_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(avc_reclaim_work, avc_reclaim_workfn);
+
+/*
+ * Free a batch of nodes chained through ->reclaim.  Only the rcu_head
+ * of the first node is used for the grace period.
+ */
+static void avc_node_free_batch(struct rcu_head *rhead)
+{
+	struct avc_node *first = container_of(rhead, struct avc_node, rhead);
+	struct avc_node *node, *next;
+
+	llist_for_each_entry_safe(node, next, &first->reclaim, reclaim)
+		avc_node_free(&node->rhead);
+}
+
+static void avc_reclaim_flush(void)
+{
+	struct llist_node *first;
+
+	atomic_set(&avc_reclaim_count, 0);
+	first = llist_del_all(&avc_reclaim_list);
+	if (first)
+		call_prcu(&llist_entry(first, struct avc_node, reclaim)->rhead,
+			  avc_node_free_batch);
+}
+
+static void avc_reclaim_workfn(struct work_struct *work)
+{
+	avc_reclaim_flush();
+}
+
+/*
+ * Free an unlinked node after a PRCU grace period.  Nodes are batched so
+ * that cache reclaim and policy reloads issue one call_prcu() per
+ * AVC_RECLAIM_BATCH nodes rather than one callback per node.
+ */
+static void avc_node_retire(struct avc_node *node)
+{
+	llist_add(&node->reclaim, &avc_reclaim_list);
+	if (atomic_inc_return(&avc_reclaim_count) >= AVC_RECLAIM_BATCH)
+		avc_reclaim_flush();
+	else if (!delayed_work_pending(&avc_reclaim_work))
+		schedule_delayed_work(&avc_reclaim_work, AVC_RECLAIM_DELAY);
+}
+#else
+static inline void avc_reclaim_flush(void)
+{
+}
+
+static void avc_node_retire(struct avc_node *node)
+{
+	call_rcu(&node->rhead, avc_node_free);
+}
+#endif
+
 static void avc_node_delete(struct avc_node *node)
 {
 	hlist_del_rcu(&node->list);
-	call_rcu(&node->rhead, avc_node_free);
+	avc_node_retire(node);
 	atomic_dec(&avc_cache.active_nodes);
 }
 
@@ -508,7 +589,7 @@ static void avc_node_kill(struct avc_node *node)
 static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 {
 	hlist_replace_rcu(&old->list, &new->list);
-	call_rcu(&old->rhead, avc_node_free);
+	avc_node_retire(old);
 	atomic_dec(&avc_cache.active_nodes);
 }
 
@@ -528,18 +609,18 @@ static inline int avc_reclaim_node(void)
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
 
-		rcu_read_lock();
+		avc_read_lock();
 		hlist_for_each_entry(node, head, list) {
 			avc_node_delete(node);
 			avc_cache_stats_incr(reclaims);
 			ecx++;
 			if (ecx >= AVC_CACHE_RECLAIM) {
-				rcu_read_unlock();
+				avc_read_unlock();
 				spin_unlock_irqrestore(lock, flags);
 				goto out;
 			}
 		}
-		rcu_read_unlock();
+		avc_read_unlock();
 		spin_unlock_irqrestore(lock, flags);
 	}
 out:
@@ -922,15 +1003,17 @@ static void avc_flush(void)
 
 		spin_lock_irqsave(lock, flag);
 		/*
-		 * With preemptable RCU, the outer spinlock does not
-		 * prevent RCU grace periods from ending.
+		 * With preemptable RCU or PRCU, the outer spinlock does not
+		 * prevent grace periods from ending.
 		 */
-		rcu_read_lock();
+		avc_read_lock();
 		hlist_for_each_entry(node, head, list)
 			avc_node_delete(node);
-		rcu_read_unlock();
+		avc_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	/* Don't leave the tail of a policy reload waiting for the delay. */
+	avc_reclaim_flush();
 }
 
 /**
@@ -961,7 +1044,7 @@ int avc_ss_reset(u32 seqno)
 /*
  * Slow-path helper function for avc_has_perm_noaudit,
  * when the avc_node lookup fails. We get called with
- * the RCU read lock held, and need to return with it
+ * the AVC read lock held, and need to return with it
  * still held, but drop if for the security compute.
  *
  * Don't inline this, since it's the slow-path and just
@@ -971,10 +1054,10 @@ static noinline struct avc_node *avc_compute_av(u32 ssid, u32 tsid,
 			 u16 tclass, struct av_decision *avd,
 			 struct avc_xperms_node *xp_node)
 {
-	rcu_read_unlock();
+	avc_read_unlock();
 	INIT_LIST_HEAD(&xp_node->xpd_head);
 	security_compute_av(ssid, tsid, tclass, avd, &xp_node->xp);
-	rcu_read_lock();
+	avc_read_lock();
 	return avc_insert(ssid, tsid, tclass, avd, xp_node);
 }
 
@@ -1019,7 +1102,7 @@ int avc_has_extended_perms(u32 ssid, u32 tsid, u16 tclass, u32 requested,
 	xp_node = &local_xp_node;
 	BUG_ON(!requested);
 
-	rcu_read_lock();
+	avc_read_lock();
 
 	node = avc_lookup(ssid, tsid, tclass);
 	if (unlikely(!node)) {
@@ -1046,10 +1129,10 @@ int avc_has_extended_perms(u32 ssid, u32 tsid, u16 tclass, u32 requested,
 			avd.allowed &= ~requested;
 			goto decision;
 		}
-		rcu_read_unlock();
+		avc_read_unlock();
 		security_compute_xperms_decision(ssid, tsid, tclass, driver,
 						&local_xpd);
-		rcu_read_lock();
+		avc_read_lock();
 		avc_update_node(AVC_CALLBACK_ADD_XPERMS, requested, driver, xperm,
 				ssid, tsid, tclass, avd.seqno, &local_xpd, 0);
 	} else {
@@ -1066,7 +1149,7 @@ decision:
 		rc = avc_denied(ssid, tsid, tclass, requested, driver, xperm,
 				AVC_EXTENDED_PERMS, &avd);
 
-	rcu_read_unlock();
+	avc_read_unlock();
 
 	rc2 = avc_xperms_audit(ssid, tsid, tclass, requested,
 			&avd, xpd, xperm, rc, ad);
@@ -1107,7 +1190,7 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 
 	BUG_ON(!requested);
 
-	rcu_read_lock();
+	avc_read_lock();
 
 	node = avc_lookup(ssid, tsid, tclass);
 	if (unlikely(!node))
@@ -1119,7 +1202,7 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 	if (unlikely(denied))
 		rc = avc_denied(ssid, tsid, tclass, requested, 0, 0, flags, avd);
 
-	rcu_read_unlock();
+	avc_read_unlock();
 	return rc;
 }
 
@@ -1192,3 +1275,130 @@ void avc_disable(void)
 		/* kmem_cache_destroy(avc_node_cachep); */
 	}
 }
+
+#ifdef CONFIG_SECURITY_SELINUX_AVC_BENCH
+struct avc_bench_thread {
+	struct task_struct	*task;
+	u32			ssid;
+	unsigned long		ops;
+};
+
+static DEFINE_MUTEX(avc_bench_mutex);
+static char avc_bench_result[256];
+
+/*
+ * Check one permission against every initial SID in turn, so that lookups
+ * spread over several hash slots.  Auditing is skipped: a denial on each
+ * iteration would flood the audit log and measure audit, not the AVC.
+ */
+static int avc_bench_thread_fn(void *arg)
+{
+	struct avc_bench_thread *t = arg;
+	struct av_decision avd;
+	u32 tsid = 1;
+
+	while (!kthread_should_stop()) {
+		avc_has_perm_noaudit(t->ssid, tsid, SECCLASS_PROCESS,
+				     PROCESS__GETATTR, 0, &avd);
+		if (++tsid > SECINITSID_NUM)
+			tsid = 1;
+		if (!(++t->ops & 1023))
+			cond_resched();
+	}
+	return 0;
+}
+
+/**
+ * avc_bench - Measure AVC permission check throughput.
+ * @ssid: source security identifier of the checks
+ * @duration_ms: length of the run
+ * @flush_ms: flush the cache at this interval, 0 to never flush; no more
+ *	than @duration_ms
+ *
+ * Run one permission-checking kthread per online CPU for @duration_ms
+ * milliseconds while optionally flushing the cache to model policy
+ * reloads.  The results are read back with avc_get_bench_result().
+ */
+int avc_bench(u32 ssid, unsigned int duration_ms, unsigned int flush_ms)
+{
+	struct avc_bench_thread *threads;
+	unsigned long total = 0, flushes = 0;
+	ktime_t start = 0, end;
+	s64 left_ms;
+	u64 elapsed_ns;
+	int cpu, nr = 0, rc = 0;
+
+	threads = kcalloc(nr_cpu_ids, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	mutex_lock(&avc_bench_mutex);
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		struct avc_bench_thread *t = &threads[cpu];
+
+		t->ssid = ssid;
+		t->task = kthread_create_on_cpu(avc_bench_thread_fn, t, cpu,
+						"avc_bench/%u");
+		if (IS_ERR(t->task)) {
+			rc = PTR_ERR(t->task);
+			t->task = NULL;
+			goto stop;
+		}
+		nr++;
+	}
+
+	start = ktime_get();
+	for_each_online_cpu(cpu)
+		wake_up_process(threads[cpu].task);
+	end = ktime_add_ms(start, duration_ms);
+	for (;;) {
+		left_ms = ktime_ms_delta(end, ktime_get());
+		if (left_ms <= 0)
+			break;
+		/* never sleep past the end of the run */
+		if (!flush_ms || left_ms < flush_ms) {
+			msleep(left_ms);
+			break;
+		}
+		msleep(flush_ms);
+		avc_flush();
+		flushes++;
+	}
+
+stop:
+	for_each_online_cpu(cpu) {
+		if (!threads[cpu].task)
+			continue;
+		kthread_stop(threads[cpu].task);
+		total += threads[cpu].ops;
+	}
+	put_online_cpus();
+
+	if (!rc) {
+		elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		scnprintf(avc_bench_result, sizeof(avc_bench_result),
+			  "flavor: %s\ncpus: %d\nduration_ms: %llu\n"
+			  "checks: %lu\nchecks_per_sec: %llu\nflushes: %lu\n",
+			  IS_ENABLED(CONFIG_SECURITY_SELINUX_AVC_PRCU) ?
+			  "prcu" : "rcu", nr,
+			  div_u64(elapsed_ns, NSEC_PER_MSEC), total,
+			  div64_u64((u64)total * NSEC_PER_SEC,
+				    elapsed_ns ? elapsed_ns : 1),
+			  flushes);
+	}
+	mutex_unlock(&avc_bench_mutex);
+	kfree(threads);
+	return rc;
+}
+
+int avc_get_bench_result(char *page)
+{
+	int len;
+
+	mutex_lock(&avc_bench_mutex);
+	len = scnprintf(page, PAGE_SIZE, "%s", avc_bench_result);
+	mutex_unlock(&avc_bench_mutex);
+	return len;
+}
+#endif
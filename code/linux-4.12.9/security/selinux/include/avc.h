@@ -179,6 +179,11 @@ int avc_add_callback(int (*callback)(u32 event), u32 events);
 int avc_get_hash_stats(char *page);
 extern unsigned int avc_cache_threshold;
 
+#ifdef CONFIG_SECURITY_SELINUX_AVC_BENCH
+int avc_bench(u32 ssid, unsigned int duration_ms, unsigned int flush_ms);
+int avc_get_bench_result(char *page);
+#endif
+
 /* Attempt to free avc node cache */
 void avc_disable(void);
 
@@ -1423,6 +1423,71 @@ static const struct file_operations sel_avc_hash_stats_ops = {
 	.llseek		= generic_file_llseek,
 };
 
+#ifdef CONFIG_SECURITY_SELINUX_AVC_BENCH
+static ssize_t sel_read_avc_bench(struct file *filp, char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	char *page;
+	ssize_t length;
+
+	page = (char *)__get_free_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	length = avc_get_bench_result(page);
+	if (length >= 0)
+		length = simple_read_from_buffer(buf, count, ppos, page, length);
+	free_page((unsigned long)page);
+
+	return length;
+}
+
+/* Write "<duration_ms> [<flush_ms>]" to run the AVC benchmark. */
+static ssize_t sel_write_avc_bench(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	char *page;
+	ssize_t ret;
+	unsigned int duration_ms, flush_ms = 0;
+
+	ret = avc_has_perm(current_sid(), SECINITSID_SECURITY,
+			   SECCLASS_SECURITY, SECURITY__SETSECPARAM,
+			   NULL);
+	if (ret)
+		return ret;
+
+	if (count >= PAGE_SIZE)
+		return -ENOMEM;
+
+	/* No partial writes. */
+	if (*ppos != 0)
+		return -EINVAL;
+
+	page = memdup_user_nul(buf, count);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+
+	ret = -EINVAL;
+	if (sscanf(page, "%u %u", &duration_ms, &flush_ms) < 1 ||
+	    !duration_ms || duration_ms > 60 * MSEC_PER_SEC ||
+	    flush_ms > duration_ms)
+		goto out;
+
+	ret = avc_bench(current_sid(), duration_ms, flush_ms);
+	if (!ret)
+		ret = count;
+out:
+	kfree(page);
+	return ret;
+}
+
+static const struct file_operations sel_avc_bench_ops = {
+	.read		= sel_read_avc_bench,
+	.write		= sel_write_avc_bench,
+	.llseek		= generic_file_llseek,
+};
+#endif
+
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 static struct avc_cache_stats *sel_avc_get_stat_idx(loff_t *idx)
 {
@@ -1500,6 +1565,9 @@ static int sel_make_avc_files(struct dentry *dir)
 		{ "cache_threshold",
 		  &sel_avc_cache_threshold_ops, S_IRUGO|S_IWUSR },
 		{ "hash_stats", &sel_avc_hash_stats_ops, S_IRUGO },
+#ifdef CONFIG_SECURITY_SELINUX_AVC_BENCH
+		{ "bench", &sel_avc_bench_ops, S_IRUGO|S_IWUSR },
+#endif
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 		{ "cache_stats", &sel_avc_cache_stats_ops, S_IRUGO },
 #endif
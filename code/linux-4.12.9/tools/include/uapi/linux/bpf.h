@@ -154,6 +154,11 @@ enum bpf_attach_type {
  * across different LRU lists.
  */
 #define BPF_F_NO_COMMON_LRU	(1U << 1)
+/* Free the elements of a BPF_F_NO_PREALLOC hash map in batches after a
+ * PRCU grace period instead of one RCU callback per element.  Programs
+ * using such a map cannot be tail-call targets or use it as an inner map.
+ */
+#define BPF_F_PRCU_RECLAIM	(1U << 2)
 
 union bpf_attr {
 	struct { /* anonymous struct used by BPF_MAP_CREATE command */
@@ -0,0 +1,234 @@
+/*
+ * Baseline RCU flavors for comparison with the user-space PRCU port.
+ * See baseline.h for a description of each flavor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "baseline.h"
+
+/* Number of cpu_relax() spins before yielding to a preempted thread. */
+#define BASELINE_SPIN_LIMIT 1000
+
+/*
+ * Simple registry of per-thread reader state shared by both flavors.
+ */
+struct baseline_registry {
+	pthread_mutex_t mtx;
+	void *readers[BASELINE_MAX_THREADS];
+};
+
+static int registry_add(struct baseline_registry *reg, void *r)
+{
+	int i;
+
+	pthread_mutex_lock(&reg->mtx);
+	for (i = 0; i < BASELINE_MAX_THREADS; i++) {
+		if (!reg->readers[i]) {
+			reg->readers[i] = r;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg->mtx);
+	return i == BASELINE_MAX_THREADS ? -ENOSPC : 0;
+}
+
+static void registry_del(struct baseline_registry *reg, void *r)
+{
+	int i;
+
+	pthread_mutex_lock(&reg->mtx);
+	for (i = 0; i < BASELINE_MAX_THREADS; i++) {
+		if (reg->readers[i] == r) {
+			reg->readers[i] = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg->mtx);
+}
+
+static void *reader_alloc(size_t size)
+{
+	void *r;
+
+	if (posix_memalign(&r, BASELINE_CACHE_LINE, size))
+		return NULL;
+	memset(r, 0, size);
+	return r;
+}
+
+static void spin_wait(int *spins)
+{
+	if (++*spins < BASELINE_SPIN_LIMIT) {
+		cpu_relax();
+		return;
+	}
+	*spins = 0;
+	sched_yield();
+}
+
+/* Definitions for the epoch flavor. */
+
+unsigned long epoch_gp_ctr = EPOCH_NEST_COUNT;
+__thread struct epoch_reader *epoch_reader;
+static pthread_mutex_t epoch_gp_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct baseline_registry epoch_registry = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+int epoch_register_thread(void)
+{
+	struct epoch_reader *r = reader_alloc(sizeof(*r));
+
+	if (!r)
+		return -ENOMEM;
+	if (registry_add(&epoch_registry, r)) {
+		free(r);
+		return -ENOSPC;
+	}
+	epoch_reader = r;
+	return 0;
+}
+
+void epoch_unregister_thread(void)
+{
+	registry_del(&epoch_registry, epoch_reader);
+	free(epoch_reader);
+	epoch_reader = NULL;
+}
+
+/*
+ * A reader is holding up the current phase flip if it is in a read-side
+ * critical section that started before the flip.
+ */
+static bool epoch_reader_ongoing(struct epoch_reader *r)
+{
+	unsigned long v = READ_ONCE(r->ctr);
+
+	return (v & EPOCH_NEST_MASK) && ((v ^ READ_ONCE(epoch_gp_ctr)) & EPOCH_PHASE);
+}
+
+static void epoch_flip_and_wait(void)
+{
+	int i;
+	int spins;
+	struct epoch_reader *r;
+
+	WRITE_ONCE(epoch_gp_ctr, epoch_gp_ctr ^ EPOCH_PHASE);
+	smp_mb(); /* Flip before scanning readers. */
+	pthread_mutex_lock(&epoch_registry.mtx);
+	for (i = 0; i < BASELINE_MAX_THREADS; i++) {
+		r = epoch_registry.readers[i];
+		if (!r)
+			continue;
+		spins = 0;
+		while (epoch_reader_ongoing(r))
+			spin_wait(&spins);
+	}
+	pthread_mutex_unlock(&epoch_registry.mtx);
+}
+
+void synchronize_epoch(void)
+{
+	pthread_mutex_lock(&epoch_gp_mtx);
+	smp_mb(); /* Caller's removal before the first flip. */
+	/*
+	 * Two flips are needed because a reader may have sampled the
+	 * old phase just before the first flip without yet publishing it.
+	 */
+	epoch_flip_and_wait();
+	epoch_flip_and_wait();
+	smp_mb(); /* Readers' accesses before the caller's frees. */
+	pthread_mutex_unlock(&epoch_gp_mtx);
+}
+
+/* Definitions for the qsbr flavor. */
+
+unsigned long qsbr_gp_ctr = QSBR_GP_ONLINE;
+__thread struct qsbr_reader *qsbr_reader;
+static pthread_mutex_t qsbr_gp_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct baseline_registry qsbr_registry = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+int qsbr_register_thread(void)
+{
+	struct qsbr_reader *r = reader_alloc(sizeof(*r));
+
+	if (!r)
+		return -ENOMEM;
+	if (registry_add(&qsbr_registry, r)) {
+		free(r);
+		return -ENOSPC;
+	}
+	qsbr_reader = r;
+	qsbr_thread_online();
+	return 0;
+}
+
+void qsbr_unregister_thread(void)
+{
+	qsbr_thread_offline();
+	registry_del(&qsbr_registry, qsbr_reader);
+	free(qsbr_reader);
+	qsbr_reader = NULL;
+}
+
+void qsbr_thread_offline(void)
+{
+	smp_mb(); /* Prior read-side accesses before going offline. */
+	WRITE_ONCE(qsbr_reader->ctr, 0);
+}
+
+void qsbr_thread_online(void)
+{
+	WRITE_ONCE(qsbr_reader->ctr, READ_ONCE(qsbr_gp_ctr));
+	smp_mb(); /* Online before subsequent read-side accesses. */
+}
+
+void synchronize_qsbr(void)
+{
+	int i;
+	int spins;
+	unsigned long gp;
+	unsigned long v;
+	struct qsbr_reader *r;
+	bool online = qsbr_reader && READ_ONCE(qsbr_reader->ctr);
+
+	/* An online updater would otherwise wait for itself. */
+	if (online)
+		qsbr_thread_offline();
+	pthread_mutex_lock(&qsbr_gp_mtx);
+	smp_mb(); /* Caller's removal before the counter update. */
+	gp = qsbr_gp_ctr + QSBR_GP_CTR;
+	WRITE_ONCE(qsbr_gp_ctr, gp);
+	smp_mb(); /* Counter update before scanning readers. */
+	pthread_mutex_lock(&qsbr_registry.mtx);
+	for (i = 0; i < BASELINE_MAX_THREADS; i++) {
+		r = qsbr_registry.readers[i];
+		if (!r)
+			continue;
+		spins = 0;
+		for (;;) {
+			v = READ_ONCE(r->ctr);
+			if (!v || v == gp)
+				break;
+			spin_wait(&spins);
+		}
+	}
+	pthread_mutex_unlock(&qsbr_registry.mtx);
+	smp_mb(); /* Readers' accesses before the caller's frees. */
+	pthread_mutex_unlock(&qsbr_gp_mtx);
+	if (online)
+		qsbr_thread_online();
+}
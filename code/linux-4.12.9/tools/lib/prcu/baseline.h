@@ -0,0 +1,95 @@
+/*
+ * Baseline RCU flavors for comparison with the user-space PRCU port:
+ *
+ * epoch: Readers publish a snapshot of a global phase counter with a
+ *	  memory barrier on entry and exit, and the updater flips the
+ *	  phase twice, waiting for readers of the old phase each time.
+ * qsbr:  Readers are free, but each registered thread must announce
+ *	  quiescent states periodically and the updater waits for every
+ *	  online thread to do so.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __PRCU_BASELINE_H
+#define __PRCU_BASELINE_H
+
+#include "prcu_compat.h"
+
+#define BASELINE_MAX_THREADS	1024
+#define BASELINE_CACHE_LINE	64
+
+/* Low bits count nesting, the top half of the word holds the phase. */
+#define EPOCH_NEST_COUNT	1UL
+#define EPOCH_PHASE		(1UL << (sizeof(unsigned long) << 2))
+#define EPOCH_NEST_MASK		(EPOCH_PHASE - 1)
+
+struct epoch_reader {
+	unsigned long ctr;
+} __attribute__((aligned(BASELINE_CACHE_LINE)));
+
+extern unsigned long epoch_gp_ctr;
+extern __thread struct epoch_reader *epoch_reader;
+
+int epoch_register_thread(void);
+void epoch_unregister_thread(void);
+void synchronize_epoch(void);
+
+static inline void epoch_read_lock(void)
+{
+	struct epoch_reader *r = epoch_reader;
+	unsigned long tmp = r->ctr;
+
+	if (!(tmp & EPOCH_NEST_MASK)) {
+		WRITE_ONCE(r->ctr, READ_ONCE(epoch_gp_ctr));
+		smp_mb(); /* Publish ->ctr before critical section. */
+	} else {
+		WRITE_ONCE(r->ctr, tmp + EPOCH_NEST_COUNT);
+	}
+}
+
+static inline void epoch_read_unlock(void)
+{
+	struct epoch_reader *r = epoch_reader;
+
+	smp_mb(); /* Critical section before ->ctr update. */
+	WRITE_ONCE(r->ctr, r->ctr - EPOCH_NEST_COUNT);
+}
+
+/* ->ctr of zero means offline, so the global counter starts at one. */
+#define QSBR_GP_ONLINE		1UL
+#define QSBR_GP_CTR		2UL
+
+struct qsbr_reader {
+	unsigned long ctr;
+} __attribute__((aligned(BASELINE_CACHE_LINE)));
+
+extern unsigned long qsbr_gp_ctr;
+extern __thread struct qsbr_reader *qsbr_reader;
+
+int qsbr_register_thread(void);
+void qsbr_unregister_thread(void);
+void qsbr_thread_offline(void);
+void qsbr_thread_online(void);
+void synchronize_qsbr(void);
+
+static inline void qsbr_read_lock(void)
+{
+	barrier();
+}
+
+static inline void qsbr_read_unlock(void)
+{
+	barrier();
+}
+
+static inline void qsbr_quiescent_state(void)
+{
+	smp_mb(); /* Prior read-side accesses before the report. */
+	WRITE_ONCE(qsbr_reader->ctr, READ_ONCE(qsbr_gp_ctr));
+	smp_mb(); /* Report before subsequent read-side accesses. */
+}
+
+#endif /* __PRCU_BASELINE_H */
@@ -0,0 +1,405 @@
+/*
+ * Multi-threaded benchmark for the user-space PRCU port.
+ *
+ * Reader threads repeatedly enter a read-side critical section,
+ * dereference a shared object and check that it has not been freed,
+ * while updater threads replace the object and wait for a grace period
+ * before freeing the old copy.  Reports read throughput and grace-period
+ * latency for PRCU (with either IPI stand-in) and for the epoch and
+ * QSBR baselines.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "prcu.h"
+#include "baseline.h"
+
+#define OBJ_MAGIC	0x50524355UL	/* "PRCU" */
+#define OBJ_POISON	0xdeadbeefUL
+#define MAX_SAMPLES	100000
+
+struct flavor {
+	const char *name;
+	int (*init)(void);
+	int (*register_thread)(void);
+	void (*unregister_thread)(void);
+	void (*read_lock)(void);
+	void (*read_unlock)(void);
+	void (*quiescent_state)(void);
+	void (*sync)(void);
+};
+
+struct obj {
+	unsigned long magic;
+	unsigned long seq;
+};
+
+struct reader_stats {
+	unsigned long long reads;
+	unsigned long long errors;
+} __attribute__((aligned(64)));
+
+struct writer_stats {
+	unsigned long long gps;
+	unsigned long long *lat;	/* Grace-period latencies (ns) */
+	int nlat;
+};
+
+static struct obj *shared_obj;
+static struct reader_stats *reader_stats;
+static struct writer_stats *writer_stats;
+static volatile bool stop;
+static volatile bool go;
+
+static int nreaders = 1;
+static int nwriters = 1;
+static int duration = 5;
+static int cs_len;
+static int qs_interval = 1024;
+static int update_delay_us;
+static bool affinity;
+static const struct flavor *cur_flavor;
+
+static int prcu_signal_init(void)
+{
+	return prcu_init(PRCU_IPI_SIGNAL);
+}
+
+static int prcu_membarrier_init(void)
+{
+	int ret = prcu_init(PRCU_IPI_MEMBARRIER);
+
+	if (!ret && prcu_ipi_mode() != PRCU_IPI_MEMBARRIER)
+		fprintf(stderr, "membarrier() unavailable, using signals\n");
+	return ret;
+}
+
+static int no_init(void)
+{
+	return 0;
+}
+
+static void no_quiescent_state(void)
+{
+}
+
+static const struct flavor flavors[] = {
+	{
+		.name = "prcu",
+		.init = prcu_signal_init,
+		.register_thread = prcu_register_thread,
+		.unregister_thread = prcu_unregister_thread,
+		.read_lock = prcu_read_lock,
+		.read_unlock = prcu_read_unlock,
+		.quiescent_state = no_quiescent_state,
+		.sync = synchronize_prcu,
+	},
+	{
+		.name = "prcu-mb",
+		.init = prcu_membarrier_init,
+		.register_thread = prcu_register_thread,
+		.unregister_thread = prcu_unregister_thread,
+		.read_lock = prcu_read_lock,
+		.read_unlock = prcu_read_unlock,
+		.quiescent_state = no_quiescent_state,
+		.sync = synchronize_prcu,
+	},
+	{
+		.name = "epoch",
+		.init = no_init,
+		.register_thread = epoch_register_thread,
+		.unregister_thread = epoch_unregister_thread,
+		.read_lock = epoch_read_lock,
+		.read_unlock = epoch_read_unlock,
+		.quiescent_state = no_quiescent_state,
+		.sync = synchronize_epoch,
+	},
+	{
+		.name = "qsbr",
+		.init = no_init,
+		.register_thread = qsbr_register_thread,
+		.unregister_thread = qsbr_unregister_thread,
+		.read_lock = qsbr_read_lock,
+		.read_unlock = qsbr_read_unlock,
+		.quiescent_state = qsbr_quiescent_state,
+		.sync = synchronize_qsbr,
+	},
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void set_affinity(long id)
+{
+	cpu_set_t cpuset;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!affinity || ncpus <= 0)
+		return;
+	CPU_ZERO(&cpuset);
+	CPU_SET(id % ncpus, &cpuset);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+}
+
+static void wait_for_go(void)
+{
+	while (!go)
+		cpu_relax();
+}
+
+static void *reader_thread(void *arg)
+{
+	struct reader_stats *rs = arg;
+	unsigned long long reads = 0;
+	unsigned long long errors = 0;
+	struct obj *p;
+	int i;
+
+	set_affinity(rs - reader_stats);
+	if (cur_flavor->register_thread()) {
+		fprintf(stderr, "reader registration failed\n");
+		exit(1);
+	}
+	wait_for_go();
+	while (!stop) {
+		cur_flavor->read_lock();
+		p = READ_ONCE(shared_obj);
+		if (READ_ONCE(p->magic) != OBJ_MAGIC)
+			errors++;
+		for (i = 0; i < cs_len; i++)
+			barrier();
+		cur_flavor->read_unlock();
+		if (!(++reads % qs_interval))
+			cur_flavor->quiescent_state();
+	}
+	cur_flavor->unregister_thread();
+	rs->reads = reads;
+	rs->errors = errors;
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer_stats *ws = arg;
+	unsigned long long t;
+	struct obj *newp;
+	struct obj *oldp;
+
+	set_affinity(nreaders + (ws - writer_stats));
+	wait_for_go();
+	while (!stop) {
+		newp = malloc(sizeof(*newp));
+		if (!newp)
+			break;
+		newp->magic = OBJ_MAGIC;
+		newp->seq = ws->gps;
+		oldp = xchg(&shared_obj, newp);
+		t = now_ns();
+		cur_flavor->sync();
+		t = now_ns() - t;
+		oldp->magic = OBJ_POISON;
+		free(oldp);
+		if (ws->nlat < MAX_SAMPLES)
+			ws->lat[ws->nlat++] = t;
+		ws->gps++;
+		if (update_delay_us)
+			usleep(update_delay_us);
+	}
+	return NULL;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(struct reader_stats *rs, struct writer_stats *ws,
+		   double secs)
+{
+	unsigned long long reads = 0;
+	unsigned long long errors = 0;
+	unsigned long long gps = 0;
+	unsigned long long sum = 0;
+	unsigned long long *lat;
+	int nlat = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < nreaders; i++) {
+		reads += rs[i].reads;
+		errors += rs[i].errors;
+	}
+	for (i = 0; i < nwriters; i++) {
+		gps += ws[i].gps;
+		nlat += ws[i].nlat;
+	}
+	lat = calloc(nlat ? nlat : 1, sizeof(*lat));
+	if (!lat)
+		return;
+	for (i = 0, nlat = 0; i < nwriters; i++)
+		for (j = 0; j < ws[i].nlat; j++) {
+			lat[nlat++] = ws[i].lat[j];
+			sum += ws[i].lat[j];
+		}
+	qsort(lat, nlat, sizeof(*lat), cmp_ull);
+
+	printf("flavor: %s readers: %d writers: %d cs_len: %d duration: %.2f s\n",
+	       cur_flavor->name, nreaders, nwriters, cs_len, secs);
+	printf("reads: %llu (%.0f/s, %.0f/s per reader) errors: %llu\n",
+	       reads, reads / secs, reads / secs / (nreaders ? nreaders : 1),
+	       errors);
+	printf("grace periods: %llu (%.0f/s)\n", gps, gps / secs);
+	if (nlat)
+		printf("gp latency (us): avg %.2f min %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f\n",
+		       sum / 1000.0 / nlat, lat[0] / 1000.0,
+		       lat[(nlat - 1) * 50 / 100] / 1000.0,
+		       lat[(nlat - 1) * 90 / 100] / 1000.0,
+		       lat[(nlat - 1) * 99 / 100] / 1000.0,
+		       lat[nlat - 1] / 1000.0);
+	free(lat);
+}
+
+static void usage(const char *prog)
+{
+	int i;
+
+	fprintf(stderr, "Usage: %s [options]\n"
+		"  -f, --flavor NAME       RCU flavor:", prog);
+	for (i = 0; i < sizeof(flavors) / sizeof(flavors[0]); i++)
+		fprintf(stderr, " %s", flavors[i].name);
+	fprintf(stderr, "\n"
+		"  -r, --readers N         reader threads (default 1)\n"
+		"  -w, --writers N         updater threads (default 1)\n"
+		"  -d, --duration SECS     run time (default 5)\n"
+		"  -c, --cs-len N          read-side critical-section loops (default 0)\n"
+		"  -q, --qs-interval N     reads between qsbr quiescent states (default 1024)\n"
+		"  -u, --update-delay US   delay between updates (default 0)\n"
+		"  -a, --affinity          pin threads round-robin to CPUs\n");
+	exit(2);
+}
+
+static const struct option longopts[] = {
+	{ "flavor", required_argument, NULL, 'f' },
+	{ "readers", required_argument, NULL, 'r' },
+	{ "writers", required_argument, NULL, 'w' },
+	{ "duration", required_argument, NULL, 'd' },
+	{ "cs-len", required_argument, NULL, 'c' },
+	{ "qs-interval", required_argument, NULL, 'q' },
+	{ "update-delay", required_argument, NULL, 'u' },
+	{ "affinity", no_argument, NULL, 'a' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 },
+};
+
+int main(int argc, char **argv)
+{
+	struct reader_stats *rs;
+	struct writer_stats *ws;
+	pthread_t *tids;
+	unsigned long long t;
+	const char *name = "prcu";
+	int i;
+	int o;
+
+	while ((o = getopt_long(argc, argv, "f:r:w:d:c:q:u:ah", longopts,
+				NULL)) != -1) {
+		switch (o) {
+		case 'f':
+			name = optarg;
+			break;
+		case 'r':
+			nreaders = atoi(optarg);
+			break;
+		case 'w':
+			nwriters = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'c':
+			cs_len = atoi(optarg);
+			break;
+		case 'q':
+			qs_interval = atoi(optarg);
+			break;
+		case 'u':
+			update_delay_us = atoi(optarg);
+			break;
+		case 'a':
+			affinity = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	for (i = 0; i < sizeof(flavors) / sizeof(flavors[0]); i++)
+		if (!strcmp(name, flavors[i].name))
+			cur_flavor = &flavors[i];
+	if (!cur_flavor || nreaders < 0 || nwriters < 0 || duration <= 0 ||
+	    qs_interval <= 0)
+		usage(argv[0]);
+	if (cur_flavor->init()) {
+		fprintf(stderr, "%s: initialization failed\n", name);
+		return 1;
+	}
+
+	shared_obj = malloc(sizeof(*shared_obj));
+	rs = calloc(nreaders ? nreaders : 1, sizeof(*rs));
+	ws = calloc(nwriters ? nwriters : 1, sizeof(*ws));
+	tids = calloc(nreaders + nwriters ? nreaders + nwriters : 1,
+		      sizeof(*tids));
+	if (!shared_obj || !rs || !ws || !tids) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	shared_obj->magic = OBJ_MAGIC;
+	shared_obj->seq = 0;
+	reader_stats = rs;
+	writer_stats = ws;
+
+	for (i = 0; i < nreaders; i++)
+		pthread_create(&tids[i], NULL, reader_thread, &rs[i]);
+	for (i = 0; i < nwriters; i++) {
+		ws[i].lat = calloc(MAX_SAMPLES, sizeof(*ws[i].lat));
+		if (!ws[i].lat) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		pthread_create(&tids[nreaders + i], NULL, writer_thread, &ws[i]);
+	}
+
+	t = now_ns();
+	go = true;
+	sleep(duration);
+	stop = true;
+	for (i = 0; i < nreaders + nwriters; i++)
+		pthread_join(tids[i], NULL);
+	t = now_ns() - t;
+
+	report(rs, ws, t / 1e9);
+	for (i = 0; i < nreaders; i++)
+		if (rs[i].errors)
+			return 1;
+	return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * Read-Copy Update mechanism for mutual exclusion (PRCU version).
+ * User-space port of kernel/rcu/prcu.c for algorithm experimentation.
+ *
+ * The algorithm is unchanged: a reader marks its thread online and bumps
+ * ->locked, the last reader to leave reports the global version into the
+ * thread-local ->version, and synchronize_prcu() advances the global
+ * version, pokes every online thread that is behind and waits for all of
+ * them (plus any context-switched readers counted in ->active_ctr) to
+ * catch up.  Only the IPI is replaced, see prcu_force_report().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+
+#include "prcu.h"
+#include "prcu_compat.h"
+
+#ifndef PRCU_SIGNAL
+#define PRCU_SIGNAL SIGUSR1
+#endif
+
+/* Number of cpu_relax() spins before yielding to a preempted thread. */
+#define PRCU_SPIN_LIMIT 1000
+
+static struct prcu_struct global_prcu = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.wait_mtx = PTHREAD_MUTEX_INITIALIZER,
+	.wait_q = PTHREAD_COND_INITIALIZER,
+	.registry_mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+static struct prcu_struct *prcu = &global_prcu;
+
+__thread struct prcu_local_struct *prcu_local;
+
+static int membarrier(int cmd, int flags)
+{
+	return syscall(__NR_membarrier, cmd, flags);
+}
+
+/*
+ * Update local PRCU state of the current thread.
+ */
+static inline void prcu_report(struct prcu_local_struct *local)
+{
+	unsigned long long global_version;
+	unsigned long long local_version;
+
+	global_version = atomic_read(&prcu->global_version);
+	local_version = READ_ONCE(local->version);
+	if (global_version > local_version)
+		cmpxchg(&local->version, local_version, global_version);
+}
+
+/*
+ * Mark the beginning of a PRCU read-side critical section.
+ *
+ * A PRCU quiescent state of a thread is when its local ->locked and
+ * ->online variables become 0.
+ */
+void prcu_read_lock(void)
+{
+	struct prcu_local_struct *local = prcu_local;
+
+	if (!local->online) {
+		WRITE_ONCE(local->online, 1);
+		/*
+		 * Memory barrier is needed for PRCU writers
+		 * to see the updated local->online value.
+		 */
+		smp_mb();
+	}
+	/* Only this thread and its signal handler access ->locked. */
+	WRITE_ONCE(local->locked, local->locked + 1);
+	barrier(); /* Critical section after entry code. */
+}
+
+/*
+ * Mark the end of a PRCU read-side critical section.
+ */
+void prcu_read_unlock(void)
+{
+	unsigned int locked;
+	struct prcu_local_struct *local = prcu_local;
+
+	barrier(); /* Critical section before exit code. */
+	locked = local->locked;
+	if (locked) {
+		WRITE_ONCE(local->locked, locked - 1);
+		/*
+		 * If we are executing the last PRCU read-side critical
+		 * section, update the thread-local PRCU state.
+		 */
+		if (locked == 1)
+			prcu_report(local);
+	} else {
+		/*
+		 * The read-side critical section was context-switched,
+		 * so it is accounted in ->active_ctr.  If it was the last
+		 * one, wake up synchronize_prcu().
+		 */
+		if (!atomic_sub_return(1, &prcu->active_ctr)) {
+			pthread_mutex_lock(&prcu->wait_mtx);
+			pthread_cond_broadcast(&prcu->wait_q);
+			pthread_mutex_unlock(&prcu->wait_mtx);
+		}
+	}
+}
+
+/*
+ * The counterpart of the kernel's IPI handler, run in signal context
+ * on the target thread.
+ */
+static void prcu_handler(int sig)
+{
+	struct prcu_local_struct *local = prcu_local;
+
+	/*
+	 * We need to do this check locally on the current thread
+	 * because no memory barrier is used for ->locked so
+	 * PRCU writers may not see its latest local value.
+	 */
+	if (local && !local->locked)
+		WRITE_ONCE(local->version,
+			   atomic_read(&prcu->global_version));
+}
+
+/*
+ * Force the thread owning @local to report @version if it is not in a
+ * PRCU read-side critical section.  Returns true if the caller must
+ * then wait for the thread's ->version to reach @version.
+ *
+ * With PRCU_IPI_MEMBARRIER, the membarrier() issued by the caller has
+ * already ordered each reader's ->locked update against this thread's
+ * accesses, so the writer may read ->locked remotely and report on the
+ * reader's behalf, which is what prcu_handler() would have done.
+ */
+static bool prcu_force_report(struct prcu_local_struct *local,
+			      unsigned long long version)
+{
+	unsigned long long local_version;
+
+	if (prcu->ipi_mode == PRCU_IPI_SIGNAL)
+		return !pthread_kill(local->tid, PRCU_SIGNAL);
+	if (!READ_ONCE(local->locked)) {
+		local_version = READ_ONCE(local->version);
+		if (local_version < version)
+			cmpxchg(&local->version, local_version, version);
+	}
+	return true;
+}
+
+/*
+ * Wait until a grace period has completed.
+ *
+ * A PRCU grace period can end if each thread has passed a PRCU quiescent
+ * state -and- ->active_ctr is 0, that is all pre-existing PRCU read-side
+ * critical sections have completed.
+ */
+void synchronize_prcu(void)
+{
+	int i;
+	int spins;
+	unsigned long long version;
+	struct prcu_local_struct *local;
+	bool waiting[PRCU_MAX_THREADS];
+
+	/*
+	 * Get the new global grace-period version before taking mutex,
+	 * which allows multiple synchronize_prcu() calls spreading PRCU
+	 * readers can return in a timely fashion.
+	 */
+	version = atomic_add_return(1, &prcu->global_version);
+	/* Take mutex to serialize concurrent synchronize_prcu() calls. */
+	pthread_mutex_lock(&prcu->mtx);
+	/* Keep threads from exiting while we might signal them. */
+	pthread_mutex_lock(&prcu->registry_mtx);
+
+	if (prcu_local)
+		prcu_report(prcu_local);
+	if (prcu->ipi_mode == PRCU_IPI_MEMBARRIER)
+		membarrier(MEMBARRIER_CMD_SHARED, 0);
+
+	/* Force straggling threads to update their PRCU state. */
+	for (i = 0; i < PRCU_MAX_THREADS; i++) {
+		waiting[i] = false;
+		local = prcu->threads[i];
+		/*
+		 * If no PRCU read-side critical sections are currently
+		 * running on this thread or a context-switch has occurred,
+		 * the thread-local PRCU state has already been updated.
+		 */
+		if (!local || local == prcu_local || !READ_ONCE(local->online))
+			continue;
+		if (READ_ONCE(local->version) < version)
+			waiting[i] = prcu_force_report(local, version);
+	}
+
+	/* Wait for outstanding threads to commit. */
+	for (i = 0; i < PRCU_MAX_THREADS; i++) {
+		if (!waiting[i])
+			continue;
+		local = prcu->threads[i];
+		spins = 0;
+		while (READ_ONCE(local->version) < version) {
+			if (++spins < PRCU_SPIN_LIMIT) {
+				cpu_relax();
+				continue;
+			}
+			spins = 0;
+			sched_yield();
+		}
+	}
+	pthread_mutex_unlock(&prcu->registry_mtx);
+
+	/* Wait for outstanding PRCU read-side critical sections to finish. */
+	if (atomic_read(&prcu->active_ctr)) {
+		pthread_mutex_lock(&prcu->wait_mtx);
+		while (atomic_read(&prcu->active_ctr))
+			pthread_cond_wait(&prcu->wait_q, &prcu->wait_mtx);
+		pthread_mutex_unlock(&prcu->wait_mtx);
+	}
+	smp_mb(); /* Order readers' accesses before the caller's frees. */
+	atomic_set(&prcu->cb_version, version);
+	pthread_mutex_unlock(&prcu->mtx);
+}
+
+/*
+ * Update PRCU state when the calling thread is about to block, the
+ * counterpart of the scheduler hook in the kernel.  Blocking readers
+ * are moved to ->active_ctr so that synchronize_prcu() sleeps rather
+ * than spins on them.
+ */
+void prcu_note_context_switch(void)
+{
+	struct prcu_local_struct *local = prcu_local;
+
+	/* Update local and global outstanding PRCU read-side numbers. */
+	if (local->locked) {
+		atomic_add_return(local->locked, &prcu->active_ctr);
+		WRITE_ONCE(local->locked, 0);
+	}
+	/* Indicate a context-switch has occurred on this thread. */
+	WRITE_ONCE(local->online, 0);
+	smp_mb(); /* Order prior read-side accesses before the report. */
+	/* Update this thread's local PRCU state. */
+	prcu_report(local);
+}
+
+/*
+ * Register the calling thread as a PRCU reader.  Returns 0 on success
+ * or a negative errno.
+ */
+int prcu_register_thread(void)
+{
+	int i;
+	struct prcu_local_struct *local;
+
+	if (posix_memalign((void **)&local, PRCU_CACHE_LINE, sizeof(*local)))
+		return -ENOMEM;
+	memset(local, 0, sizeof(*local));
+	local->tid = pthread_self();
+
+	pthread_mutex_lock(&prcu->registry_mtx);
+	local->version = atomic_read(&prcu->global_version);
+	for (i = 0; i < PRCU_MAX_THREADS; i++) {
+		if (!prcu->threads[i]) {
+			prcu->threads[i] = local;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&prcu->registry_mtx);
+	if (i == PRCU_MAX_THREADS) {
+		free(local);
+		return -ENOSPC;
+	}
+	prcu_local = local;
+	return 0;
+}
+
+/*
+ * Unregister the calling thread, which must not be in a PRCU read-side
+ * critical section.
+ */
+void prcu_unregister_thread(void)
+{
+	int i;
+	struct prcu_local_struct *local = prcu_local;
+
+	if (!local)
+		return;
+	prcu_note_context_switch();
+	pthread_mutex_lock(&prcu->registry_mtx);
+	for (i = 0; i < PRCU_MAX_THREADS; i++) {
+		if (prcu->threads[i] == local) {
+			prcu->threads[i] = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&prcu->registry_mtx);
+	prcu_local = NULL;
+	free(local);
+}
+
+/*
+ * Initialize PRCU with the specified IPI stand-in.  Falls back to
+ * PRCU_IPI_SIGNAL if membarrier() is not supported by the running
+ * kernel.  Returns 0 on success or a negative errno.
+ */
+int prcu_init(enum prcu_ipi_mode mode)
+{
+	struct sigaction sa;
+	int ret;
+
+	if (mode == PRCU_IPI_MEMBARRIER) {
+		ret = membarrier(MEMBARRIER_CMD_QUERY, 0);
+		if (ret < 0 || !(ret & MEMBARRIER_CMD_SHARED))
+			mode = PRCU_IPI_SIGNAL;
+	}
+	prcu->ipi_mode = mode;
+	if (mode != PRCU_IPI_SIGNAL)
+		return 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = prcu_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(PRCU_SIGNAL, &sa, NULL))
+		return -errno;
+	return 0;
+}
+
+enum prcu_ipi_mode prcu_ipi_mode(void)
+{
+	return prcu->ipi_mode;
+}
@@ -0,0 +1,74 @@
+/*
+ * Read-Copy Update mechanism for mutual exclusion (PRCU version).
+ * User-space port of kernel/rcu/prcu.c for algorithm experimentation.
+ *
+ * Threads stand in for CPUs: each registered thread has its own
+ * ->locked, ->online and ->version, and a POSIX signal or membarrier()
+ * stands in for the IPI that synchronize_prcu() sends to straggling CPUs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __PRCU_H
+#define __PRCU_H
+
+#include <pthread.h>
+
+#define PRCU_MAX_THREADS	1024
+#define PRCU_CACHE_LINE		64
+
+/*
+ * How synchronize_prcu() forces straggling threads to update their
+ * PRCU state.
+ */
+enum prcu_ipi_mode {
+	PRCU_IPI_SIGNAL,	/* pthread_kill(), prcu_handler() runs locally */
+	PRCU_IPI_MEMBARRIER,	/* membarrier(), writer updates ->version */
+};
+
+/*
+ * PRCU's per-thread state, the counterpart of the kernel's per-CPU
+ * prcu_local_struct.
+ */
+struct prcu_local_struct {
+	unsigned int locked;		/* Nesting level of PRCU read-side */
+					/*  critical sections */
+	unsigned int online;		/* Indicates whether a context-switch */
+					/*  has occurred on this thread */
+	unsigned long long version;	/* Local grace-period version */
+	pthread_t tid;			/* Target of the signal-based IPI */
+} __attribute__((aligned(PRCU_CACHE_LINE)));
+
+/*
+ * PRCU's global state.
+ */
+struct prcu_struct {
+	unsigned long long global_version;	/* Global grace-period version */
+	unsigned long long cb_version;		/* Completed grace-period version */
+	int active_ctr;				/* Outstanding PRCU read-side */
+						/*  sections being context-switched */
+	enum prcu_ipi_mode ipi_mode;		/* IPI stand-in */
+	pthread_mutex_t mtx;			/* Serialize synchronize_prcu() */
+	pthread_mutex_t wait_mtx;		/* Protects wait_q */
+	pthread_cond_t wait_q;			/* Wait for ->active_ctr to drain */
+	pthread_mutex_t registry_mtx;		/* Protects the thread registry */
+	struct prcu_local_struct *threads[PRCU_MAX_THREADS];
+};
+
+extern __thread struct prcu_local_struct *prcu_local;
+
+/*
+ * PRCU APIs.
+ */
+int prcu_init(enum prcu_ipi_mode mode);
+enum prcu_ipi_mode prcu_ipi_mode(void);
+int prcu_register_thread(void);
+void prcu_unregister_thread(void);
+void prcu_read_lock(void);
+void prcu_read_unlock(void);
+void synchronize_prcu(void);
+void prcu_note_context_switch(void);
+
+#endif /* __PRCU_H */
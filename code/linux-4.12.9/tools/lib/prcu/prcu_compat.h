@@ -0,0 +1,43 @@
+/*
+ * Kernel primitives used by the user-space PRCU port and its benchmark,
+ * implemented with GCC atomic builtins.  The "atomic" operations act on
+ * plain integer types rather than atomic_t.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __PRCU_COMPAT_H
+#define __PRCU_COMPAT_H
+
+#define barrier()		__asm__ __volatile__("" : : : "memory")
+#define smp_mb()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define READ_ONCE(x)		(*(volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val)	(*(volatile __typeof__(x) *)&(x) = (val))
+
+#define atomic_read(p)		__atomic_load_n(p, __ATOMIC_RELAXED)
+#define atomic_set(p, v)	__atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define atomic_add_return(i, p)	__atomic_add_fetch(p, i, __ATOMIC_SEQ_CST)
+#define atomic_sub_return(i, p)	__atomic_sub_fetch(p, i, __ATOMIC_SEQ_CST)
+#define xchg(p, v)		__atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+
+/* Returns the old value, like the kernel's cmpxchg(). */
+#define cmpxchg(p, old, new)						\
+({									\
+	__typeof__(*(p)) __old = (old);					\
+	__atomic_compare_exchange_n(p, &__old, new, false,		\
+				    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
+	__old;								\
+})
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()		__asm__ __volatile__("rep; nop" : : : "memory")
+#elif defined(__aarch64__)
+#define cpu_relax()		__asm__ __volatile__("yield" : : : "memory")
+#else
+#define cpu_relax()		barrier()
+#endif
+
+#endif /* __PRCU_COMPAT_H */
@@ -0,0 +1,98 @@
+#!/bin/bash
+#
+# Measure cache hit lookup IOPS through a bcache device, for an increasing
+# number of threads doing random 4k direct reads.
+#
+# Usage: bcache_lookup_bench.sh [ size_mb [ runtime_s [ max_threads ] ] ]
+#
+# The cache device is a brd ramdisk and the backing device a loop device
+# on a file in /dev/shm, so that the reads measure the btree lookups and
+# not the devices. The whole backing device is written in writeback mode
+# first, so that every read is a hit. Needs make-bcache and fio.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+
+size_mb=${1:-1024}
+runtime=${2:-10}
+max_threads=${3:-$(nproc)}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit 1
+fi
+
+for tool in make-bcache fio; do
+	if ! which $tool > /dev/null 2>&1; then
+		echo "$0: $tool not found"
+		exit 1
+	fi
+done
+
+if [ -e /sys/block/ram0 ]; then
+	echo "$0: brd already loaded"
+	exit 1
+fi
+
+modprobe bcache || exit 1
+# rd_size is in KB, leave room for the btree and the journal
+modprobe brd rd_nr=1 rd_size=$((size_mb * 2 * 1024)) || exit 1
+
+cache=/dev/ram0
+backing_file=$(mktemp -p /dev/shm bcache_lookup_bench.XXXXXX) || exit 1
+backing=
+bdev=
+cset=
+
+cleanup() {
+	if [ -n "$bdev" ]; then
+		echo 1 > /sys/block/$bdev/bcache/stop
+	fi
+	if [ -n "$cset" ]; then
+		echo 1 > /sys/fs/bcache/$cset/unregister
+	fi
+	udevadm settle
+	sleep 1
+	[ -n "$backing" ] && losetup -d $backing
+	rm -f $backing_file
+	rmmod brd
+}
+trap cleanup EXIT
+
+truncate -s ${size_mb}M $backing_file
+backing=$(losetup -f --show $backing_file) || exit 1
+
+wipefs -a -q $cache $backing
+make-bcache --writeback -C $cache -B $backing > /dev/null || exit 1
+echo $cache > /sys/fs/bcache/register
+echo $backing > /sys/fs/bcache/register
+udevadm settle
+
+cset=$(basename "$(readlink -f /sys/block/ram0/bcache/set)")
+bdev=$(basename "$(readlink -f /sys/block/${backing#/dev/}/bcache/dev)")
+if [ -z "$cset" ] || [ -z "$bdev" ]; then
+	echo "$0: bcache device didn't show up"
+	exit 1
+fi
+
+# Cache everything, and keep it there
+echo 0 > /sys/block/$bdev/bcache/sequential_cutoff
+echo 0 > /sys/block/$bdev/bcache/writeback_running
+dd if=/dev/urandom of=/dev/$bdev bs=1M count=$size_mb oflag=direct \
+	status=none || exit 1
+
+echo "$size_mb MB on /dev/$bdev, $runtime s per run"
+threads=1
+while [ $threads -le $max_threads ]; do
+	# field 8 of the terse output is the read IOPS
+	iops=$(fio --name=lookup --filename=/dev/$bdev --rw=randread \
+		--bs=4k --direct=1 --ioengine=psync --numjobs=$threads \
+		--time_based --runtime=$runtime --group_reporting \
+		--output-format=terse | cut -d ';' -f 8)
+
+	echo "$threads threads: $iops IOPS," \
+	     "hits: $(cat /sys/block/$bdev/bcache/stats_total/cache_hits)"
+
+	threads=$((threads * 2))
+done
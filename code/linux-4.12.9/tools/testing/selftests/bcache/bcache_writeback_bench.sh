@@ -0,0 +1,131 @@
+#!/bin/bash
+#
+# Measure how fast bcache drains dirty data to a slow backing device, with
+# writeback unthrottled and with the rate controller targeting a number of
+# backing device utilizations.
+#
+# Usage: bcache_writeback_bench.sh [ dirty_mb [ bw_mbps [ util_targets ] ] ]
+#
+# The backing device is a null_blk device that emulates a disk: one request
+# at a time, each taking 4ms plus its size at bw_mbps. Its first 8k, where
+# the bcache superblock goes, is mapped to a loop device with dm-linear, as
+# null_blk doesn't keep what's written to it. The cache device is a brd
+# ramdisk. The dirty data is written as random 4k writes, each block once.
+# Needs make-bcache, dmsetup and fio.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+
+dirty_mb=${1:-256}
+bw_mbps=${2:-150}
+util_targets=${3:-"50 90"}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit 1
+fi
+
+for tool in make-bcache dmsetup fio; do
+	if ! which $tool > /dev/null 2>&1; then
+		echo "$0: $tool not found"
+		exit 1
+	fi
+done
+
+if [ -e /sys/block/ram0 ] || [ -e /sys/block/nullb0 ]; then
+	echo "$0: brd or null_blk already loaded"
+	exit 1
+fi
+
+modprobe bcache || exit 1
+# Keep the dirty data below CUTOFF_WRITEBACK, 40% of the cache
+modprobe brd rd_nr=1 rd_size=$((dirty_mb * 4 * 1024)) || exit 1
+modprobe null_blk nr_devices=1 queue_mode=2 irqmode=2 hw_queue_depth=1 \
+	gb=$(((dirty_mb * 2 + 1023) / 1024)) completion_nsec=4000000 \
+	bw_mbps=$bw_mbps service_units=1 || exit 1
+
+name=bcache_writeback_bench
+cache=/dev/ram0
+sb_file=$(mktemp -p /dev/shm $name.XXXXXX) || exit 1
+sb_loop=
+backing=
+bdev=
+cset=
+
+cleanup() {
+	if [ -n "$bdev" ]; then
+		echo 1 > /sys/block/$bdev/bcache/stop
+	fi
+	if [ -n "$cset" ]; then
+		echo 1 > /sys/fs/bcache/$cset/unregister
+	fi
+	udevadm settle
+	sleep 1
+	[ -n "$backing" ] && dmsetup remove $name
+	[ -n "$sb_loop" ] && losetup -d $sb_loop
+	rm -f $sb_file
+	rmmod null_blk brd
+}
+trap cleanup EXIT
+
+truncate -s 8k $sb_file
+sb_loop=$(losetup -f --show $sb_file) || exit 1
+
+sectors=$(blockdev --getsz /dev/nullb0)
+dmsetup create $name <<EOT || exit 1
+0 16 linear $sb_loop 0
+16 $((sectors - 16)) linear /dev/nullb0 16
+EOT
+backing=/dev/mapper/$name
+
+wipefs -a -q $cache
+make-bcache --writeback -C $cache -B $backing > /dev/null || exit 1
+echo $cache > /sys/fs/bcache/register
+echo $backing > /sys/fs/bcache/register
+udevadm settle
+
+cset=$(basename "$(readlink -f /sys/block/ram0/bcache/set)")
+dm=$(basename "$(readlink -f $backing)")
+bdev=$(basename "$(readlink -f /sys/block/$dm/bcache/dev)")
+if [ -z "$cset" ] || [ -z "$bdev" ]; then
+	echo "$0: bcache device didn't show up"
+	exit 1
+fi
+sys=/sys/block/$bdev/bcache
+
+echo 0 > $sys/sequential_cutoff
+echo 0 > $sys/writeback_delay
+echo 1 > $sys/writeback_rate_update_seconds
+
+run() {
+	local percent=$1 util=$2 start end
+
+	echo 0 > $sys/writeback_running
+	fio --name=dirty --filename=/dev/$bdev --rw=randwrite --bs=4k \
+		--direct=1 --ioengine=libaio --iodepth=32 --size=${dirty_mb}M \
+		--output=/dev/null || exit 1
+	if [ "$(cat $sys/state)" != dirty ]; then
+		echo "$0: writes bypassed the cache"
+		exit 1
+	fi
+
+	echo $percent > $sys/writeback_percent
+	echo $util > $sys/writeback_util_target
+
+	start=$(date +%s%N)
+	echo 1 > $sys/writeback_running
+	while [ "$(cat $sys/state)" != clean ]; do
+		sleep 0.1
+	done
+	end=$(date +%s%N)
+
+	echo "writeback_percent=$percent writeback_util_target=$util:" \
+	     "$((dirty_mb * 1000000000 / (end - start))) MB/s"
+}
+
+echo "$dirty_mb MB dirty, backing device at $bw_mbps MB/s, 4ms per request"
+run 0 0
+for util in $util_targets; do
+	run 10 $util
+done
@@ -0,0 +1,64 @@
+#!/bin/bash
+#
+# Measure IOPS per submitting core through null_blk, once with requests
+# handed to the driver one at a time by ->queue_rq() and once with lists
+# of them handed over by ->queue_rqs(), with and without an I/O scheduler.
+#
+# Usage: blk_mq_batch_bench.sh [ runtime_s [ iodepth [ cpu ] ] ]
+#
+# A single fio job doing random 4k reads is pinned to one CPU and null_blk
+# completes requests inline, so the IOPS reported are what that one core
+# can submit and complete. Needs fio.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+
+runtime=${1:-10}
+iodepth=${2:-32}
+cpu=${3:-0}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit 1
+fi
+
+if ! which fio > /dev/null 2>&1; then
+	echo "$0: fio not found"
+	exit 1
+fi
+
+if [ -e /sys/module/null_blk ]; then
+	echo "$0: null_blk already loaded"
+	exit 1
+fi
+
+cleanup() {
+	rmmod null_blk 2> /dev/null
+}
+trap cleanup EXIT
+
+# run <batch_dispatch> <scheduler>
+run() {
+	local iops
+
+	modprobe null_blk queue_mode=2 irqmode=0 nr_devices=1 \
+		submit_queues=1 batch_dispatch=$1 || exit 1
+	echo $2 > /sys/block/nullb0/queue/scheduler || exit 1
+
+	iops=$(fio --name=batch --filename=/dev/nullb0 --rw=randread \
+		--bs=4k --direct=1 --ioengine=libaio --iodepth=$iodepth \
+		--iodepth_batch_submit=$iodepth --cpus_allowed=$cpu \
+		--time_based --runtime=$runtime --group_reporting \
+		--output-format=terse --terse-version=3 | cut -d ';' -f 8)
+	[ -n "$iops" ] || exit 1
+
+	echo "batch_dispatch=$1 scheduler=$2: $iops IOPS on cpu $cpu"
+	rmmod null_blk || exit 1
+}
+
+echo "4k random reads, iodepth $iodepth, ${runtime}s"
+for sched in none mq-deadline; do
+	run 0 $sched
+	run 1 $sched
+done
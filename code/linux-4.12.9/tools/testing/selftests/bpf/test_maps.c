@@ -18,6 +18,7 @@
 
 #include <sys/wait.h>
 #include <sys/resource.h>
+#include <sys/time.h>
 
 #include <linux/bpf.h>
 
@@ -545,6 +546,65 @@ static void test_map_parallel(void)
 	assert(bpf_map_get_next_key(fd, &key, &key) == -1 && errno == ENOENT);
 }
 
+#define CHURN_TASKS	8
+#define CHURN_KEYS	4096
+#define CHURN_ROUNDS	64
+
+static void do_churn(int task, void *data)
+{
+	int fd = *(int *)data;
+	long long key, value;
+	int i, j;
+
+	for (i = 0; i < CHURN_ROUNDS; i++) {
+		for (j = 0; j < CHURN_KEYS; j++) {
+			key = (long long)task * CHURN_KEYS + j;
+			value = key;
+			assert(bpf_map_update_elem(fd, &key, &value,
+						   BPF_NOEXIST) == 0);
+		}
+		for (j = 0; j < CHURN_KEYS; j++) {
+			key = (long long)task * CHURN_KEYS + j;
+			assert(bpf_map_delete_elem(fd, &key) == 0);
+		}
+	}
+}
+
+/* Time update/delete churn on a non-preallocated hash map with per-element
+ * RCU reclamation and with batched PRCU reclamation.
+ */
+static void test_map_reclaim_bench(void)
+{
+	int flags[] = { BPF_F_NO_PREALLOC,
+			BPF_F_NO_PREALLOC | BPF_F_PRCU_RECLAIM };
+	const char *names[] = { "rcu", "prcu" };
+	long long key, value;
+	struct timeval start, end;
+	double secs;
+	int i, fd;
+
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(key),
+				    sizeof(value), CHURN_TASKS * CHURN_KEYS,
+				    flags[i]);
+		if (fd < 0) {
+			printf("Failed to create %s hashmap '%s'!\n",
+			       names[i], strerror(errno));
+			exit(1);
+		}
+
+		gettimeofday(&start, NULL);
+		run_parallel(CHURN_TASKS, do_churn, &fd);
+		gettimeofday(&end, NULL);
+
+		secs = (end.tv_sec - start.tv_sec) +
+		       (end.tv_usec - start.tv_usec) / 1e6;
+		printf("reclaim %s: %.0f ops/sec\n", names[i],
+		       2.0 * CHURN_TASKS * CHURN_KEYS * CHURN_ROUNDS / secs);
+		close(fd);
+	}
+}
+
 static void run_all_tests(void)
 {
 	test_hashmap(0, NULL);
@@ -572,6 +632,11 @@ int main(void)
 	map_flags = BPF_F_NO_PREALLOC;
 	run_all_tests();
 
+	map_flags = BPF_F_NO_PREALLOC | BPF_F_PRCU_RECLAIM;
+	run_all_tests();
+
+	test_map_reclaim_bench();
+
 	printf("test_maps: OK\n");
 	return 0;
 }
@@ -0,0 +1,102 @@
+#!/bin/bash
+#
+# Measure dm-btree metadata operations per second through dm-thin: the
+# mappings inserted while provisioning a thin device, first in order and
+# then in random order, and the mappings removed by discarding all of it.
+#
+# Usage: dm_btree_bench.sh [ size_mb [ block_kb ] ]
+#
+# The pool's metadata and data devices are brd ramdisks and discards
+# aren't passed down, so the times are dominated by the btree updates.
+# A small pool block size gives more mappings per MB. Needs dmsetup, fio
+# and blkdiscard.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+
+size_mb=${1:-1024}
+block_kb=${2:-64}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit 1
+fi
+
+for tool in dmsetup fio blkdiscard; do
+	if ! which $tool > /dev/null 2>&1; then
+		echo "$0: $tool not found"
+		exit 1
+	fi
+done
+
+if [ -e /sys/block/ram0 ]; then
+	echo "$0: brd already loaded"
+	exit 1
+fi
+
+modprobe dm-thin-pool || exit 1
+# rd_size is in KB, ram0 holds the metadata and ram1 the data
+modprobe brd rd_nr=2 rd_size=$((size_mb * 1024)) || exit 1
+
+meta=/dev/ram0
+data=/dev/ram1
+pool=dm_btree_bench_pool
+thin=dm_btree_bench_thin
+sectors=$((size_mb * 2048))
+nr_blocks=$((size_mb * 1024 / block_kb))
+
+cleanup() {
+	dmsetup remove $thin 2> /dev/null
+	dmsetup remove $pool 2> /dev/null
+	udevadm settle
+	rmmod brd
+}
+trap cleanup EXIT
+
+now_ns() {
+	date +%s%N
+}
+
+# report <what> <start ns>
+report() {
+	local ns=$(($(now_ns) - $2))
+
+	echo "$1: $nr_blocks mappings in $((ns / 1000000)) ms," \
+	     "$((nr_blocks * 1000000000 / ns)) ops/s"
+}
+
+# provision <fio rw>
+provision() {
+	fio --name=provision --filename=/dev/mapper/$thin --rw=$1 \
+		--bs=${block_kb}k --direct=1 --ioengine=psync \
+		--size=${size_mb}M --randrepeat=0 --output=/dev/null || exit 1
+}
+
+discard() {
+	blkdiscard /dev/mapper/$thin || exit 1
+}
+
+dd if=/dev/zero of=$meta bs=4k count=1 oflag=direct status=none
+dmsetup create $pool --table "0 $sectors thin-pool $meta $data \
+	$((block_kb * 2)) 0 2 skip_block_zeroing no_discard_passdown" || exit 1
+dmsetup message $pool 0 "create_thin 0" || exit 1
+dmsetup create $thin --table "0 $sectors thin /dev/mapper/$pool 0" || exit 1
+
+echo "$size_mb MB thin device, $block_kb KB blocks"
+
+start=$(now_ns)
+provision write
+report "sequential insert" $start
+
+start=$(now_ns)
+discard
+report "range remove" $start
+
+start=$(now_ns)
+provision randwrite
+report "random insert" $start
+
+start=$(now_ns)
+discard
+report "range remove" $start
@@ -0,0 +1,36 @@
+#!/bin/bash
+#
+# Runs the dm-btree-test module on a brd ramdisk. The module checks
+# dm_btree_insert_sorted() with sorted runs, overwrites, duplicate and
+# unsorted keys, and fails to load if any of the checks fail.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit 1
+fi
+
+if ! /sbin/modprobe -q -n dm-btree-test; then
+	echo "dm_btree: [SKIP] module dm-btree-test not found"
+	exit 0
+fi
+
+if [ -e /sys/block/ram0 ]; then
+	echo "$0: brd already loaded"
+	exit 1
+fi
+
+# rd_size is in KB
+modprobe brd rd_nr=1 rd_size=65536 || exit 1
+trap "rmmod brd" EXIT
+
+if /sbin/modprobe -q dm-btree-test dev=/dev/ram0; then
+	/sbin/modprobe -q -r dm-btree-test
+	echo "dm_btree: ok"
+else
+	echo "dm_btree: [FAIL]"
+	exit 1
+fi
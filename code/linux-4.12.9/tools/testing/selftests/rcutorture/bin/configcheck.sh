@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+# Usage: configcheck.sh .config .config-template
+#
+# Complain about any requested Kconfig option that did not survive
+# "make oldconfig", for example because of an unmet dependency.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, you can access it online at
+# http://www.gnu.org/licenses/gpl-2.0.html.
+
+sed -e 's/\(.*\)=n$/# \1 is not set/' -e 's/^#CHECK#//' < $2 |
+awk '
+FNR == NR {
+	config[$0] = 1;
+	if ($0 ~ /^CONFIG_[0-9A-Z_]*=/)
+		set[substr($0, 1, index($0, "=") - 1)] = 1;
+	next;
+}
+
+/^CONFIG_/ && !($0 in config) {
+	print ":" $0 ": improperly set";
+}
+
+/^# CONFIG_.* is not set$/ && ($2 in set) {
+	print ":" $2 ": improperly set";
+}' $1 -
@@ -0,0 +1,81 @@
+#!/bin/bash
+#
+# Tabulate PRCU against RCU for a kvm.sh results directory.  Each PRCU
+# scenario "PRCU<suffix>" is paired with its RCU baseline "TREE<suffix>"
+# using the perf.summary and torture.summary files left behind by
+# kvm-recheck-rcuperf.sh and kvm-recheck-rcu.sh.  Latencies are in
+# microseconds, rates are per second.
+#
+# Usage: kvm-prcu-compare.sh resdir
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, you can access it online at
+# http://www.gnu.org/licenses/gpl-2.0.html.
+
+resdir="$1"
+if test -d "$resdir"
+then
+	:
+else
+	echo Unreadable results directory: $resdir
+	exit 1
+fi
+
+summaries="`ls $resdir/*/perf.summary $resdir/*/torture.summary 2> /dev/null`"
+if test -z "$summaries"
+then
+	echo No rcuperf or rcutorture summaries in $resdir
+	exit 1
+fi
+
+printf "%-22s %-7s %10s %10s %10s %10s %12s %12s %8s\n" \
+       Scenario Mode RCU-mean PRCU-mean RCU-p99 PRCU-p99 \
+       RCU-rate PRCU-rate Speedup
+cat $summaries |
+awk '
+{
+	# Scenario reruns carry a numeric suffix, for example "PRCU.2".
+	scenario = $1;
+	sub(/\.[0-9]+$/, "", scenario);
+	key = scenario " " $3;
+	if ($3 == "torture") {
+		rate[key] = $6;
+		mean[key] = "-";
+		p99[key] = "-";
+	} else {
+		mean[key] = $5;
+		p99[key] = $8;
+		rate[key] = $10;
+	}
+	if (scenario ~ /^PRCU/)
+		prcu[key] = 1;
+}
+
+END {
+	for (key in prcu) {
+		split(key, kv, " ");
+		base = kv[1];
+		sub(/^PRCU/, "TREE", base);
+		bkey = base " " kv[2];
+		if (!(bkey in rate)) {
+			printf "%-22s %-7s %10s %10s %10s %10s %12s %12.1f %8s\n",
+			       kv[1], kv[2], "-", mean[key], "-", p99[key],
+			       "-", rate[key], "-";
+			continue;
+		}
+		speedup = rate[bkey] > 0 ? rate[key] / rate[bkey] : 0;
+		printf "%-22s %-7s %10s %10s %10s %10s %12.1f %12.1f %7.2fx\n",
+		       kv[1], kv[2], mean[bkey], mean[key], p99[bkey],
+		       p99[key], rate[bkey], rate[key], speedup;
+	}
+}' | sort -k 1,2
@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# Analyze a given results directory for rcutorture progress, including
+# a summary of grace-period (update) and callback throughput taken from
+# the final statistics line.
+#
+# Usage: kvm-recheck-rcu.sh resdir
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, you can access it online at
+# http://www.gnu.org/licenses/gpl-2.0.html.
+
+i="$1"
+if test -d $i
+then
+	:
+else
+	echo Unreadable results directory: $i
+	exit 1
+fi
+. functions.sh
+
+configfile=`echo $i | sed -e 's/^.*\///'`
+if grep -q -e '-torture:.* !!! ' < $i/console.log
+then
+	print_bug $configfile `grep -e '-torture:.* !!! ' < $i/console.log | tail -1`
+fi
+
+awk -v configfile="$configfile" -v summary="$i/torture.summary" '
+/-torture: rtc: / {
+	t = "";
+	if (match($0, /^\[ *[0-9.]+\]/))
+		t = substr($0, 2, RLENGTH - 2) + 0;
+	if (t0 == "")
+		t0 = t;
+	t1 = t;
+	for (f = 1; f < NF; f++) {
+		if ($f == "ver:")
+			ver = $(f + 1);
+		else if ($f == "rtf:")
+			rtf = $(f + 1);
+		else if ($f == "barrier:")
+			barrier = $(f + 1);
+		else if ($f == "cbflood:")
+			cbflood = $(f + 1);
+		else if ($f == "onoff:")
+			onoff = $(f + 1);
+	}
+	flavor = $0;
+	sub(/-torture: rtc: .*$/, "", flavor);
+	sub(/^.* /, "", flavor);
+}
+
+END {
+	if (ver == "") {
+		print "No rcutorture statistics found???";
+		exit;
+	}
+	secs = t1 - t0;
+	rate = secs > 0 ? rtf / secs : 0;
+	print "Updates: " ver "  Callback-freed blocks: " rtf "  Barriers (ok/tries:errs): " barrier "  Callback floods: " cbflood;
+	if (onoff != "")
+		print "CPU hotplug (onlines/tries offlines/tries): " onoff;
+	if (secs > 0)
+		print "Updates per second: " ver / secs "  Callback frees per second: " rtf / secs;
+	printf "%s %s torture %d %d %.1f\n", configfile, flavor, ver, rtf,
+	       rate > summary;
+}' < $i/console.log
@@ -0,0 +1,108 @@
+#!/bin/bash
+#
+# Analyze a given results directory for rcuperf performance measurements,
+# producing a grace-period (or, for rcuperf.gp_async=1 runs, callback)
+# latency and throughput summary.  A one-line machine-readable copy of
+# the summary is left in the perf.summary file for kvm-prcu-compare.sh.
+#
+# Usage: kvm-recheck-rcuperf.sh resdir
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, you can access it online at
+# http://www.gnu.org/licenses/gpl-2.0.html.
+
+i="$1"
+if test -d $i
+then
+	:
+else
+	echo Unreadable results directory: $i
+	exit 1
+fi
+PATH=`pwd`/tools/testing/selftests/rcutorture/bin:$PATH; export PATH
+. functions.sh
+
+configfile=`echo $i | sed -e 's/^.*\///'`
+
+T=${TMPDIR-/tmp}/kvm-recheck-rcuperf.sh.$$
+trap 'rm -f $T.con' 0
+
+sed -e 's/^\[[^]]*]//' < $i/console.log > $T.con
+
+# Pull the run parameters and the overall grace-period counts.
+params="`awk '
+/-perf: .* gp_async=/ {
+	for (f = 1; f <= NF; f++) {
+		if ($f ~ /^gp_async=/)
+			gp_async = substr($f, 10) + 0;
+		if ($f ~ /^gp_exp=/)
+			gp_exp = substr($f, 8) + 0;
+		if ($f ~ /^nwriters=/)
+			nwriters = substr($f, 10) + 0;
+	}
+	flavor = $1;
+	sub(/-perf:$/, "", flavor);
+}
+
+/-perf: .*start: .* duration: .* gps: / {
+	for (f = 1; f < NF; f++) {
+		if ($f == "duration:")
+			duration = $(f + 1);
+		if ($f == "gps:")
+			gps = $(f + 1);
+		if ($f == "batches:")
+			batches = $(f + 1);
+	}
+}
+
+END {
+	mode = gp_async ? "cb" : (gp_exp ? "exp" : "gp");
+	print flavor, mode, nwriters + 0, duration + 0, gps + 0, batches + 0;
+}' < $T.con`"
+set -- $params
+
+# Zero-valued durations are unused slots or failed gp_async allocations.
+awk '/-perf: .* writer-duration: / && $NF > 0 { print $NF / 1000. }' < $T.con |
+sort -n |
+awk -v configfile="$configfile" -v summary="$i/perf.summary" \
+    -v flavor="$1" -v mode="$2" -v nwriters="$3" \
+    -v duration="$4" -v gps="$5" -v batches="$6" '
+{
+	gptimes[++n] = $1;
+	sum += $1;
+}
+
+END {
+	if (n <= 0) {
+		print "No rcuperf records found???";
+		exit;
+	}
+	pct50 = int((n * 50 + 99) / 100);
+	pct90 = int((n * 90 + 99) / 100);
+	pct99 = int((n * 99 + 99) / 100);
+	rate = duration > 0 ? gps * 1000000000. / duration : 0;
+	if (mode == "cb")
+		what = "Callback invocation";
+	else if (mode == "exp")
+		what = "Expedited grace-period";
+	else
+		what = "Grace-period";
+	print what " latency for " flavor " with " nwriters " writers, " n " samples (us):";
+	print "Minimum: " gptimes[1] "  Average: " sum / n;
+	print "50th percentile: " gptimes[pct50] "  90th percentile: " gptimes[pct90] "  99th percentile: " gptimes[pct99];
+	print "Maximum: " gptimes[n];
+	print (mode == "cb" ? "Callbacks" : "Grace periods") " per second: " rate "  Batches: " batches;
+	printf "%s %s %s %d %.3f %.3f %.3f %.3f %.3f %.1f\n",
+	       configfile, flavor, mode, n, sum / n, gptimes[pct50],
+	       gptimes[pct90], gptimes[pct99], gptimes[n], rate > summary;
+}'
@@ -0,0 +1,264 @@
+#!/bin/bash
+#
+# Run a series of tests under KVM.  By default, this series is specified
+# by the relevant CFLIST file, but can be overridden by the --configs
+# command-line argument.  Each scenario is built, booted under qemu,
+# checked for errors and summarized by kvm-recheck.sh, which finishes
+# by tabulating each PRCU scenario against its RCU baseline.
+#
+# Usage: kvm.sh [ options ]
+#
+# The default "kvm.sh --torture rcuperf" regenerates the PRCU versus
+# RCU grace-period and callback comparison from scratch.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, you can access it online at
+# http://www.gnu.org/licenses/gpl-2.0.html.
+
+scriptname=$0
+args="$*"
+
+T=${TMPDIR-/tmp}/kvm.sh.$$
+trap 'rm -rf $T' 0
+mkdir $T
+
+dur=$((30*60))
+dryrun=""
+KVM="`pwd`/tools/testing/selftests/rcutorture"; export KVM
+PATH=${KVM}/bin:$PATH; export PATH
+TORTURE_DEFCONFIG=defconfig
+TORTURE_BOOT_IMAGE=""
+TORTURE_INITRD="$KVM/initrd"; export TORTURE_INITRD
+TORTURE_KCONFIG_ARG=""
+TORTURE_KMAKE_ARG=""
+TORTURE_QEMU_MEM=512
+TORTURE_SHUTDOWN_GRACE=180
+TORTURE_SUITE=rcu
+TORTURE_PERF_GP_ASYNC=1
+resdir=""
+configs=""
+cpus=0
+ds=`date +%Y.%m.%d-%H:%M:%S`
+
+. functions.sh
+
+usage () {
+	echo "Usage: $scriptname optional arguments:"
+	echo "       --bootargs kernel-boot-arguments"
+	echo "       --buildonly"
+	echo "       --configs \"config-file list\""
+	echo "       --cpus N"
+	echo "       --datestamp string"
+	echo "       --defconfig string"
+	echo "       --dryrun"
+	echo "       --duration minutes"
+	echo "       --kconfig Kconfig-options"
+	echo "       --kmake-arg kernel-make-arguments"
+	echo "       --memory megabytes"
+	echo "       --no-gp-async"
+	echo "       --qemu-args qemu-system-..."
+	echo "       --qemu-cmd qemu-system-..."
+	echo "       --results absolute-pathname"
+	echo "       --torture rcu|rcuperf"
+	exit 1
+}
+
+while test $# -gt 0
+do
+	case "$1" in
+	--bootargs|--bootarg)
+		checkarg --bootargs "(list of kernel boot arguments)" "$#" "$2" '.*' '^--'
+		TORTURE_BOOTARGS="$2"
+		shift
+		;;
+	--buildonly)
+		TORTURE_BUILDONLY=1
+		;;
+	--configs|--config)
+		checkarg --configs "(list of config files)" "$#" "$2" '^[^/]*$' '^--'
+		configs="$2"
+		shift
+		;;
+	--cpus)
+		checkarg --cpus "(number)" "$#" "$2" '^[0-9]*$' '^--'
+		cpus=$2
+		shift
+		;;
+	--datestamp)
+		checkarg --datestamp "(relative pathname)" "$#" "$2" '^[^/]*$' '^--'
+		ds=$2
+		shift
+		;;
+	--defconfig)
+		checkarg --defconfig "defconfigtype" "$#" "$2" '^[^/][^/]*$' '^--'
+		TORTURE_DEFCONFIG=$2
+		shift
+		;;
+	--dryrun)
+		dryrun=1
+		;;
+	--duration)
+		checkarg --duration "(minutes)" $# "$2" '^[0-9]*$' '^error'
+		dur=$(($2*60))
+		shift
+		;;
+	--kconfig)
+		checkarg --kconfig "(Kconfig options)" $# "$2" '^CONFIG_[A-Z0-9_]\+=\([ynm]\|[0-9]\+\)\( CONFIG_[A-Z0-9_]\+=\([ynm]\|[0-9]\+\)\)*$' '^error$'
+		TORTURE_KCONFIG_ARG="$2"
+		shift
+		;;
+	--kmake-arg)
+		checkarg --kmake-arg "(kernel make arguments)" $# "$2" '.*' '^error$'
+		TORTURE_KMAKE_ARG="$2"
+		shift
+		;;
+	--memory)
+		checkarg --memory "(megabytes)" $# "$2" '^[0-9]\+$' '^error'
+		TORTURE_QEMU_MEM=$2
+		shift
+		;;
+	--no-gp-async)
+		TORTURE_PERF_GP_ASYNC=
+		;;
+	--qemu-args|--qemu-arg)
+		checkarg --qemu-args "-qemu args" $# "$2" '^-' '^error'
+		TORTURE_QEMU_ARG="$2"
+		shift
+		;;
+	--qemu-cmd)
+		checkarg --qemu-cmd "(qemu-system-...)" $# "$2" 'qemu-system-' '^--'
+		TORTURE_QEMU_CMD="$2"
+		shift
+		;;
+	--results)
+		checkarg --results "(absolute pathname)" "$#" "$2" '^/' '^error'
+		resdir=$2
+		shift
+		;;
+	--torture)
+		checkarg --torture "(suite name)" "$#" "$2" '^\(rcu\|rcuperf\)$' '^--'
+		TORTURE_SUITE=$2
+		shift
+		;;
+	*)
+		echo Unknown argument $1
+		usage
+		;;
+	esac
+	shift
+done
+
+CONFIGFRAG=${KVM}/configs/${TORTURE_SUITE}; export CONFIGFRAG
+export TORTURE_BOOT_IMAGE TORTURE_BUILDONLY TORTURE_DEFCONFIG
+export TORTURE_KCONFIG_ARG TORTURE_KMAKE_ARG TORTURE_QEMU_ARG
+export TORTURE_QEMU_CMD TORTURE_QEMU_MEM TORTURE_SHUTDOWN_GRACE
+
+if test -z "$configs"
+then
+	configs="`cat $CONFIGFRAG/CFLIST`"
+fi
+
+if test -z "$resdir"
+then
+	resdir=$KVM/res
+fi
+
+# Check the scenarios and work out how many CPUs each one wants,
+# limited by --cpus and by the number of CPUs on this system so that
+# overcommitted vCPUs do not distort the measurements.
+vcpus=`identify_qemu_vcpus`
+if test "$cpus" -eq 0 -o "$cpus" -gt "$vcpus"
+then
+	cpus=$vcpus
+fi
+touch $T/cfgcpu
+for CF in $configs
+do
+	if test -f "$CONFIGFRAG/$CF"
+	then
+		cpu_count=`configNR_CPUS.sh $CONFIGFRAG/$CF`
+		cpu_count=`configfrag_boot_cpus "$TORTURE_BOOTARGS" "$CONFIGFRAG/$CF" "$cpu_count"`
+		if test "$cpu_count" -gt "$cpus"
+		then
+			echo $CF: CPU count limited from $cpu_count to $cpus
+			cpu_count=$cpus
+		fi
+		echo $CF $cpu_count >> $T/cfgcpu
+	else
+		echo "The --configs file $CF does not exist, terminating."
+		exit 1
+	fi
+done
+
+# For rcuperf, boot each scenario a second time (reusing the kernel)
+# to measure callback rather than grace-period performance.
+touch $T/runs
+while read CF cpu_count
+do
+	echo $CF $CF $cpu_count "" >> $T/runs
+	if test "$TORTURE_SUITE" = rcuperf -a -n "$TORTURE_PERF_GP_ASYNC"
+	then
+		echo $CF $CF.2 $cpu_count rcuperf.gp_async=1 >> $T/runs
+	fi
+done < $T/cfgcpu
+
+if test -n "$dryrun"
+then
+	echo Results directory: $resdir/$ds
+	echo Torture suite: $TORTURE_SUITE
+	echo Duration: $dur seconds per scenario
+	cat $T/runs
+	exit 0
+fi
+
+# The tests run entirely in the kernel, so all the initrd needs is an
+# init that stays out of the way until the test powers off the guest.
+if test -z "$TORTURE_BUILDONLY" -a ! -x "$TORTURE_INITRD/init"
+then
+	echo No initrd at $TORTURE_INITRD, creating a minimal one.
+	mkdir -p $TORTURE_INITRD
+	cat > $T/init.c << '___EOF___'
+#include <unistd.h>
+
+int main(int argc, char *argv[])
+{
+	for (;;)
+		sleep(1000);
+	return 0;
+}
+___EOF___
+	if ! cc -static -O2 -o $TORTURE_INITRD/init $T/init.c
+	then
+		echo Could not build a static init, supply one at $TORTURE_INITRD/init
+		exit 1
+	fi
+fi
+
+mkdir -p $resdir/$ds || exit 1
+echo $scriptname $args > $resdir/$ds/log
+echo $TORTURE_SUITE > $resdir/$ds/TORTURE_SUITE
+builddir=$resdir/$ds/b1
+mkdir -p $builddir
+
+while read CF rd cpu_count extra_boot
+do
+	mkdir $resdir/$ds/$rd
+	echo ' ---' `date`: Starting $rd "(${cpu_count} CPUs)" | tee -a $resdir/$ds/log
+	kvm-test-1-run.sh $CONFIGFRAG/$CF $builddir $resdir/$ds/$rd $dur \
+		"$TORTURE_QEMU_ARG -smp $cpu_count" \
+		"$TORTURE_BOOTARGS $extra_boot" > $resdir/$ds/$rd/kvm-test-1-run.sh.out 2>&1
+	cat $resdir/$ds/$rd/kvm-test-1-run.sh.out | tee -a $resdir/$ds/log
+done < $T/runs
+
+echo ' ---' `date`: Done | tee -a $resdir/$ds/log
+kvm-recheck.sh $resdir/$ds | tee $resdir/$ds/summary
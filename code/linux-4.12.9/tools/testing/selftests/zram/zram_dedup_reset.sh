@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# Reset zram devices with use_dedup set while use_dedup is being flipped
+# and writes are coming in, to check that pages stored as dedup entries
+# are freed as such even if use_dedup changes under the reset.
+#
+# Usage: zram_dedup_reset.sh [ iterations [ size_mb ] ]
+#
+# Half of the data written is repeated so that both shared and unshared
+# entries are freed by each reset. The kernel log is checked for oopses
+# and zsmalloc warnings at the end.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+
+iterations=${1:-100}
+size_mb=${2:-64}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit 1
+fi
+
+if [ ! -d /sys/class/zram-control ]; then
+	modprobe zram num_devices=0 || exit 1
+fi
+
+dev_id=$(cat /sys/class/zram-control/hot_add) || exit 1
+dev=/dev/zram$dev_id
+sys=/sys/block/zram$dev_id
+src=$(mktemp -p /dev/shm zram_dedup_reset.XXXXXX) || exit 1
+pids=
+
+cleanup() {
+	[ -n "$pids" ] && kill $pids 2> /dev/null
+	wait
+	echo 1 > $sys/reset
+	echo $dev_id > /sys/class/zram-control/hot_remove
+	rm -f $src
+}
+trap cleanup EXIT
+
+if ! echo 1 > $sys/use_dedup 2> /dev/null; then
+	echo "$0: CONFIG_ZRAM_DEDUP not set"
+	exit 4
+fi
+
+chunk=$((size_mb / 4))
+head -c $((chunk * 3 / 4))M /dev/urandom | base64 -w 0 |
+	head -c ${chunk}M > $src
+for i in 1 2 3; do
+	head -c $((chunk * 3 / 4))M /dev/urandom | base64 -w 0 |
+		head -c ${chunk}M >> $src
+done
+# the second half is the first one again
+head -c $((size_mb / 2))M $src > $src.dup && cat $src.dup >> $src
+rm -f $src.dup
+
+# Flip use_dedup as fast as possible, it only sticks between resets
+(
+	while :; do
+		echo 0 > $sys/use_dedup
+		echo 1 > $sys/use_dedup
+	done 2> /dev/null
+) &
+pids="$pids $!"
+
+# Keep writing, so that the resets race with opens and I/O
+(
+	while :; do
+		dd if=$src of=$dev bs=1M oflag=direct status=none
+	done 2> /dev/null
+) &
+pids="$pids $!"
+
+dmesg_start=$(dmesg | wc -l)
+
+for i in $(seq $iterations); do
+	echo ${size_mb}M > $sys/disksize 2> /dev/null
+	sleep 0.1
+	# reset fails with EBUSY while the writer has the device open
+	until echo 1 > $sys/reset 2> /dev/null; do
+		:
+	done
+done
+
+kill $pids 2> /dev/null
+wait
+pids=
+
+if dmesg | tail -n +$((dmesg_start + 1)) |
+	grep -q -e "BUG" -e "WARNING" -e "general protection"; then
+	echo "$0: FAIL, see dmesg"
+	exit 1
+fi
+echo "$0: $iterations resets: PASS"
@@ -0,0 +1,64 @@
+#!/bin/bash
+#
+# Measure write throughput through a zram block device, once with pages
+# compressed by the submitting CPU and once with parallel_write set, so
+# that they are compressed by workers on all online CPUs.
+#
+# Usage: zram_write_bench.sh [ size_mb [ block_size [ algorithm ] ] ]
+#
+# The data written is base64 text, which compresses to roughly 3/4 of
+# its size, so that neither zram's same-filled page shortcut nor the
+# store-uncompressed path is taken.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+
+size_mb=${1:-1024}
+bs=${2:-1M}
+algo=${3:-lzo}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit 1
+fi
+
+if [ ! -d /sys/class/zram-control ]; then
+	modprobe zram num_devices=0 || exit 1
+fi
+
+dev_id=$(cat /sys/class/zram-control/hot_add) || exit 1
+dev=/dev/zram$dev_id
+sys=/sys/block/zram$dev_id
+src=$(mktemp -p /dev/shm zram_write_bench.XXXXXX) || exit 1
+
+cleanup() {
+	echo 1 > $sys/reset
+	echo $dev_id > /sys/class/zram-control/hot_remove
+	rm -f $src
+}
+trap cleanup EXIT
+
+head -c $((size_mb * 3 / 4))M /dev/urandom | base64 -w 0 |
+	head -c ${size_mb}M > $src
+
+run() {
+	local parallel=$1 start end
+
+	echo 1 > $sys/reset
+	echo $algo > $sys/comp_algorithm || exit 1
+	echo ${size_mb}M > $sys/disksize || exit 1
+	echo $parallel > $sys/parallel_write || exit 1
+
+	start=$(date +%s%N)
+	dd if=$src of=$dev bs=$bs oflag=direct conv=fsync status=none ||
+		exit 1
+	end=$(date +%s%N)
+
+	echo "parallel_write=$parallel: $((size_mb * 1000000000 / (end - start))) MB/s," \
+	     "mm_stat: $(cat $sys/mm_stat)"
+}
+
+echo "$size_mb MB in $bs writes, $algo, $(nproc) cpus"
+run 0
+run 1